@@ -355,7 +355,11 @@ function rgbSetConfig(c) {
     initial_state: parseInt(el(c, "initial").value),
     auto_off: autoOff,
     in_inverted: el(c, "in_inverted").checked,
-    transition_time: parseInt(el(c, "transition_time").value)
+    transition_time: parseInt(el(c, "transition_time").value),
+    dim_curve: parseInt(el(c, "dim_curve").value),
+    transition_space: parseInt(el(c, "transition_space").value),
+    effect_period: parseInt(el(c, "effect_period").value),
+    effect_depth: parseInt(el(c, "effect_depth").value)
   };
   if (autoOff) {
     cfg.auto_off_delay = dateStringToSeconds(autoOffDelay);
@@ -625,6 +629,9 @@ function findOrAddContainer(cd) {
       el(c, "hue_container").style.display = showcolor ? "block" : "none";
       el(c, "saturation_container").style.display =
           showcolor ? "block" : "none";
+      el(c, "transition_space_container").style.display =
+          showcolor ? "block" : "none";
+      el(c, "effect_3").style.display = showcolor ? "block" : "none";
       el(c, "color_temperature_container").style.display =
           showct ? "block" : "none";
       el(c, "color_container").style.display =
@@ -638,8 +645,8 @@ function findOrAddContainer(cd) {
         rgbSetConfig(c);
       };
       el(c, "hue").onchange = el(c, "saturation").onchange =
-          el(c, "color_temperature").onchange =
-              el(c, "brightness").onchange = function(ev) {
+          el(c, "color_temperature").onchange = el(c, "brightness").onchange =
+              el(c, "effect").onchange = function(ev) {
                 setComponentState(
                     c, rgbState(c, c.data.state), el(c, "toggle_spinner"));
                 setPreviewColor(c, cd.bulb_type);
@@ -673,7 +680,8 @@ function rgbState(c, newState) {
     state: newState, hue: el(c, "hue").value,
         saturation: el(c, "saturation").value,
         brightness: el(c, "brightness").value,
-        color_temperature: el(c, "color_temperature").value
+        color_temperature: el(c, "color_temperature").value,
+        effect: parseInt(el(c, "effect").value)
   }
 }
 
@@ -776,6 +784,11 @@ function updateComponent(cd) {
         slideIfNotModified(el(c, "saturation"), cd.saturation);
         slideIfNotModified(el(c, "brightness"), cd.brightness);
         setValueIfNotModified(el(c, "transition_time"), cd.transition_time);
+        selectIfNotModified(el(c, "dim_curve"), cd.dim_curve);
+        selectIfNotModified(el(c, "transition_space"), cd.transition_space);
+        selectIfNotModified(el(c, "effect"), cd.effect);
+        setValueIfNotModified(el(c, "effect_period"), cd.effect_period);
+        setValueIfNotModified(el(c, "effect_depth"), cd.effect_depth);
         setPreviewColor(c, cd.bulb_type);
       }
       break;
@@ -849,6 +862,12 @@ function updateComponent(cd) {
         calText = `\
           movement time: ${cd.move_time_ms / 1000} s, \
           avg power: ${cd.move_power} W`;
+        if (cd.open_time_ms > 0) {
+          calText = `\
+            close time: ${cd.move_time_ms / 1000} s, \
+            open time: ${cd.open_time_ms / 1000} s, \
+            avg power: ${cd.move_power} W`;
+        }
         el(c, "pos_ctl").style.display = "block";
       } else {
         posText = "n/a";
@@ -17,59 +17,113 @@
 
 #include "shelly_pm_ade7953.hpp"
 
+#include <algorithm>
 #include <cmath>
 
 #include "mgos.hpp"
 #include "mgos_ade7953.h"
+#include "mgos_sys_config.h"
 
 namespace shelly {
 
-struct mgos_ade7953 *s_ade7953 = NULL;
+// Readings below this are noise.
+#define ADE7953_MIN_APOWER 1.0f
+
+static std::vector<std::unique_ptr<ADE7953Sampler>> s_samplers;
+
+// static
+ADE7953Sampler *ADE7953Sampler::Get(struct mgos_ade7953 *ade7953) {
+  for (const auto &s : s_samplers) {
+    if (s->ade7953_ == ade7953) return s.get();
+  }
+  s_samplers.emplace_back(new ADE7953Sampler(ade7953));
+  return s_samplers.back().get();
+}
+
+ADE7953Sampler::ADE7953Sampler(struct mgos_ade7953 *ade7953)
+    : ade7953_(ade7953),
+      interval_ms_(
+          std::max(mgos_sys_config_get_shelly_pm_sample_interval_ms(), 50)),
+      sample_timer_(std::bind(&ADE7953Sampler::Sample, this)) {
+}
+
+void ADE7953Sampler::AddMeter(ADE7953PowerMeter *pm) {
+  pms_.push_back(pm);
+  if (!sample_timer_.IsValid()) {
+    sample_timer_.Reset(interval_ms_, MGOS_TIMER_REPEAT);
+  }
+}
+
+int64_t ADE7953Sampler::max_age_micros() const {
+  return std::max(interval_ms_ * 3, 1000) * 1000LL;
+}
+
+void ADE7953Sampler::Sample() {
+  float v = NAN, f = NAN;
+  if (!mgos_ade7953_get_voltage(ade7953_, &v) ||
+      !mgos_ade7953_get_frequency(ade7953_, &f)) {
+    LOG_EVERY_N(LL_ERROR, 100, ("ADE7953 read failed (%u)",
+                                (unsigned) num_errors_));
+    num_errors_++;
+    // Keep going, per-channel values are still useful.
+    v = f = NAN;
+  }
+  for (auto *pm : pms_) {
+    pm->Sample(std::fabs(v), f);
+  }
+}
 
 ADE7953PowerMeter::ADE7953PowerMeter(int id, struct mgos_ade7953 *ade7953,
                                      int channel)
-    : PowerMeter(id),
-      ade7953_(ade7953),
-      channel_(channel),
-      acc_timer_(std::bind(&ADE7953PowerMeter::AEAAccumulateTimerCB, this)) {
+    : PowerMeter(id), ade7953_(ade7953), channel_(channel) {
 }
 
 ADE7953PowerMeter::~ADE7953PowerMeter() {
 }
 
 Status ADE7953PowerMeter::Init() {
-  acc_timer_.Reset(10000, MGOS_TIMER_REPEAT);
+  sampler_ = ADE7953Sampler::Get(ade7953_);
+  sampler_->AddMeter(this);
+  // Take the first sample right away so the cache is never empty.
+  sampler_->Sample();
   return Status::OK();
 }
 
-StatusOr<float> ADE7953PowerMeter::GetPowerW() {
-  float apa = 0;
-  if (!mgos_ade7953_get_apower(ade7953_, channel_, &apa)) {
-    return mgos::Errorf(STATUS_UNAVAILABLE, "Failed to read %s", "AP");
+StatusOr<PowerMeter::Measurement> ADE7953PowerMeter::GetMeasurement() {
+  if (!status_.ok()) return status_;
+  auto mv = PowerMeter::GetMeasurement();
+  if (!mv.ok()) return mv;
+  const Measurement &m = mv.ValueOrDie();
+  if (mgos_uptime_micros() - m.ts > sampler_->max_age_micros()) {
+    return mgos::Errorf(STATUS_UNAVAILABLE, "stale %s", "sample");
   }
-  apa = std::fabs(apa);
-  if (apa < 1) apa = 0;  // Suppress noise.
-  return apa;
+  return mv;
 }
 
-StatusOr<float> ADE7953PowerMeter::GetEnergyWH() {
-  return GetEnergyWH(false /* reset */);
-}
-
-StatusOr<float> ADE7953PowerMeter::GetEnergyWH(bool reset) {
-  float aea = 0;
-  if (!mgos_ade7953_get_aenergy(ade7953_, channel_, reset, &aea)) {
-    return mgos::Errorf(STATUS_UNAVAILABLE, "Failed to read %s", "AE");
+void ADE7953PowerMeter::Sample(float voltage, float frequency) {
+  float apa = 0, aea = 0, i = 0;
+  if (!mgos_ade7953_get_apower(ade7953_, channel_, &apa)) {
+    status_ = mgos::Errorf(STATUS_UNAVAILABLE, "Failed to read %s", "AP");
+    return;
   }
-  float res = aea_acc_ + std::fabs(aea);
-  if (reset) {
-    aea_acc_ = res;
+  // Energy register is reset on read, we keep the total.
+  if (!mgos_ade7953_get_aenergy(ade7953_, channel_, true /* reset */, &aea)) {
+    status_ = mgos::Errorf(STATUS_UNAVAILABLE, "Failed to read %s", "AE");
+    return;
   }
-  return res;
-}
-
-void ADE7953PowerMeter::AEAAccumulateTimerCB() {
-  GetEnergyWH(true /* reset */);
+  AddEnergyWH(std::fabs(aea));
+  Measurement m;
+  m.power_w = std::fabs(apa);
+  if (m.power_w < ADE7953_MIN_APOWER) m.power_w = 0;  // Suppress noise.
+  m.energy_wh = GetTotalEnergyWH();
+  m.voltage_v = voltage;
+  if (mgos_ade7953_get_current(ade7953_, channel_, &i)) {
+    m.current_a = std::fabs(i);
+  }
+  m.frequency_hz = frequency;
+  ComputePowerFactor(&m);
+  SetMeasurement(m);
+  status_ = Status::OK();
 }
 
 }  // namespace shelly
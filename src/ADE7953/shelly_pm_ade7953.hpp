@@ -15,32 +15,62 @@
  * limitations under the License.
  */
 
-#include "shelly_pm.hpp"
+#pragma once
+
+#include <vector>
 
-#include <cmath>
+#include "shelly_pm.hpp"
 
 #include "mgos.hpp"
 #include "mgos_ade7953.h"
+#include "mgos_timers.hpp"
 
 namespace shelly {
 
+class ADE7953PowerMeter;
+
+// Periodically reads all channels of one ADE7953 in a single burst.
+// Meters are served from the cached results, so the number of bus
+// transactions does not depend on how often consumers ask.
+class ADE7953Sampler {
+ public:
+  // Returns the sampler for the device, creating it if necessary.
+  static ADE7953Sampler *Get(struct mgos_ade7953 *ade7953);
+
+  void AddMeter(ADE7953PowerMeter *pm);
+  void Sample();
+
+  // Samples older than this are not served.
+  int64_t max_age_micros() const;
+
+ private:
+  explicit ADE7953Sampler(struct mgos_ade7953 *ade7953);
+
+  struct mgos_ade7953 *const ade7953_;
+  const int interval_ms_;
+  std::vector<ADE7953PowerMeter *> pms_;
+  uint32_t num_errors_ = 0;
+  mgos::Timer sample_timer_;
+};
+
 class ADE7953PowerMeter : public PowerMeter {
  public:
   ADE7953PowerMeter(int id, struct mgos_ade7953 *ade7953, int channel);
   virtual ~ADE7953PowerMeter();
 
   Status Init() override;
-  StatusOr<float> GetPowerW() override;
-  StatusOr<float> GetEnergyWH() override;
+  StatusOr<Measurement> GetMeasurement() override;
 
  private:
-  StatusOr<float> GetEnergyWH(bool reset);
-  void AEAAccumulateTimerCB();
+  // Called by the sampler with values that are common for all channels.
+  void Sample(float voltage, float frequency);
 
   struct mgos_ade7953 *const ade7953_;
   const int channel_;
-  float aea_acc_ = 0;  // Accumulated active energy.
-  mgos::Timer acc_timer_;
+  ADE7953Sampler *sampler_ = nullptr;
+  Status status_;  // Result of the last sample.
+
+  friend class ADE7953Sampler;
 };
 
 }  // namespace shelly
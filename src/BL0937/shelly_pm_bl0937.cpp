@@ -17,22 +17,29 @@
 
 #include "shelly_pm_bl0937.hpp"
 
+#include <algorithm>
 #include <cmath>
 
 #include "mgos.hpp"
 #include "mgos_iram.h"
 
+#include "shelly_pm_protection.hpp"
+
 namespace shelly {
 
 BL0937PowerMeter::BL0937PowerMeter(int id, int cf_pin, int cf1_pin, int sel_pin,
-                                   int meas_time, float apc)
+                                   int meas_time, float apc, float vpc,
+                                   float ipc)
     : PowerMeter(id),
       cf_pin_(cf_pin),
       cf1_pin_(cf1_pin),
       sel_pin_(sel_pin),
       meas_time_(meas_time),
       apc_(apc),
-      meas_timer_(std::bind(&BL0937PowerMeter::MeasureTimerCB, this)) {
+      vpc_(vpc),
+      ipc_(ipc),
+      meas_timer_(std::bind(&BL0937PowerMeter::MeasureTimerCB, this)),
+      cf1_timer_(std::bind(&BL0937PowerMeter::CF1TimerCB, this)) {
 }
 
 BL0937PowerMeter::~BL0937PowerMeter() {
@@ -43,65 +50,186 @@ BL0937PowerMeter::~BL0937PowerMeter() {
 }
 
 Status BL0937PowerMeter::Init() {
+  if (cf_pin_ >= 0 && apc_ <= 0) {
+    return mgos::Errorf(STATUS_INVALID_ARGUMENT, "power_coeff not set");
+  }
+  Status st = InitPins();
+  if (!st.ok()) return st;
+  meas_timer_.Reset(kEvalIntervalMs, MGOS_TIMER_REPEAT);
+  if (cf1_pin_ >= 0 && (vpc_ > 0 || ipc_ > 0)) {
+    // Start with a current window, unless only voltage is wanted.
+    SetSEL(ipc_ <= 0);
+    cf1_settling_ = true;
+    cf1_timer_.Reset(kCF1SettleMs, 0);
+  }
+  LOG(LL_INFO, ("BL0937 @ %d/%d/%d apc %f vpc %f ipc %f", cf_pin_, cf1_pin_,
+                sel_pin_, apc_, vpc_, ipc_));
+  return Status::OK();
+}
+
+Status BL0937PowerMeter::InitPins() {
   if (cf_pin_ < 0 && cf1_pin_ < 0) {
     return mgos::Errorf(STATUS_INVALID_ARGUMENT, "no valid pins");
   }
   if (cf_pin_ >= 0) {
-    if (apc_ <= 0) {
-      return mgos::Errorf(STATUS_INVALID_ARGUMENT, "power_coeff not set");
-    }
     mgos_gpio_setup_input(cf_pin_, MGOS_GPIO_PULL_NONE);
     mgos_gpio_set_int_handler_isr(cf_pin_, MGOS_GPIO_INT_EDGE_POS,
-                                  &BL0937PowerMeter::GPIOIntHandler,
-                                  (void *) &cf_count_);
+                                  &BL0937PowerMeter::CFIntHandler,
+                                  (void *) this);
     mgos_gpio_enable_int(cf_pin_);
   }
   if (cf1_pin_ >= 0) {
     mgos_gpio_setup_input(cf1_pin_, MGOS_GPIO_PULL_NONE);
     mgos_gpio_set_int_handler_isr(cf1_pin_, MGOS_GPIO_INT_EDGE_POS,
-                                  &BL0937PowerMeter::GPIOIntHandler,
-                                  (void *) &cf1_count_);
+                                  &BL0937PowerMeter::CF1IntHandler,
+                                  (void *) &cf1_);
     mgos_gpio_enable_int(cf1_pin_);
   }
   if (sel_pin_ >= 0) {
     mgos_gpio_setup_output(sel_pin_, 0);  // Select current measurement mode.
   }
-  meas_start_ = mgos_uptime_micros();
-  meas_timer_.Reset(meas_time_ * 1000, MGOS_TIMER_REPEAT);
-  LOG(LL_INFO, ("BL0937 @ %d/%d/%d apc %f", cf_pin_, cf1_pin_, sel_pin_, apc_));
   return Status::OK();
 }
 
-StatusOr<float> BL0937PowerMeter::GetPowerW() {
-  return apa_;
+void BL0937PowerMeter::SetSEL(bool voltage) {
+  sel_voltage_ = voltage;
+  if (sel_pin_ >= 0) mgos_gpio_write(sel_pin_, voltage);
+}
+
+// static
+IRAM void BL0937PowerMeter::PushPulse(PulseRing *ring, uint32_t ts) {
+  uint32_t head = ring->head;
+  ring->ts[head & (PulseRing::kSize - 1)] = ts;
+  // Publish the entry only after it has been written.
+  ring->head = head + 1;
+}
+
+IRAM bool BL0937PowerMeter::AddCFPulse(uint32_t ts) {
+  const uint32_t head = cf_ring_.head;
+  const uint32_t prev_ts = cf_ring_.ts[(head - 1) & (PulseRing::kSize - 1)];
+  PushPulse(&cf_ring_, ts);
+  if (trip_period_us_ == 0 || head == 0 || early_pending_) return false;
+  if (ts - prev_ts >= trip_period_us_) return false;
+  early_pending_ = true;
+  return true;
+}
+
+// static
+IRAM void BL0937PowerMeter::CFIntHandler(int pin, void *arg) {
+  auto *pm = (BL0937PowerMeter *) arg;
+  if (pm->AddCFPulse((uint32_t) mgos_uptime_micros())) {
+    mgos_invoke_cb(&BL0937PowerMeter::EarlyMeasureCB, pm, true /* from_isr */);
+  }
+  (void) pin;
+}
+
+// static
+void BL0937PowerMeter::EarlyMeasureCB(void *arg) {
+  ((BL0937PowerMeter *) arg)->Measure();
 }
 
-StatusOr<float> BL0937PowerMeter::GetEnergyWH() {
-  return aea_;
+// static
+IRAM void BL0937PowerMeter::AddCF1Pulse(CF1Window *w, uint32_t ts) {
+  if (w->count == 0) w->first_ts = ts;
+  w->last_ts = ts;
+  w->count = w->count + 1;
 }
 
 // static
-IRAM void BL0937PowerMeter::GPIOIntHandler(int pin, void *arg) {
-  (*((uint32_t *) arg))++;
+IRAM void BL0937PowerMeter::CF1IntHandler(int pin, void *arg) {
+  AddCF1Pulse((CF1Window *) arg, (uint32_t) mgos_uptime_micros());
   (void) pin;
 }
 
+void BL0937PowerMeter::UpdatePower(uint32_t now) {
+  static constexpr uint32_t kMask = PulseRing::kSize - 1;
+  const uint32_t head = cf_ring_.head;
+  const uint32_t n = head - last_head_;
+  if (n > 0) {
+    AddEnergyWH(n * apc_ / 3600.0f);  // Each pulse is apc_ watt-seconds.
+    // Average over the most recent periods still in the ring. The oldest
+    // entry is kept out of reach as the ISR may be overwriting it.
+    uint32_t k = std::min(n, PulseRing::kSize - 2);
+    k = std::min(k, head - 1);
+    uint32_t t1 = cf_ring_.ts[(head - 1) & kMask];
+    if (k > 0) {
+      uint32_t t0 = cf_ring_.ts[(head - 1 - k) & kMask];
+      // Discard the sample if the ISR lapped us while reading.
+      if (cf_ring_.head - head < PulseRing::kSize - k && t1 != t0) {
+        apa_ = apc_ * 1e6f * k / (t1 - t0);
+      }
+    }
+    last_pulse_ts_ = t1;
+    last_head_ = head;
+  } else if (apa_ > 0) {
+    uint32_t since = now - last_pulse_ts_;
+    if (since >= kPulseTimeoutMs * 1000U) {
+      apa_ = 0;
+    } else if (since > 0) {
+      apa_ = std::min(apa_, apc_ * 1e6f / since);
+    }
+  }
+}
+
+void BL0937PowerMeter::SetProtection(PMProtection *p) {
+  PowerMeter::SetProtection(p);
+  float max_power_w = (p != nullptr ? p->limits().max_power_w : 0);
+  // Pulses closer together than this mean power is above the limit.
+  trip_period_us_ = (max_power_w > 0 ? apc_ * 1e6f / max_power_w : 0);
+}
+
 void BL0937PowerMeter::MeasureTimerCB() {
-  uint32_t cf_count = cf_count_, cf1_count = cf1_count_;
-  float elapsed_sec = (mgos_uptime_micros() - meas_start_) / 1000000.0f;
-  if (cf_count < 2) cf_count = 0;    // Noise
-  if (cf1_count < 2) cf1_count = 0;  // Noise
-  float cfps = (cf_count / elapsed_sec), cf1ps = (cf1_count / elapsed_sec);
-  apa_ = cfps * apc_;                       // Watts
-  aea_ += (apa_ / (3600.0f / meas_time_));  // Watt-hours
-  LOG(LL_DEBUG, ("cfcnt %d cfps %.2f, cf1cnt %d cf1ps %.2f; apa %.2f aea %.2f",
-                 (int) cf_count, cfps, (int) cf1_count, cf1ps, apa_, aea_));
-  // Start new measurement cycle.
+  // At most one early measurement per tick, even if power stays high.
+  early_pending_ = false;
+  Measure();
+}
+
+void BL0937PowerMeter::Measure() {
+  UpdatePower((uint32_t) mgos_uptime_micros());
+  Measurement m;
+  m.power_w = apa_;
+  m.energy_wh = GetTotalEnergyWH();
+  m.voltage_v = avrms_;
+  m.current_a = airms_;
+  ComputePowerFactor(&m);
+  SetMeasurement(m);
+}
+
+void BL0937PowerMeter::CF1TimerCB() {
+  const int window_ms = std::max(meas_time_ * 1000 / 2, 2 * kCF1SettleMs);
   mgos_ints_disable();
-  cf_count_ = 0;
-  cf1_count_ = 0;
-  meas_start_ = mgos_uptime_micros();
+  uint32_t count = cf1_.count, first_ts = cf1_.first_ts,
+           last_ts = cf1_.last_ts;
+  cf1_.count = 0;
   mgos_ints_enable();
+  if (cf1_settling_) {
+    // Pulses so far belong to the previous mode, start the window proper.
+    cf1_settling_ = false;
+    cf1_timer_.Reset(window_ms - kCF1SettleMs, 0);
+    return;
+  }
+  // Frequency from the span between the first and last pulse; fewer than
+  // 2 pulses in the window means the input is below the measurable range.
+  float freq = 0;
+  if (count >= 2 && last_ts != first_ts) {
+    freq = (count - 1) * 1e6f / (last_ts - first_ts);
+  }
+  if (sel_voltage_) {
+    avrms_ = freq * vpc_;
+  } else {
+    airms_ = freq * ipc_;
+  }
+  LOG(LL_DEBUG, ("cf1 %s cnt %u freq %.2f; avrms %.2f airms %.3f",
+                 (sel_voltage_ ? "V" : "I"), (unsigned) count, freq, avrms_,
+                 airms_));
+  // Alternate modes only if both are wanted and SEL is connected.
+  if (sel_pin_ >= 0 && vpc_ > 0 && ipc_ > 0) {
+    SetSEL(!sel_voltage_);
+    cf1_settling_ = true;
+    cf1_timer_.Reset(kCF1SettleMs, 0);
+  } else {
+    cf1_timer_.Reset(window_ms, 0);
+  }
 }
 
 }  // namespace shelly
@@ -21,30 +21,90 @@
 
 namespace shelly {
 
+// Power is derived from the CF pulse period rather than from pulse counts
+// over a fixed window: the ISR stores pulse timestamps in a lock-free ring
+// and the evaluation timer averages the most recent periods. When pulses
+// stop arriving the estimate decays as apc / (time since last pulse), which
+// is the maximum power consistent with not having seen the next pulse yet,
+// and drops to zero after kPulseTimeoutMs.
+//
+// If SEL is connected, CF1 alternates between current (SEL low) and voltage
+// (SEL high) windows of meas_time / 2 each. Pulses during the first
+// kCF1SettleMs after a switch are discarded.
+//
+// With a power limit set by protection, the ISR also compares each CF period
+// with the one corresponding to the limit and requests a measurement right
+// away when it is shorter, instead of waiting for the next evaluation tick.
 class BL0937PowerMeter : public PowerMeter {
  public:
   BL0937PowerMeter(int id, int cf_pin, int cf1_pin, int sel_pin, int meas_time,
-                   float apc);
+                   float apc, float vpc = 0, float ipc = 0);
   virtual ~BL0937PowerMeter();
 
   Status Init() override;
-  StatusOr<float> GetPowerW() override;
-  StatusOr<float> GetEnergyWH() override;
+  void SetProtection(PMProtection *p) override;
+
+ protected:
+  static constexpr int kEvalIntervalMs = 250;
+  static constexpr int kPulseTimeoutMs = 20000;
+  static constexpr int kCF1SettleMs = 100;
+
+  // Single producer (ISR) / single consumer (timer) ring of CF pulse
+  // timestamps: low 32 bits of uptime in microseconds.
+  struct PulseRing {
+    static constexpr uint32_t kSize = 16;  // Must be a power of 2.
+    volatile uint32_t head = 0;            // Total number of pulses stored.
+    volatile uint32_t ts[kSize] = {};
+  };
+
+  // CF1 pulses within the current measurement window.
+  struct CF1Window {
+    volatile uint32_t count = 0;
+    volatile uint32_t first_ts = 0, last_ts = 0;
+  };
+
+  // GPIO setup, overridden by the mock in the ubuntu build.
+  virtual Status InitPins();
+  virtual void SetSEL(bool voltage);
+
+  static void PushPulse(PulseRing *ring, uint32_t ts);
+  static void AddCF1Pulse(CF1Window *w, uint32_t ts);
+
+  // Stores a CF pulse. Returns true if the period since the previous pulse
+  // is above the protection limit and an early Measure() should be made.
+  bool AddCFPulse(uint32_t ts);
+  // Evaluates the pulses received so far and publishes a measurement.
+  void Measure();
+
+  const int cf_pin_, cf1_pin_, sel_pin_, meas_time_;
+  const float apc_, vpc_, ipc_;
+
+  PulseRing cf_ring_;
+  CF1Window cf1_;
+  bool sel_voltage_ = false;
 
  private:
-  static void GPIOIntHandler(int pin, void *arg);
+  static void CFIntHandler(int pin, void *arg);
+  static void CF1IntHandler(int pin, void *arg);
+  static void EarlyMeasureCB(void *arg);
   void MeasureTimerCB();
+  void UpdatePower(uint32_t now);
+  void CF1TimerCB();
 
-  const int cf_pin_, cf1_pin_, sel_pin_, meas_time_;
-  const float apc_;
+  bool cf1_settling_ = false;
 
-  volatile uint32_t cf_count_ = 0, cf1_count_ = 0;
-  int64_t meas_start_ = 0;
+  // CF period corresponding to the protection power limit, 0 - none.
+  volatile uint32_t trip_period_us_ = 0;
+  // Early measurement requested, cleared by the evaluation tick.
+  volatile bool early_pending_ = false;
 
-  float apa_ = 0;  // Last active power reading, W.
-  float aea_ = 0;  // Accumulated active energy, Wh.
+  uint32_t last_head_ = 0;      // Ring head at last evaluation.
+  uint32_t last_pulse_ts_ = 0;  // Timestamp of the most recent pulse.
+  float apa_ = 0;               // Current power estimate, W.
+  float avrms_ = NAN, airms_ = NAN;
 
   mgos::Timer meas_timer_;
+  mgos::Timer cf1_timer_;
 };
 
 }  // namespace shelly
@@ -17,7 +17,9 @@
 
 #include "shelly_pm_bl0942.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 
 #include "mgos.hpp"
 
@@ -47,6 +49,7 @@ BL0942PowerMeter::BL0942PowerMeter(int id, int tx_pin, int rx_pin,
       meas_time_(meas_time),
       uart_no_(uart_no),
       cfg_(cfg),
+      config_timer_(std::bind(&BL0942PowerMeter::ConfigTimerCB, this)),
       meas_timer_(std::bind(&BL0942PowerMeter::MeasureTimerCB, this)) {
 }
 
@@ -66,8 +69,87 @@ BL0942PowerMeter::~BL0942PowerMeter() {
 #define BL_ADDR 0x0
 
 #define BL_WATT 0x6
+#define BL_PACKET 0xAA
+
+constexpr uint8_t BL0942FrameAssembler::kFrameHeader;
+constexpr size_t BL0942FrameAssembler::kFrameLen;
+
+// Reset frame on the wire (6 bytes at 9600 baud, ~6.3 ms) and the reset.
+static constexpr int kResetDelayMs = 10;
+
+bool BL0942FrameAssembler::Feed(uint8_t b) {
+  if (len_ == 0 && b != kFrameHeader) {
+    stats_.num_dropped_bytes++;
+    return false;
+  }
+  buf_[len_++] = b;
+  if (len_ < kFrameLen) return false;
+  if (buf_[kFrameLen - 1] == Checksum(buf_)) {
+    stats_.num_frames++;
+    len_ = 0;
+    return true;
+  }
+  stats_.num_bad_csum++;
+  Resync();
+  return false;
+}
+
+void BL0942FrameAssembler::Reset() {
+  stats_.num_dropped_bytes += len_;
+  len_ = 0;
+}
+
+const uint8_t *BL0942FrameAssembler::frame() const {
+  return buf_;
+}
+
+const BL0942FrameAssembler::Stats &BL0942FrameAssembler::stats() const {
+  return stats_;
+}
+
+// static
+uint8_t BL0942FrameAssembler::Checksum(const uint8_t *frame) {
+  // For the full packet read the register address is not included.
+  uint8_t cs = BL_READ | BL_ADDR;
+  for (size_t i = 0; i < kFrameLen - 1; i++) {
+    cs += frame[i];
+  }
+  return cs ^ 0xFF;
+}
+
+void BL0942FrameAssembler::Resync() {
+  size_t i = 1;
+  while (i < len_ && buf_[i] != kFrameHeader) i++;
+  stats_.num_dropped_bytes += i;
+  len_ -= i;
+  memmove(buf_, buf_ + i, len_);
+}
 
 Status BL0942PowerMeter::Init() {
+  Status st = InitUART();
+  if (!st.ok()) return st;
+
+  LOG(LL_INFO, ("BL0942 @ %d/%d", rx_pin_, tx_pin_));
+
+  // Writes are queued in the UART TX buffer, no need to wait for them.
+  // Anything that reaches the chip while it resets is lost, configuration
+  // is written once the reset is done.
+  WriteReg(BL_SOFT_RESET, 0x5a5a5a);
+  config_timer_.Reset(kResetDelayMs, 0);
+
+  return Status::OK();
+}
+
+void BL0942PowerMeter::ConfigTimerCB() {
+  // this is what stock does
+  WriteReg(BL_USR_WRPROT, 0x550000);
+  WriteReg(BL_MODE, 0x8F0000);
+  WriteReg(BL_WA_CREEP, 0x330000);
+
+  meas_timer_.Reset(meas_time_ * 1000, MGOS_TIMER_REPEAT);
+}
+
+Status BL0942PowerMeter::InitUART() {
   if (rx_pin_ < 0 && tx_pin_ < 0) {
     return mgos::Errorf(STATUS_INVALID_ARGUMENT, "no valid pins");
   }
@@ -86,30 +168,17 @@ Status BL0942PowerMeter::Init() {
     return mgos::Errorf(STATUS_INVALID_ARGUMENT, "Failed to configure UART");
   }
 
+  mgos_uart_set_dispatcher(uart_no_, &BL0942PowerMeter::UARTDispatcher, this);
   mgos_uart_set_rx_enabled(uart_no_, true);
 
-  meas_timer_.Reset(meas_time_ * 1000, MGOS_TIMER_REPEAT);
-  LOG(LL_INFO, ("BL0942 @ %d/%d", rx_pin_, tx_pin_));
-
-  this->WriteReg(BL_SOFT_RESET, 0x5a5a5a);
-
-  // this is what stock does
-  this->WriteReg(BL_USR_WRPROT, 0x550000);
-  this->WriteReg(BL_MODE, 0x8F0000);
-  this->WriteReg(BL_WA_CREEP, 0x330000);
-
   return Status::OK();
 }
 
-StatusOr<float> BL0942PowerMeter::GetPowerW() {
-  return apa_;
+void BL0942PowerMeter::WriteUART(const uint8_t *data, size_t len) {
+  mgos_uart_write(uart_no_, data, len);
 }
 
-StatusOr<float> BL0942PowerMeter::GetEnergyWH() {
-  return aea_;
-}
-
-bool BL0942PowerMeter::WriteReg(uint8_t reg, uint32_t val) {
+void BL0942PowerMeter::WriteReg(uint8_t reg, uint32_t val) {
   uint8_t tx_buf[6] = {BL_WRITE | BL_ADDR,
                        reg,
                        (uint8_t) ((val >> 16) & 0xFF),
@@ -121,82 +190,88 @@ bool BL0942PowerMeter::WriteReg(uint8_t reg, uint32_t val) {
     tx_buf[5] += tx_buf[i];
   }
   tx_buf[5] = tx_buf[5] ^ 0xFF;
-  mgos_uart_write(uart_no_, tx_buf, 6);
-  mgos_uart_flush(uart_no_);
-  mgos_msleep(1);
-  return true;
+  WriteUART(tx_buf, sizeof(tx_buf));
 }
 
-bool BL0942PowerMeter::ReadReg(uint8_t reg, uint8_t *rx_buf, size_t len) {
-  bool whole_packet = (len == 23);
+void BL0942PowerMeter::SendReadRequest(uint8_t reg) {
   uint8_t tx_buf[2] = {BL_READ | BL_ADDR, reg};
-  mgos_uart_write(uart_no_, tx_buf, 2);
-  mgos_uart_flush(uart_no_);
-
-  // Delay to allow data to be available
-  int baud = 9600;
-  mgos_msleep(roundf(len * 8 / baud) * 1e3);
-
-  int read_len = mgos_uart_read(uart_no_, rx_buf, len);
+  WriteUART(tx_buf, sizeof(tx_buf));
+}
 
-  uint8_t chksum =
-      tx_buf[0] +
-      (whole_packet ? 0 : tx_buf[1]);  // ignore tx_buf[1] when reading packet
-  for (int i = 0; i < len - 1; i++) {
-    chksum += rx_buf[i];
-    // LOG(LL_INFO, ("data %i:%02X", i, rx_buf[i]));
+// static
+void BL0942PowerMeter::UARTDispatcher(int uart_no, void *arg) {
+  BL0942PowerMeter *pm = static_cast<BL0942PowerMeter *>(arg);
+  uint8_t buf[32];
+  size_t avail;
+  while ((avail = mgos_uart_read_avail(uart_no)) > 0) {
+    size_t n = mgos_uart_read(uart_no, buf, std::min(avail, sizeof(buf)));
+    if (n == 0) break;
+    pm->HandleRxData(buf, n);
   }
-  chksum ^= 0xFF;
+}
 
-  if (read_len != len || rx_buf[len - 1] != chksum) {
-    LOG(LL_ERROR, ("wrong checksum"));
-    return false;
+void BL0942PowerMeter::HandleRxData(const uint8_t *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    if (asm_.Feed(data[i])) {
+      resp_pending_ = false;
+      HandleFrame(asm_.frame());
+    }
   }
-  return true;
 }
 
-uint32_t convert_le24(uint8_t v[3]) {
+uint32_t convert_le24(const uint8_t v[3]) {
   return ((uint32_t) v[2] << 16) | (uint32_t) (v[1] << 8) | v[0];
 }
 
-uint32_t convert_le16(uint8_t v[2]) {
+uint32_t convert_le16(const uint8_t v[2]) {
   return (uint32_t) (v[1] << 8) | v[0];
 }
 
 void BL0942PowerMeter::MeasureTimerCB() {
-  packet rx_buf;
-  static uint32_t cf_cnt = 0;
-
-  if (this->ReadReg(0xAA, (uint8_t *) &rx_buf, sizeof(rx_buf))) {
-    if (rx_buf.frame_header == 0x55) {
-      uint32_t cf = convert_le24(rx_buf.cf_cnt);
-      cf = (cf_cnt & 0xFF000000) | cf;
-      if (cf_cnt > cf) {
-        cf += 0x1000000;
-      }
-      cf_cnt = cf;
-
-      float vref = cfg_.voltage_scale;
-      float iref = cfg_.current_scale;
-      float wref = cfg_.apower_scale;
-      float eref = cfg_.aenergy_scale;
-
-      float vo = convert_le24(rx_buf.v_rms) / vref;
-      float vi = convert_le24(rx_buf.i_rms) / iref;
-      int32_t wa_tmp = convert_le24(rx_buf.watt);
-      if (wa_tmp & 0x800000) {
-        wa_tmp |= 0xFF000000;
-      }
-      float wa = wa_tmp / wref;
-      float fr = 1000000.0 / (float) convert_le16(rx_buf.frequency);
-
-      apa_ = wa;
-      aea_ = cf / eref;
-
-      LOG(LL_DEBUG, ("vo: %.1f wa: %.2f i: %.2f fr: %.2f ae: %.2f", vo, wa, vi,
-                     fr, aea_));
-    }
+  if (resp_pending_) {
+    // Previous response never completed, drop whatever is left of it.
+    num_lost_++;
+    asm_.Reset();
+    const auto &st = asm_.stats();
+    LOG(LL_DEBUG, ("BL0942 no response; frames %u csum %u drop %u lost %u",
+                   (unsigned) st.num_frames, (unsigned) st.num_bad_csum,
+                   (unsigned) st.num_dropped_bytes, (unsigned) num_lost_));
   }
+  // Response will be picked up by the UART dispatcher.
+  SendReadRequest(BL_PACKET);
+  resp_pending_ = true;
+}
+
+void BL0942PowerMeter::HandleFrame(const uint8_t *frame) {
+  const packet &rx_buf = *reinterpret_cast<const packet *>(frame);
+
+  // CF counter is 24 bit and wraps around, only the increment is accounted.
+  uint32_t cf = convert_le24(rx_buf.cf_cnt);
+  if (have_cf_) {
+    uint32_t cf_inc = (cf - cf_cnt_) & 0xFFFFFF;
+    AddEnergyWH(cf_inc / cfg_.aenergy_scale);
+  }
+  cf_cnt_ = cf;
+  have_cf_ = true;
+
+  Measurement m;
+  m.voltage_v = convert_le24(rx_buf.v_rms) / cfg_.voltage_scale;
+  m.current_a = convert_le24(rx_buf.i_rms) / cfg_.current_scale;
+  int32_t wa_tmp = convert_le24(rx_buf.watt);
+  if (wa_tmp & 0x800000) {
+    wa_tmp |= 0xFF000000;
+  }
+  m.power_w = wa_tmp / cfg_.apower_scale;
+  uint32_t fr_period = convert_le16(rx_buf.frequency);
+  if (fr_period > 0) {
+    m.frequency_hz = 1000000.0 / (float) fr_period;
+  }
+  m.energy_wh = GetTotalEnergyWH();
+  ComputePowerFactor(&m);
+  SetMeasurement(m);
+
+  LOG(LL_DEBUG, ("vo: %.1f wa: %.2f i: %.2f fr: %.2f ae: %.2f", m.voltage_v,
+                 m.power_w, m.current_a, m.frequency_hz, m.energy_wh));
 }
 
 }  // namespace shelly
@@ -15,6 +15,8 @@
  * limitations under the License.
  */
 
+#pragma once
+
 #include "shelly_pm.hpp"
 
 #include "mgos_timers.hpp"
@@ -28,6 +30,39 @@ struct bl0942_cfg {
   float aenergy_scale;
 };
 
+// Reassembles full packet (0xAA) responses from the BL0942 byte stream.
+// Bytes are accepted only after the 0x55 frame header; on checksum mismatch
+// the buffer is rescanned for the next header, so a valid frame following
+// garbage or a truncated frame is still picked up.
+class BL0942FrameAssembler {
+ public:
+  static constexpr uint8_t kFrameHeader = 0x55;
+  static constexpr size_t kFrameLen = 23;
+
+  struct Stats {
+    uint32_t num_frames = 0;
+    uint32_t num_bad_csum = 0;
+    uint32_t num_dropped_bytes = 0;
+  };
+
+  // Returns true when a complete frame with valid checksum is in frame().
+  // The frame stays valid until the next call to Feed() or Reset().
+  bool Feed(uint8_t b);
+  void Reset();
+
+  const uint8_t *frame() const;
+  const Stats &stats() const;
+
+  static uint8_t Checksum(const uint8_t *frame);
+
+ private:
+  void Resync();
+
+  uint8_t buf_[kFrameLen];
+  size_t len_ = 0;
+  Stats stats_;
+};
+
 class BL0942PowerMeter : public PowerMeter {
  public:
   BL0942PowerMeter(int id, int tx_pin, int rx_pin, int meas_time, int uart_no,
@@ -35,21 +70,35 @@ class BL0942PowerMeter : public PowerMeter {
   virtual ~BL0942PowerMeter();
 
   Status Init() override;
-  StatusOr<float> GetPowerW() override;
-  StatusOr<float> GetEnergyWH() override;
 
- private:
-  void MeasureTimerCB();
+ protected:
+  // UART transport, overridden by the mock in the ubuntu build.
+  virtual Status InitUART();
+  virtual void WriteUART(const uint8_t *data, size_t len);
+
+  // Feeds received bytes to the frame assembler.
+  void HandleRxData(const uint8_t *data, size_t len);
 
   const int tx_pin_, rx_pin_, meas_time_, uart_no_;
   const bl0942_cfg cfg_;
 
-  float apa_ = 0;  // Last active power reading, W.
-  float aea_ = 0;  // Accumulated active energy, Wh.
-                   //
-  bool ReadReg(uint8_t reg, uint8_t *rx_buf, size_t len);
-  bool WriteReg(uint8_t reg, uint32_t val);
+  BL0942FrameAssembler asm_;
+  bool resp_pending_ = false;
+  uint32_t num_lost_ = 0;  // Requests that got no valid response.
+
+ private:
+  static void UARTDispatcher(int uart_no, void *arg);
+  void ConfigTimerCB();
+  void MeasureTimerCB();
+  void HandleFrame(const uint8_t *frame);
+
+  void SendReadRequest(uint8_t reg);
+  void WriteReg(uint8_t reg, uint32_t val);
+
+  uint32_t cf_cnt_ = 0;  // Last CF pulse counter value (24 bit).
+  bool have_cf_ = false;
 
+  mgos::Timer config_timer_;
   mgos::Timer meas_timer_;
 };
 
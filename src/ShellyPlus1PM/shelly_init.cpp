@@ -52,7 +52,9 @@ void CreatePeripherals(std::vector<std::unique_ptr<Input>> *inputs,
 #ifndef UART_TX_GPIO
   std::unique_ptr<PowerMeter> pm(
       new BL0937PowerMeter(1, 5 /* CF */, 18 /* CF1 */, 23 /* SEL */, 2,
-                           mgos_sys_config_get_bl0937_0_apower_scale()));
+                           mgos_sys_config_get_bl0937_0_apower_scale(),
+                           mgos_sys_config_get_bl0937_0_voltage_scale(),
+                           mgos_sys_config_get_bl0937_0_current_scale()));
 #else
 
   struct bl0942_cfg cfg = {
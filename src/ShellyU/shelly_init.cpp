@@ -26,11 +26,15 @@
 #include "shelly_input_pin.hpp"
 #include "shelly_main.hpp"
 #include "shelly_mock.hpp"
+#include "shelly_mock_pm_bl0937.hpp"
+#include "shelly_mock_pm_bl0942.hpp"
 #include "shelly_output.hpp"
 
 namespace shelly {
 
 static std::vector<std::unique_ptr<TempSensor>> sensors;
+static std::vector<MockBL0942PowerMeter *> s_mock_bl0942_pms;
+static std::vector<MockBL0937PowerMeter *> s_mock_bl0937_pms;
 
 void CreatePeripherals(std::vector<std::unique_ptr<Input>> *inputs,
                        std::vector<std::unique_ptr<Output>> *outputs,
@@ -46,11 +50,34 @@ void CreatePeripherals(std::vector<std::unique_ptr<Input>> *inputs,
 
   outputs->emplace_back(new OutputPin(1, 34, 1));
 
+  // BL0942 driver against a scripted UART, see Shelly.Mock.BL0942.
+  std::unique_ptr<MockBL0942PowerMeter> pm(new MockBL0942PowerMeter(1));
+  const Status &st = pm->Init();
+  if (st.ok()) {
+    s_mock_bl0942_pms.push_back(pm.get());
+    pms->emplace_back(std::move(pm));
+  } else {
+    const std::string &s = st.ToString();
+    LOG(LL_ERROR, ("PM init failed: %s", s.c_str()));
+  }
+
+  // BL0937 driver fed with synthetic CF pulses, see Shelly.Mock.BL0937.
+  std::unique_ptr<MockBL0937PowerMeter> pm2(new MockBL0937PowerMeter(2));
+  const Status &st2 = pm2->Init();
+  if (st2.ok()) {
+    s_mock_bl0937_pms.push_back(pm2.get());
+    pms->emplace_back(std::move(pm2));
+  } else {
+    const std::string &s = st2.ToString();
+    LOG(LL_ERROR, ("PM init failed: %s", s.c_str()));
+  }
+
   g_mock_sys_temp_sensor = new MockTempSensor(33);
   sys_temp->reset(g_mock_sys_temp_sensor);
 
   MockRPCInit();
-  (void) pms;
+  MockBL0942RPCInit(&s_mock_bl0942_pms);
+  MockBL0937RPCInit(&s_mock_bl0937_pms);
 }
 
 void CreateComponents(std::vector<std::unique_ptr<Component>> *comps,
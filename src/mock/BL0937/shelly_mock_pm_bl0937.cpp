@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shelly_mock_pm_bl0937.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "mgos.hpp"
+#include "mgos_rpc.h"
+
+namespace shelly {
+
+// Same as the Plus 1PM stock calibration: W, V and A per Hz.
+static const float kMockAPC = 2.028531;
+static const float kMockVPC = 0.15510;
+static const float kMockIPC = 0.01287;
+static const int kPulseTimerMs = 10;
+
+// Pins are never set up, see InitPins().
+MockBL0937PowerMeter::MockBL0937PowerMeter(int id)
+    : BL0937PowerMeter(id, 0 /* CF */, 0 /* CF1 */, 0 /* SEL */, 2, kMockAPC,
+                       kMockVPC, kMockIPC),
+      pulse_timer_(std::bind(&MockBL0937PowerMeter::PulseTimerCB, this)) {
+}
+
+MockBL0937PowerMeter::~MockBL0937PowerMeter() {
+}
+
+MockBL0937PowerMeter::Script *MockBL0937PowerMeter::script() {
+  return &script_;
+}
+
+Status MockBL0937PowerMeter::InitPins() {
+  pulse_timer_.Reset(kPulseTimerMs, MGOS_TIMER_REPEAT);
+  return Status::OK();
+}
+
+void MockBL0937PowerMeter::SetSEL(bool voltage) {
+  sel_voltage_ = voltage;
+  next_cf1_ = 0;
+}
+
+// Returns timestamp of the next pulse due by now, or 0 if none is.
+int64_t MockBL0937PowerMeter::NextPulse(int64_t *next, float freq) {
+  if (freq <= 0) {
+    *next = 0;
+    return 0;
+  }
+  int64_t now = mgos_uptime_micros();
+  int64_t period = std::max((int64_t) (1e6f / freq), (int64_t) 1);
+  if (*next == 0) *next = now + period;
+  if (*next > now) return 0;
+  int64_t ts = *next;
+  *next += period;
+  if (script_.jitter_us > 0) {
+    ts += mgos_rand_range(-script_.jitter_us, script_.jitter_us);
+  }
+  return ts;
+}
+
+void MockBL0937PowerMeter::PulseTimerCB() {
+  int64_t ts;
+  bool early = false;
+  while ((ts = NextPulse(&next_cf_, script_.w / apc_)) != 0) {
+    if (AddCFPulse((uint32_t) ts)) early = true;
+    num_pulses_++;
+  }
+  float cf1_freq = (sel_voltage_ ? script_.v / vpc_ : script_.i / ipc_);
+  while ((ts = NextPulse(&next_cf1_, cf1_freq)) != 0) {
+    AddCF1Pulse(&cf1_, (uint32_t) ts);
+    num_cf1_pulses_++;
+  }
+  // What the ISR would do via mgos_invoke_cb().
+  if (early) Measure();
+}
+
+std::string MockBL0937PowerMeter::GetStatusJSON() {
+  float apower = NAN, aenergy = NAN, voltage = NAN, current = NAN, pf = NAN;
+  auto mr = GetMeasurement();
+  if (mr.ok()) {
+    const Measurement &m = mr.ValueOrDie();
+    apower = m.power_w;
+    aenergy = m.energy_wh;
+    voltage = m.voltage_v;
+    current = m.current_a;
+    pf = m.power_factor;
+  }
+  return mgos::JSONPrintStringf(
+      "{id: %d, w: %.3f, v: %.3f, i: %.3f, jitter: %d, pulses: %u, "
+      "cf1_pulses: %u, apower: %.3f, aenergy: %.3f, voltage: %.3f, "
+      "current: %.3f, pf: %.3f}",
+      id(), script_.w, script_.v, script_.i, script_.jitter_us,
+      (unsigned) num_pulses_, (unsigned) num_cf1_pulses_, apower, aenergy,
+      voltage, current, pf);
+}
+
+static std::vector<MockBL0937PowerMeter *> *s_pms = nullptr;
+
+static void MockBL0937Handler(struct mg_rpc_request_info *ri, void *cb_arg,
+                              struct mg_rpc_frame_info *fi,
+                              struct mg_str args) {
+  int id = -1, jitter = -1;
+  float w = NAN, v = NAN, i = NAN;
+  json_scanf(args.p, args.len, ri->args_fmt, &id, &w, &v, &i, &jitter);
+  if (id < 0) {
+    mg_rpc_send_errorf(ri, 400, "%s is required", "id");
+    return;
+  }
+  for (auto *pm : *s_pms) {
+    if (pm->id() != id) continue;
+    auto *s = pm->script();
+    if (!std::isnan(w)) s->w = std::max(w, 0.0f);
+    if (!std::isnan(v)) s->v = std::max(v, 0.0f);
+    if (!std::isnan(i)) s->i = std::max(i, 0.0f);
+    if (jitter >= 0) s->jitter_us = jitter;
+    mg_rpc_send_responsef(ri, "%s", pm->GetStatusJSON().c_str());
+    return;
+  }
+  mg_rpc_send_errorf(ri, 404, "pm %d not found", id);
+  (void) fi;
+  (void) cb_arg;
+}
+
+void MockBL0937RPCInit(std::vector<MockBL0937PowerMeter *> *pms) {
+  s_pms = pms;
+  mg_rpc_add_handler(mgos_rpc_get_global(), "Shelly.Mock.BL0937",
+                     "{id: %d, w: %f, v: %f, i: %f, jitter: %d}",
+                     MockBL0937Handler, nullptr);
+}
+
+}  // namespace shelly
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "shelly_pm_bl0937.hpp"
+
+#include "mgos_timers.hpp"
+
+namespace shelly {
+
+// BL0937 driver fed with synthetic CF and CF1 pulse trains instead of GPIO
+// interrupts. Pulse timestamps are derived from the simulated power and,
+// depending on SEL, current or voltage, optionally with random jitter.
+class MockBL0937PowerMeter : public BL0937PowerMeter {
+ public:
+  explicit MockBL0937PowerMeter(int id);
+  virtual ~MockBL0937PowerMeter();
+
+  struct Script {
+    float w = 0;        // Active power, W.
+    float v = 230;      // Voltage, V.
+    float i = 0;        // Current, A.
+    int jitter_us = 0;  // Random pulse timing jitter, us.
+  };
+
+  Script *script();
+
+  std::string GetStatusJSON();
+
+ protected:
+  Status InitPins() override;
+  void SetSEL(bool voltage) override;
+
+ private:
+  void PulseTimerCB();
+
+  int64_t NextPulse(int64_t *next, float freq);
+
+  Script script_;
+  int64_t next_cf_ = 0, next_cf1_ = 0;
+  uint32_t num_pulses_ = 0, num_cf1_pulses_ = 0;
+  mgos::Timer pulse_timer_;
+};
+
+void MockBL0937RPCInit(std::vector<MockBL0937PowerMeter *> *pms);
+
+}  // namespace shelly
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shelly_mock_pm_bl0942.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "mgos.hpp"
+#include "mgos_rpc.h"
+
+namespace shelly {
+
+// Same as the Plus 1PM defaults.
+static const bl0942_cfg kMockCfg = {
+    .voltage_scale = (73989 / (1.218 * 4)),
+    .current_scale = (305978 / (1.218)),
+    .apower_scale = (3537 / (1.218 * 1.218 * 4)),
+    .aenergy_scale = ((3537 / (1.218 * 1.218 * 4)) * 3600 / (1638.4 * 256))};
+
+// 9600 baud, 10 bits per byte: ~1 ms per byte.
+static const int kRespDelayMs = 25;
+static const int64_t kByteMicros = 1042;
+// After the reset frame has been received.
+static const int64_t kResetMicros = 1000;
+
+// Registers the driver writes.
+static const uint8_t kRegWACreep = 0x14;
+static const uint8_t kRegMode = 0x19;
+static const uint8_t kRegSoftReset = 0x1C;
+
+static void PutLE24(uint8_t *p, uint32_t v) {
+  p[0] = (v & 0xFF);
+  p[1] = ((v >> 8) & 0xFF);
+  p[2] = ((v >> 16) & 0xFF);
+}
+
+MockBL0942PowerMeter::MockBL0942PowerMeter(int id)
+    : BL0942PowerMeter(id, -1, -1, 1, -1, kMockCfg),
+      resp_timer_(std::bind(&MockBL0942PowerMeter::RespTimerCB, this)) {
+}
+
+MockBL0942PowerMeter::~MockBL0942PowerMeter() {
+}
+
+MockBL0942PowerMeter::Script *MockBL0942PowerMeter::script() {
+  return &script_;
+}
+
+void MockBL0942PowerMeter::Feed(const std::vector<uint8_t> &data) {
+  HandleRxData(data.data(), data.size());
+}
+
+std::string MockBL0942PowerMeter::GetStatsJSON() const {
+  const auto &st = asm_.stats();
+  return mgos::JSONPrintStringf(
+      "{id: %d, reqs: %u, reg_writes: %u, lost_writes: %u, configured: %B, "
+      "frames: %u, bad_csum: %u, dropped_bytes: %u, lost: %u}",
+      id(), (unsigned) num_reqs_, (unsigned) num_reg_writes_,
+      (unsigned) num_lost_writes_, (mode_set_ && creep_set_),
+      (unsigned) st.num_frames, (unsigned) st.num_bad_csum,
+      (unsigned) st.num_dropped_bytes, (unsigned) num_lost_);
+}
+
+Status MockBL0942PowerMeter::InitUART() {
+  last_resp_ = mgos_uptime_micros();
+  return Status::OK();
+}
+
+void MockBL0942PowerMeter::WriteUART(const uint8_t *data, size_t len) {
+  // Queued frames go out back to back.
+  const int64_t start = std::max(mgos_uptime_micros(), tx_done_);
+  tx_done_ = start + len * kByteMicros;
+  if (len == 6) {
+    num_reg_writes_++;
+    HandleRegWrite(data[1], start);
+    return;
+  }
+  if (len != 2 || data[1] != 0xAA) {
+    LOG(LL_ERROR, ("PM %d: unexpected request (%d bytes)", id(), (int) len));
+    return;
+  }
+  num_reqs_++;
+  BuildResponse();
+  if (script_.drop_every > 0 && num_reqs_ % script_.drop_every == 0) {
+    LOG(LL_INFO, ("PM %d: dropping response %u", id(), (unsigned) num_reqs_));
+    return;
+  }
+  resp_off_ = 0;
+  resp_timer_.Reset(kRespDelayMs, 0);
+}
+
+void MockBL0942PowerMeter::HandleRegWrite(uint8_t reg, int64_t start) {
+  if (start < reset_done_) {
+    num_lost_writes_++;
+    LOG(LL_ERROR, ("PM %d: reg 0x%02x written during reset, lost", id(), reg));
+    return;
+  }
+  switch (reg) {
+    case kRegSoftReset:
+      reset_done_ = tx_done_ + kResetMicros;
+      mode_set_ = creep_set_ = false;
+      break;
+    case kRegMode:
+      mode_set_ = true;
+      break;
+    case kRegWACreep:
+      creep_set_ = true;
+      break;
+  }
+}
+
+void MockBL0942PowerMeter::BuildResponse() {
+  // Energy counter advances by the simulated power since last response.
+  int64_t now = mgos_uptime_micros();
+  float wh = script_.w * ((now - last_resp_) / 3600e6f);
+  last_resp_ = now;
+  cf_frac_ += wh * cfg_.aenergy_scale;
+  uint32_t cf_inc = (uint32_t) cf_frac_;
+  cf_frac_ -= cf_inc;
+  cf_cnt_ = (cf_cnt_ + cf_inc) & 0xFFFFFF;
+
+  uint8_t frame[BL0942FrameAssembler::kFrameLen] = {};
+  frame[0] = BL0942FrameAssembler::kFrameHeader;
+  PutLE24(&frame[1], (uint32_t) (script_.i * cfg_.current_scale));
+  PutLE24(&frame[4], (uint32_t) (script_.v * cfg_.voltage_scale));
+  PutLE24(&frame[10], ((uint32_t) (int32_t) (script_.w * cfg_.apower_scale)));
+  PutLE24(&frame[13], cf_cnt_);
+  frame[16] = (20000 & 0xFF);  // 50 Hz.
+  frame[17] = (20000 >> 8);
+  frame[22] = BL0942FrameAssembler::Checksum(frame);
+  if (script_.corrupt_every > 0 && num_reqs_ % script_.corrupt_every == 0) {
+    frame[22] ^= 0x5A;
+  }
+
+  resp_.clear();
+  for (int i = 0; i < script_.garbage; i++) {
+    resp_.push_back(mgos_rand_range(0, 256));
+  }
+  resp_.insert(resp_.end(), frame, frame + sizeof(frame));
+}
+
+void MockBL0942PowerMeter::RespTimerCB() {
+  size_t len = resp_.size() - resp_off_;
+  if (resp_off_ == 0 && script_.split_at > 0 &&
+      (size_t) script_.split_at < resp_.size()) {
+    len = script_.split_at;
+    resp_timer_.Reset(kRespDelayMs / 2, 0);
+  }
+  HandleRxData(resp_.data() + resp_off_, len);
+  resp_off_ += len;
+}
+
+static std::vector<MockBL0942PowerMeter *> *s_pms = nullptr;
+
+static void MockBL0942Handler(struct mg_rpc_request_info *ri, void *cb_arg,
+                              struct mg_rpc_frame_info *fi,
+                              struct mg_str args) {
+  int id = -1;
+  float v = NAN, i = NAN, w = NAN;
+  int drop_every = -1, corrupt_every = -1, split_at = -1, garbage = -1;
+  char *feed = nullptr;
+  json_scanf(args.p, args.len, ri->args_fmt, &id, &v, &i, &w, &drop_every,
+             &corrupt_every, &split_at, &garbage, &feed);
+  mgos::ScopedCPtr feed_owner(feed);
+  if (id < 0) {
+    mg_rpc_send_errorf(ri, 400, "%s is required", "id");
+    return;
+  }
+  for (auto *pm : *s_pms) {
+    if (pm->id() != id) continue;
+    auto *s = pm->script();
+    if (!std::isnan(v)) s->v = v;
+    if (!std::isnan(i)) s->i = i;
+    if (!std::isnan(w)) s->w = w;
+    if (drop_every >= 0) s->drop_every = drop_every;
+    if (corrupt_every >= 0) s->corrupt_every = corrupt_every;
+    if (split_at >= 0) s->split_at = split_at;
+    if (garbage >= 0) s->garbage = garbage;
+    if (feed != nullptr) {
+      // Hex string, e.g. "55aa01".
+      std::vector<uint8_t> data;
+      for (const char *p = feed; p[0] != '\0' && p[1] != '\0'; p += 2) {
+        char hex[3] = {p[0], p[1], '\0'};
+        data.push_back(strtol(hex, nullptr, 16));
+      }
+      pm->Feed(data);
+    }
+    mg_rpc_send_responsef(ri, "%s", pm->GetStatsJSON().c_str());
+    return;
+  }
+  mg_rpc_send_errorf(ri, 404, "pm %d not found", id);
+  (void) fi;
+  (void) cb_arg;
+}
+
+void MockBL0942RPCInit(std::vector<MockBL0942PowerMeter *> *pms) {
+  s_pms = pms;
+  mg_rpc_add_handler(mgos_rpc_get_global(), "Shelly.Mock.BL0942",
+                     "{id: %d, v: %f, i: %f, w: %f, drop_every: %d, "
+                     "corrupt_every: %d, split_at: %d, garbage: %d, feed: %Q}",
+                     MockBL0942Handler, nullptr);
+}
+
+}  // namespace shelly
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "shelly_pm_bl0942.hpp"
+
+#include "mgos_timers.hpp"
+
+namespace shelly {
+
+// BL0942 driver running against a scripted UART stand-in.
+// Read requests are answered with frames encoded from the simulated values,
+// with optional fault injection: lost responses, responses split across
+// dispatcher calls, leading garbage and corrupted checksums.
+// Frames take their time on the wire and register writes that arrive while
+// the chip is still resetting are lost, as on the real one.
+class MockBL0942PowerMeter : public BL0942PowerMeter {
+ public:
+  explicit MockBL0942PowerMeter(int id);
+  virtual ~MockBL0942PowerMeter();
+
+  struct Script {
+    float v = 230;          // Voltage, V.
+    float i = 0;            // Current, A.
+    float w = 0;            // Active power, W.
+    int drop_every = 0;     // Don't respond to every Nth request.
+    int corrupt_every = 0;  // Corrupt checksum of every Nth response.
+    int split_at = 0;       // Deliver response in two parts, split at offset.
+    int garbage = 0;        // Prepend this many random bytes to the response.
+  };
+
+  Script *script();
+
+  // Injects raw bytes into the RX path, as if received from the chip.
+  void Feed(const std::vector<uint8_t> &data);
+
+  std::string GetStatsJSON() const;
+
+ protected:
+  Status InitUART() override;
+  void WriteUART(const uint8_t *data, size_t len) override;
+
+ private:
+  void RespTimerCB();
+  void BuildResponse();
+  // start - when the frame starts arriving.
+  void HandleRegWrite(uint8_t reg, int64_t start);
+
+  Script script_;
+  uint32_t cf_cnt_ = 0;
+  float cf_frac_ = 0;
+  int64_t last_resp_ = 0;
+  uint32_t num_reqs_ = 0;
+  uint32_t num_reg_writes_ = 0;
+  uint32_t num_lost_writes_ = 0;  // Arrived during reset.
+  int64_t tx_done_ = 0;           // Last frame is on the wire until then.
+  int64_t reset_done_ = 0;
+  bool mode_set_ = false, creep_set_ = false;  // Since the last reset.
+  std::vector<uint8_t> resp_;
+  size_t resp_off_ = 0;
+  mgos::Timer resp_timer_;
+};
+
+void MockBL0942RPCInit(std::vector<MockBL0942PowerMeter *> *pms);
+
+}  // namespace shelly
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shelly_mock_pwm.hpp"
+
+#include <algorithm>
+
+#include "mgos.hpp"
+
+namespace shelly {
+
+bool MockPWMTimer::s_ints_disabled_ = false;
+
+MockPWMTimer::MockPWMTimer(int freq, int phase_micros, int stage_micros,
+                           int latch_micros)
+    : period_micros_(1000000 / freq),
+      phase_micros_(phase_micros),
+      stage_micros_(stage_micros),
+      latch_micros_(latch_micros),
+      next_boundary_(phase_micros) {
+}
+
+int64_t MockPWMTimer::period_micros() const {
+  return period_micros_;
+}
+
+int MockPWMTimer::num_frames() const {
+  return num_frames_;
+}
+
+int MockPWMTimer::num_torn() const {
+  return num_torn_;
+}
+
+void MockPWMTimer::set_period_cb(PeriodCB cb) {
+  period_cb_ = cb;
+}
+
+// static
+void MockPWMTimer::SetIntsDisabled(bool disabled) {
+  s_ints_disabled_ = disabled;
+}
+
+int64_t MockPWMTimer::Now() const {
+  return std::max(mgos_uptime_micros(), busy_until_);
+}
+
+bool MockPWMTimer::Held() const {
+#if CS_PLATFORM == CS_P_ESP8266
+  return s_ints_disabled_;
+#else
+  return paused_;
+#endif
+}
+
+void MockPWMTimer::Busy(int64_t now, int64_t micros) {
+  busy_until_ = std::max(busy_until_, now + micros);
+}
+
+void MockPWMTimer::Advance(int64_t now) {
+  if (now < next_boundary_ || Held()) return;
+  // Nothing changes between the boundaries passed since, only the first one
+  // matters.
+  int num_latched = 0, num_staged = 0;
+  for (MockPWMOutput *out : outs_) {
+    if (out->latched_) num_latched++;
+    if (out->staged_duty_ >= 0) num_staged++;
+  }
+  if (num_latched > 0) {
+    num_frames_++;
+    if (num_staged > 0) {
+      num_torn_++;
+      LOG(LL_ERROR, ("Torn PWM frame: %d latched, %d staged", num_latched,
+                     num_staged));
+    }
+  }
+  for (MockPWMOutput *out : outs_) {
+    out->active_ = out->shadow_;
+    out->latched_ = false;
+  }
+  next_boundary_ =
+      ((now - phase_micros_) / period_micros_ + 1) * period_micros_ +
+      phase_micros_;
+  if (period_cb_) period_cb_();
+}
+
+MockPWMOutput::MockPWMOutput(int id, MockPWMTimer *timer)
+    : Output(id), timer_(timer) {
+  timer_->outs_.push_back(this);
+}
+
+MockPWMOutput::~MockPWMOutput() {
+  auto &outs = timer_->outs_;
+  outs.erase(std::remove(outs.begin(), outs.end(), this), outs.end());
+}
+
+bool MockPWMOutput::GetState() {
+  return duty() > 0;
+}
+
+Status MockPWMOutput::SetState(bool on, const char *source) {
+  return SetStatePWM((on ? 1 : 0), source);
+}
+
+Status MockPWMOutput::SetStatePWM(float duty, const char *source) {
+  Status st = StagePWM(duty, source);
+  if (st.ok()) LatchPWM();
+  return st;
+}
+
+Status MockPWMOutput::Pulse(bool on, int duration_ms, const char *source) {
+  (void) on;
+  (void) duration_ms;
+  (void) source;
+  return Status::UNIMPLEMENTED();
+}
+
+void MockPWMOutput::SetInvert(bool out_invert) {
+  (void) out_invert;
+}
+
+Status MockPWMOutput::StagePWM(float duty, const char *source) {
+  const int64_t now = timer_->Now();
+  timer_->Advance(now);
+  staged_duty_ = duty;
+  staged_source_ = source;
+  timer_->Busy(now, timer_->stage_micros_);
+  return Status::OK();
+}
+
+void MockPWMOutput::LatchPWM() {
+  const int64_t now = timer_->Now();
+  timer_->Advance(now);
+  if (staged_duty_ < 0) return;
+  shadow_ = staged_duty_;
+  staged_duty_ = -1;
+  latched_ = true;
+  timer_->Busy(now, timer_->latch_micros_);
+}
+
+void MockPWMOutput::HoldPWM(bool hold) {
+  timer_->paused_ = hold;
+}
+
+float MockPWMOutput::duty() {
+  timer_->Advance(timer_->Now());
+  return active_;
+}
+
+}  // namespace shelly
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "shelly_output.hpp"
+
+namespace shelly {
+
+class MockPWMOutput;
+
+// PWM timer shared by MockPWMOutput channels, like the LEDC timers of ESP32:
+// latched duty goes to a shadow register and is output from the next period
+// boundary on, so a group latched within one period changes together.
+//
+// Periods start phase_micros after whole periods of uptime, timers of the
+// host shim fire on whole milliseconds. Each stage and latch takes
+// stage_micros and latch_micros of virtual time, as the register writes
+// of OutputPin do on the device, so a boundary can fall between the latches
+// of one update.
+// Boundaries are held off as OutputPin can on the platform the mock is
+// built for: on ESP8266 while interrupts are disabled, as the PWM interrupt
+// is (the host has no interrupts, whoever stands in for mgos_ints_disable()
+// reports them with SetIntsDisabled()), elsewhere while the outputs are
+// held, as the LEDC timer of ESP32 is paused. They are processed lazily,
+// on the first call past them. One reached while part of a group has been
+// latched and the rest is still staged outputs a mix of old and new values,
+// such periods are counted as torn.
+class MockPWMTimer {
+ public:
+  typedef std::function<void()> PeriodCB;
+
+  MockPWMTimer(int freq, int phase_micros, int stage_micros,
+               int latch_micros);
+  MockPWMTimer(const MockPWMTimer &other) = delete;
+
+  int64_t period_micros() const;
+  int num_frames() const;  // Periods that changed the output.
+  int num_torn() const;
+
+  // Called when a period starts, with the new duty active.
+  void set_period_cb(PeriodCB cb);
+
+  // Interrupts are global, so is this.
+  static void SetIntsDisabled(bool disabled);
+
+ private:
+  friend class MockPWMOutput;
+
+  // Virtual time, including the writes of the current tick.
+  int64_t Now() const;
+  bool Held() const;
+  void Advance(int64_t now);
+  // Takes micros of virtual time from now.
+  void Busy(int64_t now, int64_t micros);
+
+  static bool s_ints_disabled_;
+
+  const int64_t period_micros_;
+  const int64_t phase_micros_;
+  const int64_t stage_micros_;
+  const int64_t latch_micros_;
+  int64_t busy_until_ = 0;
+  bool paused_ = false;
+  int64_t next_boundary_;
+  PeriodCB period_cb_;
+  int num_frames_ = 0;
+  int num_torn_ = 0;
+  std::vector<MockPWMOutput *> outs_;
+};
+
+class MockPWMOutput : public Output {
+ public:
+  MockPWMOutput(int id, MockPWMTimer *timer);
+  virtual ~MockPWMOutput();
+
+  // Output interface impl.
+  bool GetState() override;
+  Status SetState(bool on, const char *source) override;
+  Status SetStatePWM(float duty, const char *source) override;
+  Status Pulse(bool on, int duration_ms, const char *source) override;
+  void SetInvert(bool out_invert) override;
+  Status StagePWM(float duty, const char *source) override;
+  void LatchPWM() override;
+  void HoldPWM(bool hold) override;
+
+  // Being output in the current period.
+  float duty();
+
+ private:
+  friend class MockPWMTimer;
+
+  MockPWMTimer *const timer_;
+  float shadow_ = 0;
+  float active_ = 0;
+  bool latched_ = false;  // Since the last boundary.
+};
+
+}  // namespace shelly
@@ -32,26 +32,35 @@ Status MockPowerMeter::Init() {
   return Status::OK();
 }
 
-StatusOr<float> MockPowerMeter::GetPowerW() {
-  return apa_;
-}
-
-StatusOr<float> MockPowerMeter::GetEnergyWH() {
-  return aea_;
-}
-
 void MockPowerMeter::SetPowerW(float w) {
   LOG(LL_INFO, ("PM %d W %.2f -> %.2f", id(), apa_, w));
   apa_ = w;
+  Publish();
 }
 
 void MockPowerMeter::SetEnergyWH(float wh) {
-  LOG(LL_INFO, ("PM %d WH %.2f -> %.2f", id(), aea_, wh));
-  aea_ = wh;
+  LOG(LL_INFO, ("PM %d WH %.2f -> %.2f", id(), GetTotalEnergyWH(), wh));
+  SetTotalEnergyWH(wh);
+  Publish();
+}
+
+void MockPowerMeter::SetCurrentA(float a) {
+  LOG(LL_INFO, ("PM %d A %.3f -> %.3f", id(), airms_, a));
+  airms_ = a;
+  Publish();
 }
 
 void MockPowerMeter::MeasureTimerCB() {
-  aea_ += (apa_ / 3600);
+  AddEnergyWH(apa_ / 3600);
+  Publish();
+}
+
+void MockPowerMeter::Publish() {
+  Measurement m;
+  m.power_w = apa_;
+  m.energy_wh = GetTotalEnergyWH();
+  m.current_a = airms_;
+  SetMeasurement(m);
 }
 
 }  // namespace shelly
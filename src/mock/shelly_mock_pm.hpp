@@ -30,17 +30,17 @@ class MockPowerMeter : public PowerMeter {
 
   // PowerMeter interface impl.
   Status Init() override;
-  StatusOr<float> GetPowerW() override;
-  StatusOr<float> GetEnergyWH() override;
 
   void SetPowerW(float w);
   void SetEnergyWH(float wh);
+  void SetCurrentA(float a);
 
  private:
   void MeasureTimerCB();
+  void Publish();
 
   float apa_ = 0;
-  float aea_ = 0;
+  float airms_ = NAN;
   mgos::Timer meas_timer_;
 };
 
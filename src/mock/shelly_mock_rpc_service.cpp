@@ -43,20 +43,21 @@ static void MockSetSysTempHandler(struct mg_rpc_request_info *ri, void *cb_arg,
 static void MockSetPM(struct mg_rpc_request_info *ri, void *cb_arg,
                       struct mg_rpc_frame_info *fi, struct mg_str args) {
   int id = -1;
-  float w = NAN, wh = NAN;
-  json_scanf(args.p, args.len, ri->args_fmt, &id, &w, &wh);
+  float w = NAN, wh = NAN, a = NAN;
+  json_scanf(args.p, args.len, ri->args_fmt, &id, &w, &wh, &a);
   if (id < 0) {
     mg_rpc_send_errorf(ri, 400, "%s is required", "id");
     return;
   }
-  if (std::isnan(w) && std::isnan(wh)) {
-    mg_rpc_send_errorf(ri, 400, "%s is required", "w or wh");
+  if (std::isnan(w) && std::isnan(wh) && std::isnan(a)) {
+    mg_rpc_send_errorf(ri, 400, "%s is required", "w, wh or a");
     return;
   }
   for (auto *pm : g_mock_pms) {
     if (pm->id() == id) {
       if (!std::isnan(w)) pm->SetPowerW(w);
       if (!std::isnan(wh)) pm->SetEnergyWH(wh);
+      if (!std::isnan(a)) pm->SetCurrentA(a);
       mg_rpc_send_responsef(ri, nullptr);
       return;
     }
@@ -70,7 +71,7 @@ void MockRPCInit() {
   mg_rpc_add_handler(mgos_rpc_get_global(), "Shelly.Mock.SetSysTemp",
                      "{temp: %f}", MockSetSysTempHandler, nullptr);
   mg_rpc_add_handler(mgos_rpc_get_global(), "Shelly.Mock.SetPM",
-                     "{id: %d, w: %f, wh: %f}", MockSetPM, nullptr);
+                     "{id: %d, w: %f, wh: %f, a: %f}", MockSetPM, nullptr);
 }
 
 }  // namespace shelly
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shelly_adaptive_lighting_curve.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+
+namespace shelly {
+namespace hap {
+
+// Values beyond this are not meaningful and would overflow Q16.
+static constexpr float kMaxValue = 16384;
+
+static bool ToQ16(float v, int32_t *res) {
+  if (!std::isfinite(v)) return false;
+  v = std::min(std::max(v, -kMaxValue), kMaxValue);
+  *res = std::lround(v * 65536);
+  return true;
+}
+
+static int64_t DivRound(int64_t a, int64_t b) {
+  return (a >= 0 ? a + b / 2 : a - b / 2) / b;
+}
+
+bool TransitionCurveArena::push_back(const transitionEntryType &e) {
+  if (size_ >= kMaxEntries) return false;
+  if (entries_ == nullptr) {
+    entries_.reset(new transitionEntryType[kMaxEntries]);
+  }
+  entries_[size_++] = e;
+  return true;
+}
+
+void TransitionCurveArena::clear() {
+  size_ = 0;
+}
+
+void TransitionCurveArena::release() {
+  entries_.reset();
+  size_ = 0;
+}
+
+bool TransitionCurveArena::empty() const {
+  return (size_ == 0);
+}
+
+size_t TransitionCurveArena::size() const {
+  return size_;
+}
+
+const transitionEntryType *TransitionCurveArena::begin() const {
+  return entries_.get();
+}
+
+const transitionEntryType *TransitionCurveArena::end() const {
+  return entries_.get() + size_;
+}
+
+bool AdaptiveLightingCurve::Compile(const transitionEntryType *entries,
+                                    size_t num_entries) {
+  segs_.clear();
+  if (num_entries == 0 || num_entries > TransitionCurveArena::kMaxEntries) {
+    return false;
+  }
+  if (segs_.capacity() < num_entries) {
+    // Free the old segments first, the peak is a single curve.
+    Clear();
+    segs_.reserve(num_entries);
+  }
+  segs_.resize(num_entries);
+  uint32_t end = 0;
+  int32_t prev_value = 0, prev_adj = 0;
+  for (size_t i = 0; i < num_entries; i++) {
+    const transitionEntryType &e = entries[i];
+    const transitionEntryType &prev = entries[i > 0 ? i - 1 : 0];
+    Segment &s = segs_[i];
+    int32_t value, adj;
+    if (!ToQ16(e.value, &value) || !ToQ16(e.adjustmentFactor, &adj)) {
+      segs_.clear();
+      return false;
+    }
+    if (i == 0) {
+      prev_value = value;
+      prev_adj = adj;
+    }
+    const uint32_t begin = end;
+    uint64_t len = (uint64_t) e.offset + (e.durationPresent ? e.duration : 0);
+    end = std::min<uint64_t>(begin + len, UINT32_MAX);
+    len = std::max<uint64_t>(end - begin, 1);
+    const uint64_t hold = (prev.durationPresent ? prev.duration : 0);
+    s.end = end;
+    s.value = prev_value;
+    s.adj = prev_adj;
+    s.value_slope = s.adj_slope = 0;
+    s.shift = 0;
+    if (hold >= len) {
+      // Held for the whole segment.
+      s.ramp_begin = end;
+    } else {
+      s.ramp_begin = begin + hold;
+      const int64_t ramp_len = len - hold;
+      const int64_t dv = (int64_t) value - prev_value;
+      const int64_t da = (int64_t) adj - prev_adj;
+      // As many fractional bits as the steeper slope leaves room for.
+      const int64_t dmax = std::max(std::abs(dv), std::abs(da));
+      int shift = 31;
+      while (shift > 0 && DivRound(dmax << shift, ramp_len) > INT32_MAX) {
+        shift--;
+      }
+      s.value_slope = DivRound(dv * (1LL << shift), ramp_len);
+      s.adj_slope = DivRound(da * (1LL << shift), ramp_len);
+      s.shift = shift;
+    }
+    prev_value = value;
+    prev_adj = adj;
+  }
+  last_value_ = prev_value;
+  last_adj_ = prev_adj;
+  return true;
+}
+
+void AdaptiveLightingCurve::Clear() {
+  std::vector<Segment>().swap(segs_);
+}
+
+bool AdaptiveLightingCurve::empty() const {
+  return segs_.empty();
+}
+
+size_t AdaptiveLightingCurve::size() const {
+  return segs_.size();
+}
+
+uint32_t AdaptiveLightingCurve::duration() const {
+  return (segs_.empty() ? 0 : segs_.back().end);
+}
+
+bool AdaptiveLightingCurve::Eval(uint32_t offset_ms, int32_t multiplier,
+                                 int *result) const {
+  if (segs_.empty()) return false;
+  // First segment ending at or after the offset. Branchless binary search,
+  // lookups are at random points of the curve.
+  const Segment *it = segs_.data();
+  for (size_t n = segs_.size(); n > 1; n -= n / 2) {
+    it = (it[n / 2].end < offset_ms ? it + n / 2 : it);
+  }
+  if (it->end < offset_ms) it++;
+  const bool in_curve = (it != segs_.data() + segs_.size());
+  int64_t value, adj;
+  if (!in_curve) {
+    // Past the end, the last entry applies.
+    value = last_value_;
+    adj = last_adj_;
+  } else if (offset_ms <= it->ramp_begin) {
+    value = it->value;
+    adj = it->adj;
+  } else {
+    const int64_t dt = offset_ms - it->ramp_begin;
+    value = it->value + ((it->value_slope * dt) >> it->shift);
+    adj = it->adj + ((it->adj_slope * dt) >> it->shift);
+  }
+  const int64_t res = (value + adj * multiplier) / 65536;
+  *result = std::min<int64_t>(std::max<int64_t>(res, INT_MIN), INT_MAX);
+  return in_curve;
+}
+
+}  // namespace hap
+}  // namespace shelly
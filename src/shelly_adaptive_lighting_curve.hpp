@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// NB: This file is also built on the host by tools/al_bench,
+// it must not depend on Mongoose OS or HAP.
+
+namespace shelly {
+namespace hap {
+
+// Entry of an adaptive lighting transition curve, as sent by the controller.
+typedef struct {
+  float adjustmentFactor;
+  float value;
+  uint32_t offset;
+  uint32_t duration;
+  bool durationPresent;
+} transitionEntryType;
+
+// Fixed-capacity storage of curve entries, for decoding curves written by
+// the controller. Allocated on first use and then reused, so that curves
+// written over and over do not fragment the heap, until released.
+class TransitionCurveArena {
+ public:
+  // Room for a 24 h curve with entries 8 minutes apart.
+  static constexpr size_t kMaxEntries = 192;
+
+  // Returns false if full.
+  bool push_back(const transitionEntryType &e);
+  void clear();
+  // Same, and frees the storage.
+  void release();
+
+  bool empty() const;
+  size_t size() const;
+  const transitionEntryType *begin() const;
+  const transitionEntryType *end() const;
+
+ private:
+  std::unique_ptr<transitionEntryType[]> entries_;
+  size_t size_ = 0;
+};
+
+// Adaptive lighting curve compiled for lookup.
+//
+// Entry i is reached offset + duration ms after entry i - 1. In between, the
+// value of entry i - 1 is held for its duration, then ramps linearly to that
+// of entry i. Segments store the cumulative offset of their entry for binary
+// search and fixed point (Q16) values with precomputed slopes, so a lookup is
+// O(log n) and needs neither floats nor divisions.
+class AdaptiveLightingCurve {
+ public:
+  // Returns false if the curve is empty, has more than
+  // TransitionCurveArena::kMaxEntries entries or non-finite values.
+  // Segment storage is reused unless the curve is longer than any compiled
+  // since the last Clear().
+  bool Compile(const transitionEntryType *entries, size_t num_entries);
+  // Also frees the segments.
+  void Clear();
+
+  bool empty() const;
+  size_t size() const;
+  uint32_t duration() const;  // To the last entry, ms.
+
+  // Color temperature in mired, value + adjustment factor * multiplier,
+  // at the given offset into the curve. Returns false once past the end,
+  // in which case the result is that of the last entry.
+  bool Eval(uint32_t offset_ms, int32_t multiplier, int *result) const;
+
+ private:
+  struct Segment {
+    uint32_t end;         // Cumulative offset of the entry.
+    uint32_t ramp_begin;  // Hold of the previous entry ends.
+    int32_t value;        // Q16, at the beginning of the ramp.
+    int32_t adj;          // Q16, likewise.
+    int32_t value_slope;  // Q16 per ms << shift.
+    int32_t adj_slope;
+    uint8_t shift;
+  };
+
+  std::vector<Segment> segs_;
+  int32_t last_value_ = 0;
+  int32_t last_adj_ = 0;
+};
+
+}  // namespace hap
+}  // namespace shelly
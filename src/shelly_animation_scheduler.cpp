@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shelly_animation_scheduler.hpp"
+
+#include <algorithm>
+
+#include "mgos.hpp"
+
+namespace shelly {
+
+AnimationScheduler::Client::~Client() {
+}
+
+// static
+AnimationScheduler *AnimationScheduler::Get() {
+  static AnimationScheduler *s_instance = new AnimationScheduler();
+  return s_instance;
+}
+
+AnimationScheduler::AnimationScheduler()
+    : timer_(std::bind(&AnimationScheduler::TimerCB, this)) {
+}
+
+void AnimationScheduler::Add(Client *c) {
+  if (!IsActive(c)) clients_.push_back(c);
+  timer_.Reset(0, 0);
+}
+
+void AnimationScheduler::Remove(Client *c) {
+  clients_.erase(std::remove(clients_.begin(), clients_.end(), c),
+                 clients_.end());
+  if (clients_.empty()) timer_.Clear();
+}
+
+bool AnimationScheduler::IsActive(const Client *c) const {
+  return std::find(clients_.begin(), clients_.end(), c) != clients_.end();
+}
+
+int AnimationScheduler::num_active() const {
+  return clients_.size();
+}
+
+void AnimationScheduler::TimerCB() {
+  const int64_t now = mgos_uptime_micros();
+  int64_t next = -1;
+  for (auto it = clients_.begin(); it != clients_.end();) {
+    int64_t due = (*it)->AnimationTick(now);
+    if (due < 0) {
+      it = clients_.erase(it);
+      continue;
+    }
+    if (next < 0 || due < next) next = due;
+    it++;
+  }
+  // Nothing to animate, sleep until the next Add().
+  if (next < 0) return;
+  int next_ms = std::max((int) ((next - now + 999) / 1000), kMinTickMs);
+  timer_.Reset(next_ms, 0);
+}
+
+}  // namespace shelly
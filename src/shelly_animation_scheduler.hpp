@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "mgos_timers.hpp"
+
+#include "shelly_common.hpp"
+
+namespace shelly {
+
+// Drives all running animations, e.g. light transitions, off a single timer.
+// Every tick advances all active clients to the same point in time, so
+// simultaneous fades stay in phase. The timer is armed for the earliest tick
+// any client asks for and is stopped when there are no clients.
+class AnimationScheduler {
+ public:
+  // Ticks are never issued more often than this.
+  static constexpr int kMinTickMs = 10;
+
+  class Client {
+   public:
+    // Advances the animation to `now` (uptime, microseconds).
+    // Returns when the next tick is wanted, -1 if the animation has finished,
+    // in which case the client is removed.
+    virtual int64_t AnimationTick(int64_t now) = 0;
+
+   protected:
+    virtual ~Client();
+  };
+
+  static AnimationScheduler *Get();
+
+  // Adds the client if it's not active, first tick is issued right away.
+  // Must not be called from AnimationTick().
+  void Add(Client *c);
+  void Remove(Client *c);
+  bool IsActive(const Client *c) const;
+  int num_active() const;
+
+ private:
+  AnimationScheduler();
+
+  void TimerCB();
+
+  std::vector<Client *> clients_;
+  mgos::Timer timer_;
+
+  AnimationScheduler(const AnimationScheduler &other) = delete;
+};
+
+}  // namespace shelly
@@ -24,7 +24,7 @@ namespace shelly {
 
 CCTController::CCTController(struct mgos_config_lb *cfg, Output *out_cw,
                              Output *out_ww)
-    : LightBulbController<StateCCT>(cfg), out_ww_(out_ww), out_cw_(out_cw) {
+    : LightBulbController<StateCCT>(cfg, {out_ww, out_cw}) {
 }
 
 CCTController::~CCTController() {
@@ -36,11 +36,6 @@ void CCTController::ReportTransition(const StateCCT &next,
   LOG(LL_INFO, ("Output 2: %.2f => %.2f", prev.cw, next.cw));
 }
 
-void CCTController::UpdatePWM(const StateCCT &state) {
-  out_ww_->SetStatePWM(state.ww, "transition");
-  out_cw_->SetStatePWM(state.cw, "transition");
-}
-
 StateCCT CCTController::ConfigToState(const struct mgos_config_lb &cfg) const {
   StateCCT state{};
 
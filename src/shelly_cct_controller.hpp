@@ -29,18 +29,14 @@ struct StateCCT {
   float ww;
   float cw;
 
-  StateCCT operator+(const StateCCT &other) const {
-    return {
-        .ww = ww + other.ww,
-        .cw = cw + other.cw,
-    };
+  static constexpr int kNumChannels = 2;
+
+  float &operator[](int ch) {
+    return (ch == 0 ? ww : cw);
   }
 
-  StateCCT operator*(float a) const {
-    return {
-        .ww = a * ww,
-        .cw = a * cw,
-    };
+  float operator[](int ch) const {
+    return (ch == 0 ? ww : cw);
   }
 
   std::string ToString() const;
@@ -57,10 +53,7 @@ class CCTController : public LightBulbController<StateCCT> {
   }
 
  private:
-  Output *const out_ww_, *const out_cw_;
-
   StateCCT ConfigToState(const struct mgos_config_lb &cfg) const final;
   void ReportTransition(const StateCCT &next, const StateCCT &prev) final;
-  void UpdatePWM(const StateCCT &state) final;
 };
 }  // namespace shelly
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shelly_color.hpp"
+
+#include <algorithm>
+
+namespace shelly {
+
+// a / b, rounded to nearest. b > 0.
+static int DivRound(int a, int b) {
+  return (a >= 0 ? (a + b / 2) / b : -((-a + b / 2) / b));
+}
+
+ColorHSV HSVFromConfig(int hue, int saturation, int brightness) {
+  ColorHSV res;
+  res.h = DivRound(hue * kHueMax, 360) % kHueMax;
+  res.s = DivRound(saturation * kColorMax, 100);
+  res.v = DivRound(brightness * kColorMax, 100);
+  return res;
+}
+
+ColorRGBW HSVToRGBW(const ColorHSV &hsv, bool white) {
+  // Computed with 2 extra bits and rounded at the end, so that white
+  // extraction does not add up rounding errors.
+  static constexpr int M = kColorMax;
+  static_assert(kHueSextant == M, "hue fraction must have the same scale");
+  const int v = hsv.v * 4, s = hsv.s;
+  ColorRGBW res = {v, v, v, 0};
+  if (s > 0) {
+    const int h = ((hsv.h % kHueMax) + kHueMax) % kHueMax;
+    const int f = h % kHueSextant;
+    // Products stay within 32 bits: v * M * M <= 2^30.
+    const int p = DivRound(hsv.v * (M - s), M / 4);
+    const int q = DivRound(hsv.v * (M * M - f * s), M * M / 4);
+    const int t = DivRound(hsv.v * (M * M - (M - f) * s), M * M / 4);
+    switch (h / kHueSextant) {
+      case 0:  // 0° ≤ h < 60°
+        res = {v, t, p, 0};
+        break;
+      case 1:  // 60° ≤ h < 120°
+        res = {q, v, p, 0};
+        break;
+      case 2:  // 120° ≤ h < 180°
+        res = {p, v, t, 0};
+        break;
+      case 3:  // 180° ≤ h < 240°
+        res = {p, q, v, 0};
+        break;
+      case 4:  // 240° ≤ h < 300°
+        res = {t, p, v, 0};
+        break;
+      default:  // 300° ≤ h < 360°
+        res = {v, p, q, 0};
+        break;
+    }
+  }
+  if (white) {
+    res.w = std::min(res.r, std::min(res.g, res.b));
+    res.r -= res.w;
+    res.g -= res.w;
+    res.b -= res.w;
+  }
+  res.r = DivRound(res.r, 4);
+  res.g = DivRound(res.g, 4);
+  res.b = DivRound(res.b, 4);
+  res.w = DivRound(res.w, 4);
+  return res;
+}
+
+ColorHSV RGBWToHSV(const ColorRGBW &c) {
+  const int r = std::min(c.r + c.w, kColorMax);
+  const int g = std::min(c.g + c.w, kColorMax);
+  const int b = std::min(c.b + c.w, kColorMax);
+  const int max = std::max(r, std::max(g, b));
+  const int min = std::min(r, std::min(g, b));
+  const int d = max - min;
+  ColorHSV res = {0, 0, max};
+  if (d == 0) return res;
+  res.s = DivRound(d * kColorMax, max);
+  if (max == r) {
+    res.h = DivRound((g - b) * kHueSextant, d);
+  } else if (max == g) {
+    res.h = 2 * kHueSextant + DivRound((b - r) * kHueSextant, d);
+  } else {
+    res.h = 4 * kHueSextant + DivRound((r - g) * kHueSextant, d);
+  }
+  if (res.h < 0) res.h += kHueMax;
+  return res;
+}
+
+}  // namespace shelly
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+// NB: This file is also built on the host by tools/light_bench,
+// it must not depend on Mongoose OS.
+
+namespace shelly {
+
+// Fixed point colour, integer math only.
+// Channels, saturation and value are in [0; kColorMax].
+// Hue is in [0; kHueMax), kHueSextant per 60 degrees.
+static constexpr int kColorMax = 1024;
+static constexpr int kHueSextant = 1024;
+static constexpr int kHueMax = 6 * kHueSextant;
+
+// Colour space transitions are interpolated in.
+// NB: Keep in sync with lb.transition_space in mos.yml.
+enum class TransitionSpace {
+  kRGB = 0,
+  kHSV = 1,  // Shortest way around the hue circle.
+  kMax,
+};
+
+struct ColorHSV {
+  int h;
+  int s;
+  int v;
+};
+
+struct ColorRGBW {
+  int r;
+  int g;
+  int b;
+  int w;
+};
+
+// hue [0; 360], saturation and brightness [0; 100], as in mgos_config_lb.
+ColorHSV HSVFromConfig(int hue, int saturation, int brightness);
+
+// If white is true, the common part of R, G and B goes to W.
+ColorRGBW HSVToRGBW(const ColorHSV &hsv, bool white);
+
+// W is added back to R, G and B. Hue of greys and black is 0.
+ColorHSV RGBWToHSV(const ColorRGBW &rgbw);
+
+}  // namespace shelly
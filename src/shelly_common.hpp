@@ -73,6 +73,9 @@
 #define SHELLY_HAP_IID_BASE_CARBON_MONOXIDE_SENSOR 0x1100
 #define SHELLY_HAP_IID_BASE_CARBON_DIOXIDE_SENSOR 0x1200
 #define SHELLY_HAP_IID_BASE_HUMIDITY_SENSOR 0x1300
+#define SHELLY_HAP_IID_BASE_EVE_HISTORY 0x1400
+#define SHELLY_HAP_IID_STEP_EVE_HISTORY 0x10
+#define SHELLY_HAP_IID_BASE_PM_PROTECTION 0x1500
 
 #define kChangeReasonAuto "AUTO"
 #define kChangeReasonAutoWithNotification "AUTO_NOTIFICATION"
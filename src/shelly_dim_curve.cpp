@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shelly_dim_curve.hpp"
+
+#include <array>
+#include <cmath>
+
+namespace shelly {
+
+namespace {
+
+// Math for table generation at compile time, C++11 constexpr: no loops,
+// single return.
+
+// ln(2)
+constexpr double kLn2 = 0.69314718055994530942;
+
+// 2 * atanh(z) series, sum of 2 * z^(2k + 1) / (2k + 1).
+constexpr double Atanh2(double z, double zn, int k) {
+  return (k > 20 ? 0 : 2 * zn / (2 * k + 1) + Atanh2(z, zn * z * z, k + 1));
+}
+
+// ln(x), x > 0. Reduced to [0.5; 1] where the atanh series converges fast.
+constexpr double Ln(double x) {
+  return (x < 0.5 ? Ln(x * 2) - kLn2
+                  : (x > 1 ? Ln(x / 2) + kLn2
+                           : Atanh2((x - 1) / (x + 1), (x - 1) / (x + 1), 0)));
+}
+
+// Taylor series of e^y, for |y| <= 1.
+constexpr double ExpSeries(double y, double term, int k) {
+  return (k > 20 ? 0 : term + ExpSeries(y, term * y / (k + 1), k + 1));
+}
+
+// e^y, halved until |y| <= 1 and squared back.
+constexpr double Sq(double x) {
+  return x * x;
+}
+constexpr double Exp(double y) {
+  return (y < -1 || y > 1 ? Sq(Exp(y / 2)) : ExpSeries(y, 1, 0));
+}
+
+constexpr double Gamma22(double x) {
+  return (x <= 0 ? 0 : Exp(2.2 * Ln(x)));
+}
+
+// L* [0; 100] to relative luminance.
+constexpr double CIE1931(double x) {
+  return (x * 100 <= 8 ? x * 100 / 903.3
+                       : Sq((x * 100 + 16) / 116) * ((x * 100 + 16) / 116));
+}
+
+constexpr uint16_t ToOut(double y) {
+  return static_cast<uint16_t>(y * kDimCurveOut + 0.5);
+}
+
+// Index sequence, built by halving to keep template recursion shallow.
+template <int... Is>
+struct Seq {};
+
+template <class A, class B>
+struct Concat;
+
+template <int... A, int... B>
+struct Concat<Seq<A...>, Seq<B...>> {
+  typedef Seq<A..., (sizeof...(A) + B)...> type;
+};
+
+template <int N>
+struct MakeSeq {
+  typedef typename Concat<typename MakeSeq<N / 2>::type,
+                          typename MakeSeq<N - N / 2>::type>::type type;
+};
+
+template <>
+struct MakeSeq<0> {
+  typedef Seq<> type;
+};
+
+template <>
+struct MakeSeq<1> {
+  typedef Seq<0> type;
+};
+
+typedef std::array<uint16_t, kDimCurveIn + 1> LUT;
+
+template <int... Is>
+constexpr LUT MakeGamma22LUT(Seq<Is...>) {
+  return LUT{{ToOut(Gamma22(static_cast<double>(Is) / kDimCurveIn))...}};
+}
+
+template <int... Is>
+constexpr LUT MakeCIE1931LUT(Seq<Is...>) {
+  return LUT{{ToOut(CIE1931(static_cast<double>(Is) / kDimCurveIn))...}};
+}
+
+constexpr LUT kGamma22LUT =
+    MakeGamma22LUT(typename MakeSeq<kDimCurveIn + 1>::type());
+constexpr LUT kCIE1931LUT =
+    MakeCIE1931LUT(typename MakeSeq<kDimCurveIn + 1>::type());
+
+static_assert(kGamma22LUT[kDimCurveIn] == kDimCurveOut, "gamma end");
+static_assert(kCIE1931LUT[kDimCurveIn] == kDimCurveOut, "CIE end");
+
+}  // namespace
+
+int DimCurveApply(DimCurve curve, int brightness) {
+  if (brightness <= 0) return 0;
+  if (brightness >= kDimCurveIn) return kDimCurveOut;
+  switch (curve) {
+    case DimCurve::kGamma22:
+      return kGamma22LUT[brightness];
+    case DimCurve::kCIE1931:
+      return kCIE1931LUT[brightness];
+    case DimCurve::kLinear:
+    case DimCurve::kMax:
+      break;
+  }
+  return (brightness * kDimCurveOut + kDimCurveIn / 2) / kDimCurveIn;
+}
+
+float DimCurveApplyFloat(DimCurve curve, float brightness) {
+  switch (curve) {
+    case DimCurve::kGamma22:
+      return std::pow(brightness, 2.2f);
+    case DimCurve::kCIE1931: {
+      float l = brightness * 100;
+      if (l <= 8) return l / 903.3f;
+      float y = (l + 16) / 116;
+      return y * y * y;
+    }
+    case DimCurve::kLinear:
+    case DimCurve::kMax:
+      break;
+  }
+  return brightness;
+}
+
+}  // namespace shelly
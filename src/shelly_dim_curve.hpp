@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+// NB: This file is also built on the host by tools/light_bench,
+// it must not depend on Mongoose OS.
+
+namespace shelly {
+
+// Maps perceived brightness to light output.
+// NB: Keep in sync with lb.dim_curve in mos.yml.
+enum class DimCurve {
+  kLinear = 0,
+  kGamma22 = 1,  // Output = brightness ^ 2.2.
+  kCIE1931 = 2,  // CIE 1931 lightness (L*) to luminance.
+  kMax,
+};
+
+// Input resolution: brightness in 1/kDimCurveIn of full scale.
+static constexpr int kDimCurveIn = 1024;
+// Output resolution: duty in 1/kDimCurveOut of full scale.
+static constexpr int kDimCurveOut = 65535;
+
+// Brightness [0; kDimCurveIn] to duty [0; kDimCurveOut], by lookup in tables
+// generated at compile time. Ends are exact: 0 -> 0, full -> full.
+int DimCurveApply(DimCurve curve, int brightness);
+
+// Reference implementation in floating point, [0; 1] -> [0; 1].
+float DimCurveApplyFloat(DimCurve curve, float brightness);
+
+}  // namespace shelly
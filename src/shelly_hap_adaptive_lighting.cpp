@@ -17,6 +17,10 @@
 
 #include "shelly_hap_adaptive_lighting.hpp"
 
+#include <cstdio>
+
+#include "common/cs_crc32.h"
+
 #include "shelly_hap_light_bulb.hpp"
 
 // not officially documented, reverse engineering by HomeBridge
@@ -124,6 +128,46 @@ const HAPUUID kHAPCharacteristicType_CharacteristicValueActiveTransitionCount =
 namespace shelly {
 namespace hap {
 
+#define AL_FILE_NAME_FMT "al_%d.bin"
+#define AL_FILE_MAGIC 0x31544C41  // "ALT1"
+// HAP times are relative to 2001-01-01.
+#define AL_EPOCH_OFFSET 978307200
+// Wall clock time before 2020-01-01 has not been set yet.
+#define AL_MIN_VALID_TIME 1577836800
+// Presence flags of the optional fields of the transition.
+#define AL_F_NOTIFY_INTERVAL_THRESHOLD (1 << 0)
+#define AL_F_UPDATE_INTERVAL (1 << 1)
+#define AL_F_UNKNOWN_4 (1 << 2)
+#define AL_F_UNKNOWN_7 (1 << 3)
+#define AL_F_CURVE (1 << 4)
+
+struct AdaptiveLighting::FileHeader {
+  uint32_t magic;
+  uint64_t start_time;
+  uint64_t id3;
+  uint8_t transition_id[16];
+  int32_t min_multiplier;
+  int32_t max_multiplier;
+  uint32_t notify_interval_threshold;
+  uint16_t update_interval;
+  uint16_t unknown_7;
+  uint16_t iid;
+  uint16_t curve_iid;
+  uint8_t unknown_3;
+  uint8_t unknown_4;
+  uint8_t flags;
+  uint16_t num_entries;
+} __attribute__((packed));
+
+// Followed by num_entries of these and a CRC32 of all of the above.
+struct AdaptiveLighting::FileEntry {
+  float value;
+  float adjustment_factor;
+  uint32_t offset;
+  uint32_t duration;
+  uint8_t duration_present;
+} __attribute__((packed));
+
 template <class T>
 const T clamp(const T &v, const T &lo, const T &hi) {
   return std::min(std::max(v, lo), hi);
@@ -657,19 +701,199 @@ AdaptiveLighting::AdaptiveLighting(LightBulb *bulb, struct mgos_config_lb *cfg)
     : bulb_(bulb),
       cfg_(cfg),
       active_transition_count_(0),
-      update_timer_(std::bind(&AdaptiveLighting::UpdateCB, this)) {
-  // TODO:restore transition schedule from mgos config / transition_schedule
-  // caveat: we cannot know how long we were offline for, nor do we know the
-  // current time, so this seems pointless for now
+      update_timer_(std::bind(&AdaptiveLighting::UpdateCB, this)),
+      file_name_(mgos::SPrintf(AL_FILE_NAME_FMT, bulb->id())) {
 }
 
 AdaptiveLighting::~AdaptiveLighting() {
+  mgos_event_remove_handler(MGOS_EVENT_TIME_CHANGED, TimeChangedCB, this);
 }
 
 void AdaptiveLighting::Disable() {
+  if (active_transition_count_ != 0 || restore_pending_) {
+    RemoveSaved();
+  }
   update_timer_.Clear();
   active_transition_count_ = 0;
+  // Not needed until the next schedule is written.
+  active_table_.release();
+  active_curve_.Clear();
+  transition_count_characteristic_->RaiseEvent();
+}
+
+void AdaptiveLighting::UpdateTransitionRefs() {
+  VecToSequence(&active_transition_.transitionCurveConfiguration.curve,
+                &active_table_);
+  active_transition_.parameters.transitionId.bytes = &active_transition_id_;
+  active_transition_.parameters.transitionId.numBytes =
+      sizeof(active_transition_id_);
+}
+
+void AdaptiveLighting::Start(uint32_t offset_millis) {
+  restore_pending_ = false;
+  active_transition_count_ = 1;
   transition_count_characteristic_->RaiseEvent();
+  offset_millis_ = offset_millis;
+  notification_millis_ = 0;
+
+  update_timer_.Reset(active_transition_.updateInterval,
+                      MGOS_TIMER_REPEAT | MGOS_TIMER_RUN_NOW);
+}
+
+Status AdaptiveLighting::Save() const {
+  const transitionType &t = active_transition_;
+  const auto &range = t.transitionCurveConfiguration.adjustmentMultiplierRange;
+  FileHeader hdr = {};
+  hdr.magic = AL_FILE_MAGIC;
+  hdr.start_time = t.parameters.startTime;
+  hdr.id3 = t.parameters.id3;
+  memcpy(hdr.transition_id, active_transition_id_, sizeof(hdr.transition_id));
+  hdr.min_multiplier = range.minimumAdjustmentMultiplier;
+  hdr.max_multiplier = range.maximumAdjustmentMultiplier;
+  hdr.notify_interval_threshold = t.notifyIntervalThreshold;
+  hdr.update_interval = t.updateInterval;
+  hdr.unknown_7 = t.unknown_7;
+  hdr.iid = t.iid;
+  hdr.curve_iid = t.transitionCurveConfiguration.iid;
+  hdr.unknown_3 = t.unknown_3;
+  hdr.unknown_4 = t.unknown_4;
+  hdr.flags = ((t.notifyIntervalThresholdPresent
+                    ? AL_F_NOTIFY_INTERVAL_THRESHOLD
+                    : 0) |
+               (t.updateIntervalPresent ? AL_F_UPDATE_INTERVAL : 0) |
+               (t.unknown_4Present ? AL_F_UNKNOWN_4 : 0) |
+               (t.unknown_7Present ? AL_F_UNKNOWN_7 : 0) |
+               (t.transitionCurveConfiguration.curvePresent ? AL_F_CURVE : 0));
+  hdr.num_entries = active_table_.size();
+  std::string tmp_name = file_name_ + ".tmp";
+  FILE *fp = fopen(tmp_name.c_str(), "wb");
+  if (fp == nullptr) {
+    return mgos::Errorf(STATUS_UNAVAILABLE, "failed to open %s",
+                        tmp_name.c_str());
+  }
+  uint32_t crc = cs_crc32(0, &hdr, sizeof(hdr));
+  bool ok = (fwrite(&hdr, sizeof(hdr), 1, fp) == 1);
+  for (const auto &e : active_table_) {
+    const FileEntry fe = {e.value, e.adjustmentFactor, e.offset, e.duration,
+                          e.durationPresent};
+    crc = cs_crc32(crc, &fe, sizeof(fe));
+    ok = ok && (fwrite(&fe, sizeof(fe), 1, fp) == 1);
+  }
+  ok = ok && (fwrite(&crc, sizeof(crc), 1, fp) == 1);
+  Status st = Status::OK();
+  if (!ok) {
+    st = mgos::Errorf(STATUS_UNAVAILABLE, "write failed");
+  }
+  fclose(fp);
+  if (st.ok() && rename(tmp_name.c_str(), file_name_.c_str()) != 0) {
+    st = mgos::Errorf(STATUS_UNAVAILABLE, "failed to rename %s",
+                      tmp_name.c_str());
+  }
+  if (!st.ok()) remove(tmp_name.c_str());
+  return st;
+}
+
+Status AdaptiveLighting::Restore() {
+  FILE *fp = fopen(file_name_.c_str(), "rb");
+  if (fp == nullptr) {
+    return mgos::Errorf(STATUS_NOT_FOUND, "no transition");
+  }
+  FileHeader hdr;
+  uint32_t crc = 0, crc2 = 0;
+  Status st = Status::OK();
+  active_table_.clear();
+  if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || hdr.magic != AL_FILE_MAGIC) {
+    st = mgos::Errorf(STATUS_INVALID_ARGUMENT, "bad magic");
+  } else {
+    crc2 = cs_crc32(0, &hdr, sizeof(hdr));
+    for (size_t i = 0; i < hdr.num_entries; i++) {
+      FileEntry fe;
+      if (fread(&fe, sizeof(fe), 1, fp) != 1) {
+        st = mgos::Errorf(STATUS_DATA_LOSS, "read failed");
+        break;
+      }
+      crc2 = cs_crc32(crc2, &fe, sizeof(fe));
+      if (!active_table_.push_back({fe.adjustment_factor, fe.value, fe.offset,
+                                    fe.duration, fe.duration_present != 0})) {
+        st = mgos::Errorf(STATUS_INVALID_ARGUMENT, "too many entries");
+        break;
+      }
+    }
+    if (st.ok() && fread(&crc, sizeof(crc), 1, fp) != 1) {
+      st = mgos::Errorf(STATUS_DATA_LOSS, "read failed");
+    }
+  }
+  fclose(fp);
+  if (st.ok() && crc != crc2) {
+    st = mgos::Errorf(STATUS_DATA_LOSS, "bad checksum");
+  }
+  if (st.ok() &&
+      !active_curve_.Compile(active_table_.begin(), active_table_.size())) {
+    st = mgos::Errorf(STATUS_INVALID_ARGUMENT, "invalid curve");
+  }
+  if (!st.ok()) {
+    active_table_.clear();
+    return st;
+  }
+  transitionType &t = active_transition_;
+  t = {};
+  auto &range = t.transitionCurveConfiguration.adjustmentMultiplierRange;
+  t.parameters.startTime = hdr.start_time;
+  t.parameters.id3 = hdr.id3;
+  memcpy(active_transition_id_, hdr.transition_id,
+         sizeof(active_transition_id_));
+  range.minimumAdjustmentMultiplier = hdr.min_multiplier;
+  range.maximumAdjustmentMultiplier = hdr.max_multiplier;
+  t.transitionCurveConfiguration.iid = hdr.curve_iid;
+  t.transitionCurveConfiguration.curvePresent = (hdr.flags & AL_F_CURVE);
+  t.notifyIntervalThreshold = hdr.notify_interval_threshold;
+  t.updateInterval = hdr.update_interval;
+  t.unknown_7 = hdr.unknown_7;
+  t.iid = hdr.iid;
+  t.unknown_3 = hdr.unknown_3;
+  t.unknown_4 = hdr.unknown_4;
+  t.notifyIntervalThresholdPresent =
+      (hdr.flags & AL_F_NOTIFY_INTERVAL_THRESHOLD);
+  t.updateIntervalPresent = (hdr.flags & AL_F_UPDATE_INTERVAL);
+  t.unknown_4Present = (hdr.flags & AL_F_UNKNOWN_4);
+  t.unknown_7Present = (hdr.flags & AL_F_UNKNOWN_7);
+  // Only active transitions are saved.
+  t.unknown_3Present = true;
+  t.parametersPresent = true;
+  t.transitionCurveConfigurationPresent = true;
+  UpdateTransitionRefs();
+  return Status::OK();
+}
+
+void AdaptiveLighting::RemoveSaved() {
+  restore_pending_ = false;
+  remove(file_name_.c_str());
+}
+
+int64_t AdaptiveLighting::GetWallClockOffset() const {
+  const double now = mg_time();
+  if (now < AL_MIN_VALID_TIME) return -1;
+  const int64_t now_millis = (now - AL_EPOCH_OFFSET) * 1000;
+  const int64_t start = active_transition_.parameters.startTime;
+  return std::max<int64_t>(now_millis - start, 0);
+}
+
+// static
+void AdaptiveLighting::TimeChangedCB(int ev UNUSED_ARG,
+                                     void *ev_data UNUSED_ARG,
+                                     void *userdata) {
+  AdaptiveLighting *al = static_cast<AdaptiveLighting *>(userdata);
+  if (!al->restore_pending_) return;
+  const int64_t offset = al->GetWallClockOffset();
+  if (offset < 0) return;
+  if (offset > al->active_curve_.duration()) {
+    LOG(LL_INFO, ("Saved schedule is over"));
+    al->Disable();
+    return;
+  }
+  LOG(LL_INFO, ("Schedule resumed, elapsed: %d min",
+                (int) (offset / 1000 / 60)));
+  al->Start(offset);
 }
 
 void AdaptiveLighting::ColorTempChangedManually() {
@@ -688,65 +912,9 @@ void AdaptiveLighting::AdjustColorTemp(uint16_t elapsed_time) {
   if (active_transition_count_ != 1) {
     return;
   }
-  // eventually we should save the current offset_millis_ so we could
-  // continue the transition where we left off (except the unknown downtime)
-  // once we also store/restore the transition table from nvmem
-
   offset_millis_ += elapsed_time;
   notification_millis_ += elapsed_time;
 
-  uint32_t offset_next = 0, offset_curr = 0;
-
-  transitionEntryType curr, next;
-  curr = active_table_[0];
-  next = active_table_[0];
-
-  // loop over everything until now: could maybe be done more elegantly
-  // this is only done every 30 minutes
-  for (auto val = active_table_.cbegin(); val != active_table_.cend(); ++val) {
-    offset_next += val->offset;
-
-    if (val->durationPresent) {
-      offset_next += val->duration;
-    }
-
-    next = *val;
-
-    if (offset_millis_ <= offset_next) {
-      break;
-    }
-    curr = *val;
-    offset_curr = offset_next;
-  }
-
-  if (offset_millis_ > offset_next) {
-    Disable();
-  }
-
-  float duration = offset_next - offset_curr;
-  duration = clamp<float>(duration, 1, INT32_MAX);
-
-  float elapsed = offset_millis_ - offset_curr;
-  ;
-  float percentage = elapsed / duration;
-
-  if (curr.durationPresent) {
-    if (curr.duration > elapsed) {
-      percentage = 0;
-    } else {
-      elapsed -= curr.duration;
-      duration -= curr.duration;
-      percentage = elapsed / duration;
-    }
-  }
-
-  percentage = clamp<float>(percentage, 0, 1);
-
-  float val_interp = curr.value + (next.value - curr.value) * percentage;
-  float adj_interp =
-      curr.adjustmentFactor +
-      (next.adjustmentFactor - curr.adjustmentFactor) * percentage;
-
   auto range = &active_transition_.transitionCurveConfiguration
                     .adjustmentMultiplierRange;
 
@@ -755,7 +923,11 @@ void AdaptiveLighting::AdjustColorTemp(uint16_t elapsed_time) {
       (int32_t) cfg_->brightness, range->minimumAdjustmentMultiplier,
       range->maximumAdjustmentMultiplier);
 
-  int temperature = val_interp + adj_interp * adjustmentMultiplier;
+  int temperature = 0;
+  if (!active_curve_.Eval(offset_millis_, adjustmentMultiplier,
+                          &temperature)) {
+    Disable();
+  }
   LOG(LL_INFO, ("adaptive light: %i mired, elapsed in schedule: %f min",
                 temperature, offset_millis_ / 1000 / 60.0));
 
@@ -954,18 +1126,21 @@ Status AdaptiveLighting::Init() {
               &active_transition_.transitionCurveConfiguration.curve;
 
           active_table_.clear();
-          tableIterationContext table_context = {.vec = &active_table_,
-                                                 .count = 0};
+          tableIterationContext table_context = {.arena = &active_table_,
+                                                 .num_dropped = 0};
 
           err = curve->enumerate(
               &curve->dataSource,
               [](void *_Nullable context, HAPTLVValue *value,
-                 bool HAP_UNUSED *shouldContinue) {
+                 bool *shouldContinue) {
                 tableIterationContext *enc = (tableIterationContext *) context;
 
                 transitionEntryType *v = (transitionEntryType *) value;
 
-                enc->vec->push_back(*v);
+                if (!enc->arena->push_back(*v)) {
+                  enc->num_dropped++;
+                  *shouldContinue = false;
+                }
               },
               &table_context);
 
@@ -975,20 +1150,19 @@ Status AdaptiveLighting::Init() {
             return err;
           }
 
-          // encode active_table back for encoding
-          transitionCurveType *table =
-              &active_transition_.transitionCurveConfiguration.curve;
-
-          VecToSequence(table, &active_table_);
+          if (table_context.num_dropped > 0) {
+            LOG(LL_ERROR, ("table is longer than supported (%zu)",
+                           TransitionCurveArena::kMaxEntries));
+            active_table_.clear();
+            Disable();
+            return kHAPError_OutOfResources;
+          }
 
           // deep copy of parameters.uuid
-          active_transition_.parameters.transitionId.numBytes = 16;
           memcpy(&active_transition_id_,
                  active_transition_.parameters.transitionId.bytes,
-                 active_transition_.parameters.transitionId.numBytes);
-
-          active_transition_.parameters.transitionId.bytes =
-              &active_transition_id_;
+                 sizeof(active_transition_id_));
+          UpdateTransitionRefs();
 
           uint16_t iidColorTemperature =
               ((HAPBaseCharacteristic *) bulb_
@@ -1004,23 +1178,26 @@ Status AdaptiveLighting::Init() {
           if (!active_transition_.unknown_3Present) {
             LOG(LL_INFO, ("Schedule deactivated"));
             Disable();
+          } else if (!active_curve_.Compile(active_table_.begin(),
+                                            active_table_.size())) {
+            LOG(LL_ERROR, ("Invalid transition curve"));
+            Disable();
+            return kHAPError_InvalidData;
           } else {
             LOG(LL_INFO, ("Schedule activated"));
-            // TODO: store configuration as base64 encoded val
-            // e.g mgos_conf_set_str(&cfg_->transition_schedule, encodedval);
-            // this would use ~1 kB of storage, but only if we have a notion of
-            // time
-
-            active_transition_count_ = 1;
-            transition_count_characteristic_->RaiseEvent();
-            offset_millis_ = 0;
-            notification_millis_ = 0;
-
-            update_timer_.Reset(active_transition_.updateInterval,
-                                MGOS_TIMER_REPEAT | MGOS_TIMER_RUN_NOW);
+            Status st = Save();
+            if (!st.ok()) {
+              LOG(LL_ERROR, ("Failed to save schedule: %s",
+                             st.ToString().c_str()));
+            }
+            Start(0);
           }
         } else {
           active_transition_count_ = 0;
+          active_table_.release();
+          active_curve_.Clear();
+          // The saved transition has been overwritten.
+          if (transition_context.count >= 1) RemoveSaved();
         }
 
         return kHAPError_None;
@@ -1038,6 +1215,17 @@ Status AdaptiveLighting::Init() {
       kHAPCharacteristicDebugDescription_CharacteristicValueActiveTransitionCount);
   bulb_->AddChar(transition_count_characteristic_);
 
+  Status st = Restore();
+  if (st.ok()) {
+    LOG(LL_INFO, ("Schedule restored, waiting for time"));
+    restore_pending_ = true;
+    TimeChangedCB(MGOS_EVENT_TIME_CHANGED, nullptr, this);
+  } else if (st.error_code() != STATUS_NOT_FOUND) {
+    LOG(LL_ERROR, ("Failed to restore schedule: %s", st.ToString().c_str()));
+    RemoveSaved();
+  }
+  mgos_event_add_handler(MGOS_EVENT_TIME_CHANGED, TimeChangedCB, this);
+
   return Status::OK();
 }
 
@@ -17,11 +17,15 @@
 
 #pragma once
 
+#include <string>
+
 #include "mgos.hpp"
 #include "mgos_hap_chars.hpp"
 
 #include "HAP+Internal.h"
 
+#include "shelly_adaptive_lighting_curve.hpp"
+
 namespace shelly {
 namespace hap {
 
@@ -29,24 +33,14 @@ class LightBulb;
 
 typedef uint16_t iidType;
 
-typedef struct {
-  float adjustmentFactor;
-  float value;
-  uint32_t offset;
-  uint32_t duration;
-  bool durationPresent;
-} transitionEntryType;
-
 typedef struct {
   int32_t minimumAdjustmentMultiplier;
   int32_t maximumAdjustmentMultiplier;
 } adjustmentMultiplierRangeType;
 
-typedef std::vector<transitionEntryType> curveVectorType;
-
 typedef struct {
-  curveVectorType *vec;
-  size_t count;
+  TransitionCurveArena *arena;
+  size_t num_dropped;  // Beyond the capacity of the arena.
 } tableIterationContext;
 
 typedef struct {
@@ -163,9 +157,25 @@ class AdaptiveLighting {
   mgos::Status Init();
 
  private:
+  struct FileHeader;
+  struct FileEntry;
+
   void UpdateCB();
   void Disable();
   void AdjustColorTemp(uint16_t elapsed_time);
+  // Points the active transition at the table and ID kept here.
+  void UpdateTransitionRefs();
+  void Start(uint32_t offset_millis);
+
+  // The active transition is saved when written, so that it can be resumed
+  // after a reboot once the wall clock time is known.
+  mgos::Status Save() const;
+  mgos::Status Restore();
+  void RemoveSaved();
+  // Offset into the transition according to the wall clock and its start
+  // time, -1 if the time is not set.
+  int64_t GetWallClockOffset() const;
+  static void TimeChangedCB(int ev, void *ev_data, void *userdata);
 
   LightBulb *bulb_;
   struct mgos_config_lb *cfg_;
@@ -179,7 +189,8 @@ class AdaptiveLighting {
 
   transitionType active_transition_;
 
-  curveVectorType active_table_;
+  TransitionCurveArena active_table_;  // As received, for read responses.
+  AdaptiveLightingCurve active_curve_;
   uint8_t active_transition_id_[16];
 
   uint32_t offset_millis_;
@@ -187,6 +198,10 @@ class AdaptiveLighting {
 
   mgos::Timer update_timer_;
 
+  const std::string file_name_;
+  // Restored, waiting for the time to be set.
+  bool restore_pending_ = false;
+
   bool direct_answer_read_ = false;
   bool direct_answer_update_ = false;
 };
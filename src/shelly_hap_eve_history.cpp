@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shelly_hap_eve_history.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "mgos.hpp"
+
+namespace shelly {
+namespace hap {
+
+// Eve history service and characteristics, not part of the HAP spec.
+// https://github.com/simont77/fakegato-history
+
+// E863F007-079E-48FF-8F27-9C2605A29F52
+static const HAPUUID kHAPServiceType_EveHistory = {
+    0x52, 0x9F, 0xA2, 0x05, 0x26, 0x9C, 0x27, 0x8F,
+    0xFF, 0x48, 0x9E, 0x07, 0x07, 0xF0, 0x63, 0xE8,
+};
+
+// History status (S2R1).
+// E863F116-079E-48FF-8F27-9C2605A29F52
+static const HAPUUID kHAPCharacteristic_EveHistoryStatus = {
+    0x52, 0x9F, 0xA2, 0x05, 0x26, 0x9C, 0x27, 0x8F,
+    0xFF, 0x48, 0x9E, 0x07, 0x16, 0xF1, 0x63, 0xE8,
+};
+
+// History entries (S2R2).
+// E863F117-079E-48FF-8F27-9C2605A29F52
+static const HAPUUID kHAPCharacteristic_EveHistoryEntries = {
+    0x52, 0x9F, 0xA2, 0x05, 0x26, 0x9C, 0x27, 0x8F,
+    0xFF, 0x48, 0x9E, 0x07, 0x17, 0xF1, 0x63, 0xE8,
+};
+
+// History request (S2W1).
+// E863F11C-079E-48FF-8F27-9C2605A29F52
+static const HAPUUID kHAPCharacteristic_EveHistoryRequest = {
+    0x52, 0x9F, 0xA2, 0x05, 0x26, 0x9C, 0x27, 0x8F,
+    0xFF, 0x48, 0x9E, 0x07, 0x1C, 0xF1, 0x63, 0xE8,
+};
+
+// Set time (S2W2).
+// E863F121-079E-48FF-8F27-9C2605A29F52
+static const HAPUUID kHAPCharacteristic_EveSetTime = {
+    0x52, 0x9F, 0xA2, 0x05, 0x26, 0x9C, 0x27, 0x8F,
+    0xFF, 0x48, 0x9E, 0x07, 0x21, 0xF1, 0x63, 0xE8,
+};
+
+// Eve timestamps are relative to 2001-01-01T00:00:00Z.
+static constexpr uint32_t kEveEpochOffset = 978307200;
+// Record layout of the energy log: 4 fields, power is field 7, 2 bytes.
+static const uint8_t kEveEnergySignature[] = {0x04, 0x01, 0x02, 0x02, 0x02,
+                                              0x07, 0x02, 0x0F, 0x03};
+static constexpr uint8_t kEveEnergyEntryType = 0x1F;
+
+static void PutLE16(std::string *s, uint16_t v) {
+  s->push_back(v & 0xFF);
+  s->push_back(v >> 8);
+}
+
+static void PutLE32(std::string *s, uint32_t v) {
+  PutLE16(s, v & 0xFFFF);
+  PutLE16(s, v >> 16);
+}
+
+// Characteristic of the Data format with byte string value.
+class DataCharacteristic : public mgos::hap::Characteristic {
+ public:
+  typedef std::function<HAPError(std::string *value)> ReadHandler;
+  typedef std::function<HAPError(const uint8_t *data, size_t len)>
+      WriteHandler;
+
+  DataCharacteristic(uint16_t iid, const HAPUUID *type, ReadHandler rh,
+                     bool supports_notification, WriteHandler wh,
+                     const char *debug_description)
+      : Characteristic(iid, kHAPCharacteristicFormat_Data, type,
+                       debug_description),
+        read_handler_(rh),
+        write_handler_(wh) {
+    HAPDataCharacteristic *c =
+        reinterpret_cast<HAPDataCharacteristic *>(hap_char());
+    c->properties.readable = (rh != nullptr);
+    c->properties.writable = (wh != nullptr);
+    c->properties.supportsEventNotification = supports_notification;
+    c->constraints.maxLength = 256;
+    if (rh != nullptr) c->callbacks.handleRead = HandleReadCB;
+    if (wh != nullptr) c->callbacks.handleWrite = HandleWriteCB;
+    s_instances.push_back(this);
+  }
+
+  virtual ~DataCharacteristic() {
+    s_instances.erase(
+        std::remove(s_instances.begin(), s_instances.end(), this),
+        s_instances.end());
+  }
+
+ private:
+  static DataCharacteristic *FindInstance(const HAPCharacteristic *hc) {
+    for (auto *c : s_instances) {
+      if (c->GetHAPCharacteristic() == hc) return c;
+    }
+    return nullptr;
+  }
+
+  static HAPError HandleReadCB(HAPAccessoryServerRef *server,
+                               const HAPDataCharacteristicReadRequest *request,
+                               void *value_bytes, size_t max_value_bytes,
+                               size_t *num_value_bytes, void *context) {
+    auto *c = FindInstance(request->characteristic);
+    if (c == nullptr) return kHAPError_Unknown;
+    std::string value;
+    HAPError err = c->read_handler_(&value);
+    if (err != kHAPError_None) return err;
+    if (value.size() > max_value_bytes) return kHAPError_OutOfResources;
+    memcpy(value_bytes, value.data(), value.size());
+    *num_value_bytes = value.size();
+    (void) server;
+    (void) context;
+    return kHAPError_None;
+  }
+
+  static HAPError HandleWriteCB(
+      HAPAccessoryServerRef *server,
+      const HAPDataCharacteristicWriteRequest *request,
+      const void *value_bytes, size_t num_value_bytes, void *context) {
+    auto *c = FindInstance(request->characteristic);
+    if (c == nullptr) return kHAPError_Unknown;
+    (void) server;
+    (void) context;
+    return c->write_handler_((const uint8_t *) value_bytes, num_value_bytes);
+  }
+
+  const ReadHandler read_handler_;
+  const WriteHandler write_handler_;
+
+  static std::vector<DataCharacteristic *> s_instances;
+};
+
+std::vector<DataCharacteristic *> DataCharacteristic::s_instances;
+
+EveEnergyLog::EveEnergyLog(PMHistory *hist)
+    : hist_(hist), entries_(kNumEntries) {
+  handler_id_ = hist_->AddIntervalHandler(
+      kEntryIntervalSec,
+      std::bind(&EveEnergyLog::AddEntry, this, _1, _2));
+}
+
+EveEnergyLog::~EveEnergyLog() {
+  hist_->RemoveIntervalHandler(handler_id_);
+}
+
+uint32_t EveEnergyLog::first_entry() const {
+  // Entry 1 is the reference time, data entries start at 2.
+  if (num_entries_ < kNumEntries) return 1;
+  return num_entries_ - kNumEntries + 2;
+}
+
+uint32_t EveEnergyLog::last_entry() const {
+  return num_entries_ + 1;
+}
+
+const EveEnergyLog::Entry &EveEnergyLog::GetEntry(uint32_t addr) const {
+  return entries_[(addr - 2) % kNumEntries];
+}
+
+uint32_t EveEnergyLog::GetRefTime(uint32_t addr) const {
+  // The ring is much shorter than the time between references, it never
+  // holds entries of more than two.
+  return (addr >= ref_entry_ ? ref_time_ : prev_ref_time_);
+}
+
+void EveEnergyLog::PutRefRecord(std::string *res, uint32_t addr) const {
+  res->push_back(0x15);
+  PutLE32(res, addr);
+  PutLE32(res, 1);
+  res->push_back(0x81);
+  PutLE32(res, GetRefTime(addr));
+  res->append(7, '\0');
+}
+
+void EveEnergyLog::AddEntry(uint32_t ts, float power_w) {
+  if (ts < kEveEpochOffset) return;
+  uint32_t t = ts - kEveEpochOffset;
+  if (ref_time_ == 0) ref_time_ = t;
+  if (t < ref_time_) return;  // Clock went backwards.
+  uint32_t slot = (t - ref_time_) / kEntryIntervalSec;
+  if (slot >= kRefSlot) {
+    // Out of offsets, entries from here on are relative to a new reference.
+    prev_ref_time_ = ref_time_;
+    ref_time_ += slot * kEntryIntervalSec;
+    entries_[num_entries_ % kNumEntries] = {kRefSlot, 0};
+    num_entries_++;
+    ref_entry_ = last_entry();
+    slot = 0;
+  }
+  Entry &e = entries_[num_entries_ % kNumEntries];
+  e.slot = slot;
+  e.power_dw = (uint16_t) std::max(0.0f, std::min(power_w * 10, 65535.0f));
+  num_entries_++;
+}
+
+std::string EveEnergyLog::GetStatus() const {
+  std::string res;
+  uint32_t last_time = 0;
+  if (num_entries_ > 0) {
+    const Entry &e = GetEntry(last_entry());
+    if (e.slot != kRefSlot) last_time = (uint32_t) e.slot * kEntryIntervalSec;
+  }
+  PutLE32(&res, last_time);
+  PutLE32(&res, 0);
+  PutLE32(&res, ref_time_);
+  res.append((const char *) kEveEnergySignature, sizeof(kEveEnergySignature));
+  PutLE16(&res, std::min(last_entry(), (uint32_t) kNumEntries));
+  PutLE16(&res, kNumEntries);
+  PutLE32(&res, first_entry());
+  res.append("\x00\x00\x00\x00\x01\x01", 6);
+  return res;
+}
+
+void EveEnergyLog::SetReadAddress(uint32_t addr) {
+  read_addr_ = std::max(addr, first_entry());
+}
+
+std::string EveEnergyLog::GetEntries() {
+  std::string res;
+  if (read_addr_ == 0 || ref_time_ == 0 || read_addr_ > last_entry()) {
+    read_addr_ = 0;
+    res.push_back(0);  // No more entries.
+    return res;
+  }
+  for (size_t i = 0; i < kMaxEntriesPerRead && read_addr_ <= last_entry();
+       i++, read_addr_++) {
+    if (read_addr_ == 1 || GetEntry(read_addr_).slot == kRefSlot) {
+      PutRefRecord(&res, read_addr_);
+      continue;
+    }
+    const Entry &e = GetEntry(read_addr_);
+    res.push_back(0x14);
+    PutLE32(&res, read_addr_);
+    PutLE32(&res, (uint32_t) e.slot * kEntryIntervalSec);
+    res.push_back(kEveEnergyEntryType);
+    PutLE32(&res, 0);
+    PutLE16(&res, e.power_dw);
+    PutLE32(&res, 0);
+  }
+  return res;
+}
+
+EveHistoryService::EveHistoryService(int id, PMHistory *hist)
+    : Service(SHELLY_HAP_IID_BASE_EVE_HISTORY +
+                  SHELLY_HAP_IID_STEP_EVE_HISTORY * (id - 1),
+              &kHAPServiceType_EveHistory, "eve-history"),
+      log_(hist) {
+}
+
+EveHistoryService::~EveHistoryService() {
+}
+
+Status EveHistoryService::Init() {
+  uint16_t iid = svc_.iid + 1;
+  AddChar(new DataCharacteristic(
+      iid++, &kHAPCharacteristic_EveHistoryStatus,
+      [this](std::string *value) {
+        *value = log_.GetStatus();
+        return kHAPError_None;
+      },
+      true /* supports_notification */, nullptr, "eve-history-status"));
+  AddChar(new DataCharacteristic(
+      iid++, &kHAPCharacteristic_EveHistoryEntries,
+      [this](std::string *value) {
+        *value = log_.GetEntries();
+        return kHAPError_None;
+      },
+      true /* supports_notification */, nullptr, "eve-history-entries"));
+  AddChar(new DataCharacteristic(
+      iid++, &kHAPCharacteristic_EveHistoryRequest, nullptr,
+      false /* supports_notification */,
+      [this](const uint8_t *data, size_t len) {
+        if (len < 6) return kHAPError_InvalidData;
+        uint32_t addr = data[2] | (data[3] << 8) | (data[4] << 16) |
+                        ((uint32_t) data[5] << 24);
+        log_.SetReadAddress(addr);
+        return kHAPError_None;
+      },
+      "eve-history-request"));
+  // Eve sets the time on connect, we use SNTP time instead.
+  AddChar(new DataCharacteristic(
+      iid++, &kHAPCharacteristic_EveSetTime, nullptr,
+      false /* supports_notification */,
+      [](const uint8_t *, size_t) { return kHAPError_None; },
+      "eve-set-time"));
+  return Status::OK();
+}
+
+}  // namespace hap
+}  // namespace shelly
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mgos_hap_chars.hpp"
+#include "mgos_hap_service.hpp"
+
+#include "shelly_common.hpp"
+#include "shelly_pm_history.hpp"
+
+namespace shelly {
+namespace hap {
+
+// Energy log in the format used by the Eve history service.
+//
+// Average power is logged every 10 minutes (as Eve Energy does) into a
+// fixed-size ring, computed by the meter's PMHistory from its energy
+// counter. The log is maintained on the device regardless of whether a
+// controller is connected, controllers fetch it incrementally starting from
+// the last entry they have. Entries are numbered from 1, entry 1 being the
+// reference time record. Entry times are 16 bit offsets from the reference,
+// when they run out (after ~455 days) a new reference record is logged.
+class EveEnergyLog {
+ public:
+  static constexpr int kEntryIntervalSec = 600;
+  static constexpr size_t kNumEntries = 384;  // 2 2/3 days.
+  static constexpr size_t kMaxEntriesPerRead = 11;
+
+  explicit EveEnergyLog(PMHistory *hist);
+  ~EveEnergyLog();
+
+  // History status (S2R1).
+  std::string GetStatus() const;
+  // Next batch of entries for the current transfer (S2R2).
+  std::string GetEntries();
+  // History request (S2W1), sets the entry to start the transfer from.
+  void SetReadAddress(uint32_t addr);
+
+  // ts is the start of the entry's interval, Unix time.
+  void AddEntry(uint32_t ts, float power_w);
+
+  uint32_t first_entry() const;
+  uint32_t last_entry() const;
+
+ private:
+  struct Entry {
+    uint16_t slot;      // Entry time, in kEntryIntervalSec since reference.
+    uint16_t power_dw;  // Average power, 0.1 W.
+  };
+  // Slot of reference time records after the first one.
+  static constexpr uint16_t kRefSlot = 0xFFFF;
+
+  const Entry &GetEntry(uint32_t addr) const;
+  // Of the entry at addr.
+  uint32_t GetRefTime(uint32_t addr) const;
+  void PutRefRecord(std::string *res, uint32_t addr) const;
+
+  PMHistory *const hist_;
+  PMHistory::HandlerID handler_id_ = PMHistory::kInvalidHandlerID;
+  std::vector<Entry> entries_;
+  uint32_t num_entries_ = 0;  // Entries logged in total.
+  uint32_t ref_time_ = 0;     // Seconds since the Eve epoch (2001-01-01).
+  uint32_t ref_entry_ = 1;    // Entry that set ref_time_.
+  uint32_t prev_ref_time_ = 0;
+  uint32_t read_addr_ = 0;    // Next entry to send, 0 - no transfer.
+
+  EveEnergyLog(const EveEnergyLog &other) = delete;
+};
+
+// Eve history service exposing EveEnergyLog of a switch or outlet.
+class EveHistoryService : public mgos::hap::Service {
+ public:
+  EveHistoryService(int id, PMHistory *hist);
+  virtual ~EveHistoryService();
+
+  Status Init();
+
+ private:
+  EveEnergyLog log_;
+};
+
+}  // namespace hap
+}  // namespace shelly
@@ -52,6 +52,8 @@ class GarageDoorOpener : public Component, public mgos::hap::Service {
   bool IsIdle() override;
 
  private:
+  friend class SimAccess;  // Simulation harness, see tools/wc_sim.
+
   // NB: Values correspond to HAP Current Door State values.
   enum class State {
     kOpen = 0,
@@ -16,6 +16,8 @@
  */
 
 #include "shelly_hap_light_bulb.hpp"
+#include "shelly_color.hpp"
+#include "shelly_light_effect.hpp"
 #include "shelly_main.hpp"
 #include "shelly_switch.hpp"
 
@@ -163,6 +165,11 @@ Status LightBulb::Init() {
     cfg_->in_mode = -2;
   }
 
+  // Saved by another component while it was running.
+  if (!LightEffectLoops(static_cast<LightEffect>(cfg_->effect))) {
+    cfg_->effect = static_cast<int>(LightEffect::kNone);
+  }
+
   bool should_restore = (cfg_->initial_state == (int) InitialState::kLast);
   if (IsSoftReboot()) should_restore = true;
 
@@ -274,6 +281,18 @@ void LightBulb::SetBrightness(int brightness, const std::string &source) {
   controller_->UpdateOutput(cfg_, true);
 }
 
+void LightBulb::SetEffect(int effect, const std::string &source) {
+  if (cfg_->effect == effect) return;
+
+  LOG(LL_INFO, ("Effect changed (%s): %d => %d", source.c_str(), cfg_->effect,
+                effect));
+
+  cfg_->effect = effect;
+  dirty_ = true;
+
+  controller_->UpdateOutput(cfg_, true);
+}
+
 StatusOr<std::string> LightBulb::GetInfo() const {
   const_cast<LightBulb *>(this)->SaveState();
   return mgos::SPrintf("sta: %s, b: %i, h: %i, sa: %i, ct: %i",
@@ -287,12 +306,15 @@ StatusOr<std::string> LightBulb::GetInfoJSON() const {
       " brightness: %d, hue: %d, saturation: %d, "
       " in_inverted: %B, initial: %d, in_mode: %d, "
       "auto_off: %B, auto_off_delay: %.3f, transition_time: %d, "
-      "color_temperature: %d, bulb_type: %d, hap_optional: %d}",
+      "dim_curve: %d, transition_space: %d, color_temperature: %d, "
+      "effect: %d, effect_period: %d, effect_depth: %d, "
+      "bulb_type: %d, hap_optional: %d}",
       id(), type(), cfg_->name, cfg_->svc_hidden, cfg_->state, cfg_->brightness,
       cfg_->hue, cfg_->saturation, cfg_->in_inverted, cfg_->initial_state,
       cfg_->in_mode, cfg_->auto_off, cfg_->auto_off_delay,
-      cfg_->transition_time, cfg_->color_temperature, controller_->Type(),
-      is_optional_);
+      cfg_->transition_time, cfg_->dim_curve, cfg_->transition_space,
+      cfg_->color_temperature, cfg_->effect, cfg_->effect_period,
+      cfg_->effect_depth, controller_->Type(), is_optional_);
 }
 
 Status LightBulb::SetConfig(const std::string &config_json,
@@ -304,10 +326,13 @@ Status LightBulb::SetConfig(const std::string &config_json,
   json_scanf(config_json.c_str(), config_json.size(),
              "{name: %Q, svc_hidden: %B, in_mode: %d, in_inverted: %B, "
              "initial_state: %d, "
-             "auto_off: %B, auto_off_delay: %lf, transition_time: %d}",
+             "auto_off: %B, auto_off_delay: %lf, transition_time: %d, "
+             "dim_curve: %d, transition_space: %d, effect_period: %d, "
+             "effect_depth: %d}",
              &cfg.name, &cfg.svc_hidden, &cfg.in_mode, &in_inverted,
              &cfg.initial_state, &cfg.auto_off, &cfg.auto_off_delay,
-             &cfg.transition_time);
+             &cfg.transition_time, &cfg.dim_curve, &cfg.transition_space,
+             &cfg.effect_period, &cfg.effect_depth);
 
   mgos::ScopedCPtr name_owner((void *) cfg.name);
   // Validation.
@@ -331,6 +356,21 @@ Status LightBulb::SetConfig(const std::string &config_json,
   if (cfg.initial_state < 0 || cfg.initial_state > (int) InitialState::kMax) {
     return mgos::Errorf(STATUS_INVALID_ARGUMENT, "invalid %s", "initial_state");
   }
+  if (cfg.dim_curve < 0 || cfg.dim_curve >= (int) DimCurve::kMax) {
+    return mgos::Errorf(STATUS_INVALID_ARGUMENT, "invalid %s", "dim_curve");
+  }
+  if (cfg.transition_space < 0 ||
+      cfg.transition_space >= (int) TransitionSpace::kMax) {
+    return mgos::Errorf(STATUS_INVALID_ARGUMENT, "invalid %s",
+                        "transition_space");
+  }
+  if (cfg.effect_period < 100 || cfg.effect_period > 86400000) {
+    return mgos::Errorf(STATUS_INVALID_ARGUMENT, "invalid %s",
+                        "effect_period");
+  }
+  if (cfg.effect_depth < 0 || cfg.effect_depth > 100) {
+    return mgos::Errorf(STATUS_INVALID_ARGUMENT, "invalid %s", "effect_depth");
+  }
   // Now copy over.
   if (cfg_->name != nullptr && strcmp(cfg_->name, cfg.name) != 0) {
     mgos_conf_set_str(&cfg_->name, cfg.name);
@@ -355,24 +395,40 @@ Status LightBulb::SetConfig(const std::string &config_json,
   cfg_->auto_off = cfg.auto_off;
   cfg_->auto_off_delay = cfg.auto_off_delay;
   cfg_->transition_time = cfg.transition_time;
+  cfg_->transition_space = cfg.transition_space;
+  // Picked up by the next frame.
+  cfg_->effect_period = cfg.effect_period;
+  cfg_->effect_depth = cfg.effect_depth;
+  if (cfg_->dim_curve != cfg.dim_curve) {
+    cfg_->dim_curve = cfg.dim_curve;
+    // Same state, outputs are rewritten through the new curve.
+    controller_->UpdateOutput(cfg_, true);
+  }
   return Status::OK();
 }
 
 void LightBulb::SaveState() {
   if (!dirty_) return;
+  // One-shot effects are not started again on boot.
+  const int effect = cfg_->effect;
+  if (!LightEffectLoops(static_cast<LightEffect>(effect))) {
+    cfg_->effect = static_cast<int>(LightEffect::kNone);
+  }
   mgos_sys_config_save(&mgos_sys_config, false /* try_once */, NULL /* msg */);
+  cfg_->effect = effect;
   dirty_ = false;
 }
 
 Status LightBulb::SetState(const std::string &state_json) {
   int8_t state = -1, toggle = -1;
   int brightness = -1, hue = -1, saturation = -1, color_temperature = -1;
+  int effect = -1;
 
   json_scanf(state_json.c_str(), state_json.size(),
              "{state: %B, toggle: %B, brightness: %d, hue: %d, saturation: %d, "
-             "color_temperature: %d}",
+             "color_temperature: %d, effect: %d}",
              &state, &toggle, &brightness, &hue, &saturation,
-             &color_temperature);
+             &color_temperature, &effect);
 
   if (state != -1 && toggle != -1) {
     return mgos::Errorf(STATUS_INVALID_ARGUMENT, "only %s or %s can be used",
@@ -401,6 +457,13 @@ Status LightBulb::SetState(const std::string &state_json) {
                         color_temperature);
   }
 
+  if (effect != -1 &&
+      (effect < 0 || effect >= (int) LightEffect::kMax ||
+       (effect == (int) LightEffect::kColorLoop &&
+        controller_->Type() != LightBulbControllerBase::BulbType::kRGBW))) {
+    return mgos::Errorf(STATUS_INVALID_ARGUMENT, "invalid effect: %d", effect);
+  }
+
   if (toggle != -1) {
     state = !controller_->IsOn();
   }
@@ -409,6 +472,7 @@ Status LightBulb::SetState(const std::string &state_json) {
   if (saturation != -1) SetSaturation(saturation, "RPC");
   if (brightness != -1) SetBrightness(brightness, "RPC");
   if (color_temperature != -1) SetColorTemperature(color_temperature, "RPC");
+  if (effect != -1) SetEffect(effect, "RPC");
 
   return Status::OK();
 }
@@ -77,6 +77,7 @@ class LightBulb : public Component, public mgos::hap::Service {
   void SetSaturation(int saturation, const std::string &source);
 
   void SetBrightness(int brightness, const std::string &source);
+  void SetEffect(int effect, const std::string &source);
 
   bool IsAutoOffEnabled() const;
 
@@ -70,6 +70,7 @@ Status Outlet::Init() {
 
   // Power
   AddPowerMeter(&iid);
+  AddEveHistory();
 
   return Status::OK();
 }
@@ -63,6 +63,7 @@ Status Switch::Init() {
 
   // Power
   AddPowerMeter(&iid);
+  AddEveHistory();
 
   out_->SetInvert(cfg_->out_inverted);
 
@@ -17,6 +17,7 @@
 
 #include "shelly_hap_window_covering.hpp"
 
+#include <algorithm>
 #include <cmath>
 
 #include "mgos.hpp"
@@ -32,6 +33,9 @@ const int DISPLAY_TYPE_WINDOW_COVERING = 0;
 const int DISPLAY_TYPE_WINDOW = 1;
 const int DISPLAY_TYPE_GARAGE_DOOR = 2;
 
+// Power readings older than this are considered a meter failure.
+static constexpr int64_t kMaxPMAgeMicros = 3000000;
+
 WindowCovering::WindowCovering(int id, Input *in0, Input *in1, Output *out0,
                                Output *out1, PowerMeter *pm0, PowerMeter *pm1,
                                struct mgos_config_wc *cfg, ServiceType type)
@@ -52,7 +56,8 @@ WindowCovering::WindowCovering(int id, Input *in0, Input *in1, Output *out0,
       cur_pos_(cfg_->current_pos),
       tgt_pos_(cfg_->current_pos),
       state_timer_(std::bind(&WindowCovering::RunOnce, this)),
-      move_ms_per_pct_(cfg_->move_time_ms / 100.0),
+      cal_trace_(kCalTraceLen),
+      move_trace_(kMoveTraceLen),
       service_type_(type) {
   if (!cfg_->swap_inputs) {
     in_open_ = in0;
@@ -81,6 +86,12 @@ WindowCovering::~WindowCovering() {
   if (in_close_handler_ != Input::kInvalidHandlerID) {
     in_close_->RemoveHandler(in_close_handler_);
   }
+  if (pm_open_handler_ != PowerMeter::kInvalidHandlerID) {
+    pm_open_->RemoveHandler(pm_open_handler_);
+  }
+  if (pm_close_handler_ != PowerMeter::kInvalidHandlerID) {
+    pm_close_->RemoveHandler(pm_close_handler_);
+  }
   out_open_->SetState(false, "dtor");
   out_close_->SetState(false, "dtor");
   SaveState();
@@ -230,7 +241,15 @@ Status WindowCovering::Init() {
   } else {
     LOG(LL_INFO, ("WC %d: not calibrated", id()));
   }
-  state_timer_.Reset(100, MGOS_TIMER_REPEAT);
+  // Every sample is needed: calibration averages them and movement reacts
+  // to motor power changes as soon as they are measured.
+  pm_open_handler_ = pm_open_->AddHandler(
+      std::bind(&WindowCovering::PMHandler, this, Direction::kOpen, _1),
+      PowerMeter::HandlerOpts());
+  pm_close_handler_ = pm_close_->AddHandler(
+      std::bind(&WindowCovering::PMHandler, this, Direction::kClose, _1),
+      PowerMeter::HandlerOpts());
+  // No periodic tick while idle, state machine is woken up by events.
   return Status::OK();
 }
 
@@ -250,17 +269,82 @@ StatusOr<std::string> WindowCovering::GetInfo() const {
       (int) last_move_dir_);
 }
 
+StatusOr<std::string> WindowCovering::GetTraceJSON(const std::string &kind,
+                                                    int offset,
+                                                    int limit) const {
+  const WCPowerTrace *t = nullptr;
+  if (kind == "cal") {
+    t = &cal_trace_;
+  } else if (kind == "move") {
+    t = &move_trace_;
+  } else {
+    return mgos::Errorf(STATUS_INVALID_ARGUMENT, "invalid %s", "kind");
+  }
+  if (t->kind() == WCPowerTrace::Kind::kNone) {
+    return mgos::Errorf(STATUS_NOT_FOUND, "no %s trace", kind.c_str());
+  }
+  const WCPowerParams &pp = t->params();
+  const auto &entries = t->entries();
+  const int total = entries.size();
+  if (offset < 0) offset = 0;
+  if (limit <= 0 || limit > kTracePageLen) limit = kTracePageLen;
+  const int end = std::min(offset + limit, total);
+  std::string res = mgos::JSONPrintStringf(
+      "{id: %d, kind: %Q, start: %.3f, recording: %B, idle_power_thr: %.2f, "
+      "move_power: %.2f, max_ramp_up_time_ms: %d, "
+      "obstruction_power_coeff: %.2f, obstruction_duration_ms: %d, "
+      "dropped: %d, total: %d, offset: %d, next: %d, entries: [",
+      id(), kind.c_str(), t->start() / 1000000.0, (t == trace_),
+      pp.idle_power_thr, pp.move_power, pp.max_ramp_up_time_ms,
+      pp.obstruction_power_coeff, pp.obstruction_duration_ms,
+      t->num_dropped(), total, offset, (end < total ? end : -1));
+  // [dt_ms, power_dw, state, dir], see WCPowerTrace::Entry.
+  for (int i = offset; i < end; i++) {
+    const auto &e = entries[i];
+    mgos::JSONAppendStringf(
+        &res, (i > offset ? ",[%u,%u,%u,%u]" : "[%u,%u,%u,%u]"),
+        (unsigned) e.dt_ms, (unsigned) e.p_dw, (unsigned) e.state,
+        (unsigned) e.dir);
+  }
+  res.append("], passes: [");
+  if (offset > 0) {
+    res.append("]}");
+    return res;
+  }
+  bool first = true;
+  for (const auto &p : AnalyzeWCPowerTrace(*t)) {
+    if (!first) res.append(",");
+    mgos::JSONAppendStringf(
+        &res,
+        "{state: %d, dir: %d, start_ms: %d, duration_ms: %d, samples: %d, "
+        "ramp_up_ms: %d, travel_ms: %d, mean_power: %.2f, "
+        "steady_power: %.2f, peak_power: %.2f, obst_power: %.2f, "
+        "obst_margin: %.2f, obst_trip_ms: %d, obst_trip: %Q}",
+        p.state, p.dir, p.start_ms, p.duration_ms, p.num_samples,
+        p.ramp_up_ms, p.travel_ms, p.mean_power_w, p.steady_power_w,
+        p.peak_power_w, p.obst_power_w, p.obst_margin_w, p.obst_trip_ms,
+        WCPowerStats::TripStr(p.obst_trip));
+    first = false;
+  }
+  res.append("]}");
+  return res;
+}
+
 StatusOr<std::string> WindowCovering::GetInfoJSON() const {
   return mgos::JSONPrintStringf(
       "{id: %d, type: %d, name: %Q, "
       "in_mode: %d, swap_inputs: %B, swap_outputs: %B, "
-      "cal_done: %B, move_time_ms: %d, move_power: %d, "
-      "state: %d, state_str: %Q, cur_pos: %d, tgt_pos: %d, "
-      "display_type: %d}",
+      "cal_done: %B, move_time_ms: %d, open_time_ms: %d, "
+      "stop_latency_ms: %d, move_power: %d, state: %d, state_str: %Q, "
+      "cur_pos: %d, tgt_pos: %d, display_type: %d, move_stats: {samples: %d, "
+      "ema: %.2f, stddev: %.2f, slope: %.2f, trip: %Q}}",
       id(), type(), cfg_->name, cfg_->in_mode, cfg_->swap_inputs,
       cfg_->swap_outputs, cfg_->calibrated, cfg_->move_time_ms,
-      (int) cfg_->move_power, (int) state_, StateStr(state_), (int) cur_pos_,
-      (int) tgt_pos_, (int) service_type_);
+      cfg_->open_time_ms, cfg_->coast_ms, (int) cfg_->move_power, (int) state_,
+      StateStr(state_), (int) cur_pos_, (int) tgt_pos_, (int) service_type_,
+      move_stats_.num_samples(), move_stats_.ema(), move_stats_.stddev(),
+      move_stats_.slope(),
+      WCPowerStats::TripStr(move_stats_.trip()));
 }
 
 Status WindowCovering::SetConfig(const std::string &config_json,
@@ -325,11 +409,14 @@ Status WindowCovering::SetState(const std::string &state_json) {
     tgt_state_ = static_cast<State>(state);
     if (state_ != State::kIdle) {
       SetInternalState(State::kStop);
+    } else {
+      RunOnce();
     }
     return Status::OK();
   }
   if (tgt_pos >= 0) {
     SetTgtPos(tgt_pos, "RPC");
+    RunOnce();
   } else if (tgt_pos == -1) {
     RunOnce();
     SetTgtPos(cur_pos_, "RPC");  // Stop
@@ -361,6 +448,12 @@ const char *WindowCovering::StateStr(State state) {
       return "cal1";
     case State::kPostCal1:
       return "postcal1";
+    case State::kPreCal2:
+      return "precal2";
+    case State::kCal2:
+      return "cal2";
+    case State::kPostCal2:
+      return "postcal2";
     case State::kMove:
       return "move";
     case State::kRampUp:
@@ -377,6 +470,36 @@ const char *WindowCovering::StateStr(State state) {
   return "???";
 }
 
+// static
+int WindowCovering::GetTickIntervalMs(State state) {
+  switch (state) {
+    case State::kNone:
+      return -1;
+    case State::kIdle:
+      // Check once if there's something else to do, then sleep.
+    case State::kMove:
+    case State::kStop:
+    case State::kError:
+    case State::kPostCal2:
+      return 0;
+    case State::kRampUp:
+    case State::kMoving:
+    case State::kStopping:
+      return kFastTickMs;
+    case State::kPreCal0:
+    case State::kCal0:
+    case State::kPostCal0:
+    case State::kPreCal1:
+    case State::kCal1:
+    case State::kPostCal1:
+    case State::kPreCal2:
+    case State::kCal2:
+      // Also keeps outputs off for a while before reversing direction.
+      return kSlowTickMs;
+  }
+  return -1;
+}
+
 // static
 float WindowCovering::TrimPos(float pos) {
   if (pos < kFullyClosed) {
@@ -397,6 +520,16 @@ void WindowCovering::SetInternalState(State new_state) {
                 StateStr(new_state), (int) state_, (int) new_state));
   state_ = new_state;
   begin_ = mgos_uptime_micros();
+  if (trace_ != nullptr) {
+    trace_->AddState(begin_, (int) new_state);
+    if (new_state == State::kIdle) trace_ = nullptr;
+  }
+  int tick_ms = GetTickIntervalMs(new_state);
+  if (tick_ms < 0) {
+    state_timer_.Clear();
+  } else {
+    state_timer_.Reset(tick_ms, (tick_ms > 0 ? MGOS_TIMER_REPEAT : 0));
+  }
 }
 
 void WindowCovering::SetCurPos(float new_cur_pos, float p) {
@@ -462,9 +595,7 @@ void WindowCovering::HAPSetTgtPos(float value) {
       }
     }
     last_hap_set_tgt_pos_ = mgos_uptime_micros();
-    if (state_ == State::kIdle) {
-      state_timer_.Reset(1, MGOS_TIMER_REPEAT);
-    }
+    RunOnce();
     return;
   }
 
@@ -527,6 +658,113 @@ void WindowCovering::Move(Direction dir) {
   }
 }
 
+void WindowCovering::StopMotor() {
+  if (moving_dir_ != Direction::kNone) {
+    auto pv = GetPowerW(moving_dir_);
+    coast_dir_ = moving_dir_;
+    // Only stops with the motor running tell anything about the latency,
+    // at the end stops it is already off.
+    coast_learn_ = (pv.ok() && pv.ValueOrDie() >= cfg_->idle_power_thr);
+    coast_start_pos_ = cur_pos_;
+    coast_ms_ = 0;
+    // The next measurement averages power since the previous one,
+    // part of which the motor was still driven.
+    const auto &m =
+        (moving_dir_ == Direction::kOpen ? pm_open_meas_ : pm_close_meas_);
+    coast_stop_ts_ = mgos_uptime_micros();
+    coast_last_ts_ = std::min(m.ts, coast_stop_ts_);
+  }
+  Move(Direction::kNone);
+}
+
+float WindowCovering::GetMsPerPct(Direction dir) const {
+  int move_time_ms = cfg_->move_time_ms;
+  if (dir == Direction::kOpen && cfg_->open_time_ms > 0) {
+    move_time_ms = cfg_->open_time_ms;
+  }
+  return move_time_ms / 100.0f;
+}
+
+float WindowCovering::GetCoastPct(Direction dir) const {
+  if (dir == Direction::kNone || cfg_->move_time_ms <= 0) return 0;
+  return cfg_->coast_ms / GetMsPerPct(dir);
+}
+
+WCPowerParams WindowCovering::GetPowerParams() const {
+  WCPowerParams pp;
+  pp.idle_power_thr = cfg_->idle_power_thr;
+  pp.move_power = cfg_->move_power;
+  pp.max_ramp_up_time_ms = cfg_->max_ramp_up_time_ms;
+  pp.obstruction_power_coeff = cfg_->obstruction_power_coeff;
+  pp.obstruction_duration_ms = cfg_->obstruction_duration_ms;
+  return pp;
+}
+
+void WindowCovering::BeginTrace(WCPowerTrace *trace, WCPowerTrace::Kind kind) {
+  trace->Begin(kind, GetPowerParams(), mgos_uptime_micros());
+  trace->AddState(trace->start(), (int) state_);
+  trace_ = trace;
+}
+
+WindowCovering::Direction WindowCovering::GetTraceDir() const {
+  switch (state_) {
+    case State::kCal0:
+    case State::kCal2:
+      return Direction::kOpen;
+    case State::kCal1:
+      return Direction::kClose;
+    case State::kStopping:
+      return coast_dir_;
+    default:
+      return moving_dir_;
+  }
+}
+
+StatusOr<float> WindowCovering::GetPowerW(Direction dir) const {
+  const auto &m = (dir == Direction::kOpen ? pm_open_meas_ : pm_close_meas_);
+  if (m.ts == 0 || mgos_uptime_micros() - m.ts > kMaxPMAgeMicros) {
+    return mgos::Errorf(STATUS_UNAVAILABLE, "no power data");
+  }
+  return m.power_w;
+}
+
+void WindowCovering::PMHandler(Direction dir,
+                               const PowerMeter::Measurement &m) {
+  (dir == Direction::kOpen ? pm_open_meas_ : pm_close_meas_) = m;
+  if (trace_ != nullptr && dir == GetTraceDir()) {
+    trace_->AddSample(m.ts, (int) state_, (int) dir, m.power_w);
+  }
+  // React to power changes as soon as they are measured,
+  // the tick is only a fallback.
+  switch (state_) {
+    case State::kCal0:
+    case State::kCal2:
+      if (dir == Direction::kOpen) RunOnce();
+      break;
+    case State::kCal1:
+      if (dir == Direction::kClose) {
+        p_sum_ += m.power_w;
+        p_num_++;
+        RunOnce();
+      }
+      break;
+    case State::kRampUp:
+      if (dir == moving_dir_) RunOnce();
+      break;
+    case State::kMoving:
+      if (dir == moving_dir_) {
+        move_stats_.Add(m.ts, m.power_w);
+        RunOnce();
+      }
+      break;
+    case State::kStopping:
+      RunOnce();
+      break;
+    default:
+      break;
+  }
+}
+
 void WindowCovering::RunOnce() {
   const char *ss = StateStr(state_);
   if (state_ != State::kIdle) {
@@ -550,6 +788,7 @@ void WindowCovering::RunOnce() {
       out_open_->SetState(false, ss);
       out_close_->SetState(false, ss);
       LOG(LL_INFO, ("Begin calibration"));
+      BeginTrace(&cal_trace_, WCPowerTrace::Kind::kCalibration);
       cfg_->calibrated = false;
       SaveState();
       out_open_->SetState(true, ss);
@@ -558,16 +797,16 @@ void WindowCovering::RunOnce() {
       break;
     }
     case State::kCal0: {
-      auto p0v = pm_open_->GetPowerW();
+      auto p0v = GetPowerW(Direction::kOpen);
       if (!p0v.ok()) {
         LOG(LL_ERROR, ("PM error"));
         SetInternalState(State::kError);
         break;
       }
       const float p0 = p0v.ValueOrDie();
+      int elapsed_ms = (mgos_uptime_micros() - begin_) / 1000;
       LOG_EVERY_N(LL_INFO, 8, ("WC %d: P0 = %.3f", id(), p0));
-      if (p0 < cfg_->idle_power_thr &&
-          (mgos_uptime_micros() - begin_ > cfg_->max_ramp_up_time_ms * 1000)) {
+      if (WCEndOfTravel(GetPowerParams(), p0, elapsed_ms)) {
         out_open_->SetState(false, ss);
         SetInternalState(State::kPostCal0);
       }
@@ -588,7 +827,7 @@ void WindowCovering::RunOnce() {
       break;
     }
     case State::kCal1: {
-      auto p1v = pm_close_->GetPowerW();
+      auto p1v = GetPowerW(Direction::kClose);
       if (!p1v.ok()) {
         LOG(LL_ERROR, ("PM error"));
         SetInternalState(State::kError);
@@ -597,27 +836,56 @@ void WindowCovering::RunOnce() {
       const float p1 = p1v.ValueOrDie();
       int move_time_ms = (mgos_uptime_micros() - begin_) / 1000;
       LOG_EVERY_N(LL_INFO, 8, ("WC %d: P1 = %.3f", id(), p1));
-      if (p1 < cfg_->idle_power_thr &&
-          move_time_ms > cfg_->max_ramp_up_time_ms) {
+      if (WCEndOfTravel(GetPowerParams(), p1, move_time_ms)) {
         out_close_->SetState(false, StateStr(state_));
-        float move_power = p_sum_ / p_num_;
+        float move_power = (p_num_ > 0 ? p_sum_ / p_num_ : 0);
         LOG(LL_INFO, ("WC %d: calibration done, move_time %d, move_power %.3f",
                       id(), move_time_ms, move_power));
         cfg_->move_time_ms = move_time_ms;
         cfg_->move_power = move_power;
-        move_ms_per_pct_ = cfg_->move_time_ms / 100.0;
         SetInternalState(State::kPostCal1);
-      } else {
-        p_sum_ += p1;
-        p_num_++;
       }
       break;
     }
     case State::kPostCal1: {
+      out_open_->SetState(false, ss);
+      out_close_->SetState(false, ss);
+      SetInternalState(State::kPreCal2);
+      break;
+    }
+    case State::kPreCal2: {
+      // Open all the way again to measure travel time in this direction,
+      // it is usually different due to gravity.
+      out_close_->SetState(false, ss);
+      out_open_->SetState(true, ss);
+      SetInternalState(State::kCal2);
+      break;
+    }
+    case State::kCal2: {
+      auto p0v = GetPowerW(Direction::kOpen);
+      if (!p0v.ok()) {
+        LOG(LL_ERROR, ("PM error"));
+        SetInternalState(State::kError);
+        break;
+      }
+      const float p0 = p0v.ValueOrDie();
+      int open_time_ms = (mgos_uptime_micros() - begin_) / 1000;
+      LOG_EVERY_N(LL_INFO, 8, ("WC %d: P0 = %.3f", id(), p0));
+      if (WCEndOfTravel(GetPowerParams(), p0, open_time_ms)) {
+        out_open_->SetState(false, ss);
+        LOG(LL_INFO, ("WC %d: open_time %d", id(), open_time_ms));
+        cfg_->open_time_ms = open_time_ms;
+        SetInternalState(State::kPostCal2);
+      }
+      break;
+    }
+    case State::kPostCal2: {
       cfg_->calibrated = true;
-      SetCurPos(kFullyClosed, -1);
+      // Coast is learned anew from regular movements.
+      cfg_->coast_ms = 0;
+      SetCurPos(kFullyOpen, -1);
       SaveState();
-      SetTgtPos((kFullyOpen - kFullyClosed) / 2, "postcal1");
+      SetTgtPos((kFullyOpen - kFullyClosed) / 2, "postcal2");
       SetInternalState(State::kIdle);
       break;
     }
@@ -633,15 +901,16 @@ void WindowCovering::RunOnce() {
         obstruction_detected_ = false;
         obst_char_->RaiseEvent();
       }
+      BeginTrace(&move_trace_, WCPowerTrace::Kind::kMove);
       move_start_pos_ = cur_pos_;
-      obstruction_begin_ = 0;
+      move_begin_ = mgos_uptime_micros();
+      move_stats_.Reset(GetPowerParams());
       Move(dir);
       SetInternalState(State::kRampUp);
       break;
     }
     case State::kRampUp: {
-      auto *pm = (moving_dir_ == Direction::kOpen ? pm_open_ : pm_close_);
-      auto pmv = pm->GetPowerW();
+      auto pmv = GetPowerW(moving_dir_);
       float p = -1;
       if (pmv.ok()) {
         p = pmv.ValueOrDie();
@@ -652,7 +921,7 @@ void WindowCovering::RunOnce() {
         break;
       }
       LOG(LL_INFO, ("P = %.2f -> %.2f", p, cfg_->move_power));
-      if (p >= cfg_->move_power * 0.75) {
+      if (WCRampUpDone(GetPowerParams(), p)) {
         SetInternalState(State::kMoving);
         break;
       }
@@ -666,13 +935,13 @@ void WindowCovering::RunOnce() {
     }
     case State::kMoving: {
       int64_t now = mgos_uptime_micros();
-      int moving_time_ms = (now - begin_) / 1000;
-      float pos_diff = moving_time_ms / move_ms_per_pct_;
+      // Motor has been running since it was turned on, including ramp up.
+      int moving_time_ms = (now - move_begin_) / 1000;
+      float pos_diff = moving_time_ms / GetMsPerPct(moving_dir_);
       float new_cur_pos =
           (moving_dir_ == Direction::kOpen ? move_start_pos_ + pos_diff
                                            : move_start_pos_ - pos_diff);
-      auto *pm = (moving_dir_ == Direction::kOpen ? pm_open_ : pm_close_);
-      auto pmv = pm->GetPowerW();
+      auto pmv = GetPowerW(moving_dir_);
       float p = -1;
       if (pmv.ok()) {
         p = pmv.ValueOrDie();
@@ -683,19 +952,17 @@ void WindowCovering::RunOnce() {
         break;
       }
       SetCurPos(new_cur_pos, p);
-      float too_much_power = cfg_->move_power * cfg_->obstruction_power_coeff;
+      // Power statistics are updated with each measurement, see PMHandler().
+      auto trip = move_stats_.trip();
       int too_long_time = cfg_->move_time_ms * cfg_->obstruction_time_coeff;
-      if (p > too_much_power) {
-        if (obstruction_begin_ == 0) obstruction_begin_ = now;
-      } else {
-        obstruction_begin_ = 0;
-      }
-      if ((p > too_much_power &&
-           (now - obstruction_begin_ > cfg_->obstruction_duration_ms * 1000)) ||
+      if (trip != WCPowerStats::Trip::kNone ||
           (p > cfg_->idle_power_thr && moving_time_ms > too_long_time)) {
         obstruction_detected_ = true;
         obst_char_->RaiseEvent();
-        LOG(LL_ERROR, ("Obstruction: p = %.2f t = %d", p, moving_time_ms));
+        LOG(LL_ERROR,
+            ("Obstruction (%s): p = %.2f ema %.2f sd %.2f slope %.2f t = %d",
+             WCPowerStats::TripStr(trip), p, move_stats_.ema(),
+             move_stats_.stddev(), move_stats_.slope(), moving_time_ms));
         tgt_state_ = State::kError;
         SetInternalState(State::kStop);
         break;
@@ -718,34 +985,72 @@ void WindowCovering::RunOnce() {
           SetCurPos(pos, p);
         }
       } else if (want_move_dir == moving_dir_) {
-        // Still moving.
-        break;
-      } else {
-        // We stoped moving. Reconcile target position with current,
-        // pretend we wanted to be exactly where we ended up.
-        if (std::abs(tgt_pos_ - cur_pos_) < 1) {
-          SetTgtPos(cur_pos_, "fixup");
+        // Issue the stop early, so that the motor coasts to the target.
+        float remaining_pct =
+            std::abs(tgt_pos_ - cur_pos_) - GetCoastPct(moving_dir_);
+        if (remaining_pct > 0) {
+          // Still moving. Wake up when it's time to stop, if that's sooner
+          // than the next tick.
+          int tick_ms = std::max(
+              1, (int) (remaining_pct * GetMsPerPct(moving_dir_)));
+          state_timer_.Reset(std::min(tick_ms, kFastTickMs),
+                             MGOS_TIMER_REPEAT);
+          break;
         }
       }
-      Move(Direction::kNone);  // Stop moving immediately to minimize error.
+      StopMotor();  // Stop moving immediately to minimize error.
       SetInternalState(State::kStop);
       break;
     }
     case State::kStop: {
-      Move(Direction::kNone);
-      SaveState();
+      StopMotor();
       SetInternalState(State::kStopping);
       break;
     }
     case State::kStopping: {
       float p0 = 0, p1 = 0;
-      auto p0v = pm_open_->GetPowerW();
+      auto p0v = GetPowerW(Direction::kOpen);
       if (p0v.ok()) p0 = p0v.ValueOrDie();
-      auto p1v = pm_close_->GetPowerW();
+      auto p1v = GetPowerW(Direction::kClose);
       if (p1v.ok()) p1 = p1v.ValueOrDie();
-      if (p0 < cfg_->idle_power_thr && p1 < cfg_->idle_power_thr) {
-        SetInternalState(State::kIdle);
+      if (coast_dir_ != Direction::kNone) {
+        const auto &m =
+            (coast_dir_ == Direction::kOpen ? pm_open_meas_ : pm_close_meas_);
+        if (m.ts > coast_last_ts_ && cfg_->move_power > 0) {
+          float speed = std::min(std::max(m.power_w / cfg_->move_power, 0.0f),
+                                 1.0f);
+          // Exclude the part before the stop, motor was at full speed then.
+          float driven_ms =
+              std::max(coast_stop_ts_ - coast_last_ts_, (int64_t) 0) / 1000.0f;
+          coast_ms_ += std::max(
+              speed * (m.ts - coast_last_ts_) / 1000.0f - driven_ms, 0.0f);
+          coast_last_ts_ = m.ts;
+          float pos_diff = coast_ms_ / GetMsPerPct(coast_dir_);
+          float new_cur_pos =
+              (coast_dir_ == Direction::kOpen ? coast_start_pos_ + pos_diff
+                                              : coast_start_pos_ - pos_diff);
+          SetCurPos(new_cur_pos, m.power_w);
+        }
+      }
+      if (p0 >= cfg_->idle_power_thr || p1 >= cfg_->idle_power_thr) break;
+      if (coast_dir_ != Direction::kNone) {
+        if (coast_learn_) {
+          cfg_->coast_ms = (cfg_->coast_ms == 0
+                                ? coast_ms_
+                                : cfg_->coast_ms * 0.75f + coast_ms_ * 0.25f);
+          LOG(LL_INFO, ("WC %d: stop latency %.0f ms, avg %d ms", id(),
+                        coast_ms_, cfg_->coast_ms));
+        }
+        coast_dir_ = Direction::kNone;
       }
+      // Reconcile target position with current, pretend we wanted to be
+      // exactly where we ended up if it's too close to move again.
+      float fixup_pct = 1 + GetCoastPct(last_move_dir_);
+      if (std::abs(tgt_pos_ - cur_pos_) < fixup_pct) {
+        SetTgtPos(cur_pos_, "fixup");
+      }
+      SaveState();
+      SetInternalState(State::kIdle);
       break;
     }
     case State::kError: {
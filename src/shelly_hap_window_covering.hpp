@@ -30,6 +30,7 @@
 #include "shelly_input.hpp"
 #include "shelly_output.hpp"
 #include "shelly_pm.hpp"
+#include "shelly_wc_trace.hpp"
 
 namespace shelly {
 namespace hap {
@@ -66,7 +67,14 @@ class WindowCovering : public Component, public mgos::hap::Service {
   Status SetState(const std::string &state_json) override;
   bool IsIdle() override;
 
+  // Power trace of the last calibration ("cal") or movement ("move"),
+  // up to limit entries from offset, with analysis on the first page.
+  StatusOr<std::string> GetTraceJSON(const std::string &kind, int offset,
+                                     int limit) const;
+
  private:
+  friend class SimAccess;  // Simulation harness, see tools/wc_sim.
+
   enum class State {
     kNone = -1,
     kIdle = 0,
@@ -77,6 +85,9 @@ class WindowCovering : public Component, public mgos::hap::Service {
     kPreCal1 = 13,
     kCal1 = 14,
     kPostCal1 = 15,
+    kPreCal2 = 16,
+    kCal2 = 17,
+    kPostCal2 = 18,
     // Movement states
     kMove = 20,
     kRampUp = 22,
@@ -99,9 +110,22 @@ class WindowCovering : public Component, public mgos::hap::Service {
   static constexpr int kOpenOutIdx = 0;
   static constexpr int kCloseOutIdx = 1;
 
+  static constexpr int kFastTickMs = 20;
+  static constexpr int kSlowTickMs = 100;
+
+  // Trace buffer sizes, entries. Calibration is 3 full passes, of up to
+  // 30 s each at the 5 Hz the ADE7953 is sampled at, plus state changes.
+  static constexpr int kCalTraceLen = 3 * 30 * 5 + 32;
+  static constexpr int kMoveTraceLen = 160;
+  // Entries per GetTraceJSON() page, ~2.5K of JSON.
+  static constexpr int kTracePageLen = 128;
+
   static float TrimPos(float pos);
 
   static const char *StateStr(State state);
+  // State machine tick interval: -1 - no tick, 0 - once, on the next
+  // event loop iteration, > 0 - periodic.
+  static int GetTickIntervalMs(State state);
 
   void SaveState();
 
@@ -113,9 +137,25 @@ class WindowCovering : public Component, public mgos::hap::Service {
 
   Direction GetDesiredMoveDirection();
   void Move(Direction dir);
+  // Turns the motor off, position keeps being tracked until the meter
+  // reads idle.
+  void StopMotor();
+  // Time it takes to move by 1% in the specified direction.
+  float GetMsPerPct(Direction dir) const;
+  // Distance the meter is expected to report after stopping, percent.
+  float GetCoastPct(Direction dir) const;
 
   void RunOnce();
 
+  WCPowerParams GetPowerParams() const;
+  void BeginTrace(WCPowerTrace *trace, WCPowerTrace::Kind kind);
+  // Direction whose power is traced in the current state.
+  Direction GetTraceDir() const;
+
+  // Latest power of the motor moving in the specified direction.
+  StatusOr<float> GetPowerW(Direction dir) const;
+  void PMHandler(Direction dir, const PowerMeter::Measurement &m);
+
   void HandleInputEvent01(Direction dir, Input::Event ev, bool state);
   void HandleInputEvent2(Input::Event ev, bool state);
   void HandleInputEventNotCalibrated();
@@ -128,6 +168,9 @@ class WindowCovering : public Component, public mgos::hap::Service {
 
   Input::HandlerID in_open_handler_ = Input::kInvalidHandlerID;
   Input::HandlerID in_close_handler_ = Input::kInvalidHandlerID;
+  PowerMeter::HandlerID pm_open_handler_ = PowerMeter::kInvalidHandlerID;
+  PowerMeter::HandlerID pm_close_handler_ = PowerMeter::kInvalidHandlerID;
+  PowerMeter::Measurement pm_open_meas_, pm_close_meas_;
 
   float cur_pos_ = kNotSet;
   float tgt_pos_ = kNotSet;
@@ -153,13 +196,28 @@ class WindowCovering : public Component, public mgos::hap::Service {
   float p_sum_ = 0;
   int64_t begin_ = 0;
   float move_start_pos_ = 0;
-  float move_ms_per_pct_ = 0;
+  int64_t move_begin_ = 0;
   bool obstruction_detected_ = false;
-  int64_t obstruction_begin_ = 0;
+  WCPowerStats move_stats_;  // Power during kMoving, for obstruction checks.
   int64_t last_hap_set_tgt_pos_ = 0;
   Direction moving_dir_ = Direction::kNone;
   Direction last_move_dir_ = Direction::kNone;
 
+  // Stop latency after StopMotor(): motor power relative to move power is
+  // integrated into the equivalent full speed travel time until the meter
+  // reads idle. That covers relay release and the meter's averaging window.
+  // Mechanical coast draws no power and is not seen.
+  Direction coast_dir_ = Direction::kNone;
+  bool coast_learn_ = false;  // Stopped mid-travel, update cfg_->coast_ms.
+  float coast_start_pos_ = 0;
+  float coast_ms_ = 0;
+  int64_t coast_stop_ts_ = 0;
+  int64_t coast_last_ts_ = 0;  // End of the last integrated measurement.
+
+  WCPowerTrace cal_trace_;
+  WCPowerTrace move_trace_;
+  WCPowerTrace *trace_ = nullptr;  // Being recorded, if any.
+
   ServiceType service_type_;
 };
 void CreateHAPWC(int id, Input *in1, Input *in2, Output *out1, Output *out2,
@@ -17,6 +17,10 @@
 
 #include "shelly_light_bulb_controller.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
 #include "shelly_cct_controller.hpp"
 #include "shelly_rgbw_controller.hpp"
 #include "shelly_white_controller.hpp"
@@ -47,61 +51,239 @@ bool LightBulbControllerBase::IsOff() const {
 }
 
 template <class T>
-void LightBulbController<T>::TransitionTimerCB() {
-  const auto &cur = transitions_.front();
-  int64_t elapsed = mgos_uptime_micros() - transition_start_;
+LightBulbController<T>::~LightBulbController() {
+  AnimationScheduler::Get()->Remove(this);
+}
+
+// static
+template <class T>
+typename LightBulbController<T>::Duty LightBulbController<T>::StateToDuty(
+    const T &state) {
+  Duty duty;
+  for (int i = 0; i < T::kNumChannels; i++) {
+    float v = std::min(std::max(state[i], 0.0f), 1.0f);
+    duty[i] = std::lround(v * kPWMSteps);
+  }
+  return duty;
+}
 
-  if (elapsed >= cur.transition_time_micros) {
-    LOG(LL_INFO,
-        ("Transition finished, end state: %s", state_now_.ToString().c_str()));
-    state_now_ = cur.state_end;
+// static
+template <class T>
+T LightBulbController<T>::DutyToState(const Duty &duty) {
+  T state{};
+  for (int i = 0; i < T::kNumChannels; i++) {
+    state[i] = static_cast<float>(duty[i]) / kPWMSteps;
+  }
+  return state;
+}
+
+template <class T>
+void LightBulbController<T>::TransitionCoords(const Duty &from, const Duty &to,
+                                              Duty *from_coords,
+                                              Duty *to_coords) {
+  *from_coords = from;
+  *to_coords = to;
+}
+
+template <class T>
+void LightBulbController<T>::CoordsToDuty(const Duty &coords,
+                                          Duty *duty) const {
+  *duty = coords;
+}
+
+template <class T>
+void LightBulbController<T>::ApplyEffect(const LightEffectFrame &f,
+                                         Duty *duty) const {
+  for (int &d : *duty) d = d * f.level / kEffectLevelMax;
+}
+
+template <class T>
+int64_t LightBulbController<T>::AnimationTick(int64_t now) {
+  int64_t next = (transitions_.empty() ? -1 : TransitionTick(now));
+  const int64_t frame = EffectTick(now);
+  if (frame >= 0 && (next < 0 || frame < next)) next = frame;
+  Duty duty = duty_now_;
+  if (effect_ != LightEffect::kNone) ApplyEffect(effect_frame_, &duty);
+  WritePWM(duty);
+  return next;
+}
+
+template <class T>
+int64_t LightBulbController<T>::TransitionTick(int64_t now) {
+  if (now - transition_start_ >= transitions_.front().transition_time_micros) {
+    duty_now_ = duty_end_;
+    LOG(LL_INFO, ("Transition finished, end state: %s",
+                  DutyToState(duty_now_).ToString().c_str()));
     transitions_.pop_front();
-    transition_timer_.Clear();
-    StartPendingTransitions();
+    if (transitions_.empty()) return -1;
+    BeginTransition(now);
+    return now;
+  }
+  return Interpolate(now);
+}
+
+template <class T>
+void LightBulbController<T>::UpdateEffect(int64_t now,
+                                          const struct mgos_config_lb &cfg) {
+  if (cfg.effect == effect_cfg_) return;
+  effect_cfg_ = cfg.effect;
+  const LightEffect effect = static_cast<LightEffect>(cfg.effect);
+  if (effect == LightEffect::kNone) {
+    mix_from_ = EffectMix(now);
+    mix_to_ = 0;
   } else {
-    float alpha = static_cast<float>(elapsed) /
-                  static_cast<float>(cur.transition_time_micros);
-    state_now_ = cur.state_end * alpha + state_start_ * (1 - alpha);
+    LOG(LL_INFO, ("Starting effect %d", cfg.effect));
+    effect_ = effect;
+    effect_start_ = now;
+    mix_from_ = (LightEffectLoops(effect) ? 0 : kEffectLevelMax);
+    mix_to_ = kEffectLevelMax;
+  }
+  fade_start_ = now;
+  fade_end_ = now + cfg.transition_time * 1000;
+}
+
+template <class T>
+int LightBulbController<T>::EffectMix(int64_t now) const {
+  if (effect_ == LightEffect::kNone) return 0;
+  if (now >= fade_end_) return mix_to_;
+  return mix_from_ + (mix_to_ - mix_from_) * (now - fade_start_) /
+                         (fade_end_ - fade_start_);
+}
+
+// Frames are evaluated at a fixed rate, whatever the transitions need, and
+// cost a table lookup each.
+template <class T>
+int64_t LightBulbController<T>::EffectTick(int64_t now) {
+  if (effect_ == LightEffect::kNone) return -1;
+  const int mix = EffectMix(now);
+  const LightEffectFrame f =
+      LightEffectEval(effect_, (now - effect_start_) / 1000,
+                      cfg_->effect_period, cfg_->effect_depth);
+  if (f.done || (mix == 0 && now >= fade_end_)) {
+    LOG(LL_INFO, ("Effect %d finished", (int) effect_));
+    // A one-shot effect that ran to the end is over in the config too, so
+    // it is reported as such and setting it again starts it again.
+    if (f.done && cfg_->effect == effect_cfg_) {
+      cfg_->effect = effect_cfg_ = (int) LightEffect::kNone;
+    }
+    effect_ = LightEffect::kNone;
+    effect_frame_ = {kEffectLevelMax, 0, false};
+    return -1;
   }
+  effect_frame_ = LightEffectMix(f, mix);
+  // Resumed by the transition that turns the light on.
+  if (IsOff() && transitions_.empty()) return -1;
+  const int64_t frame_us = kEffectFrameMs * 1000;
+  return effect_start_ + ((now - effect_start_) / frame_us + 1) * frame_us;
+}
 
-  UpdatePWM(state_now_);
+// Coordinates move linearly from start to end, one step at a time.
+// Instead of ticking at a fixed rate, the next tick is requested for when
+// the next step is due on any of them, so slow fades and unchanged channels
+// cost nothing.
+template <class T>
+int64_t LightBulbController<T>::Interpolate(int64_t now) {
+  const int64_t total = transitions_.front().transition_time_micros;
+  const int64_t elapsed = now - transition_start_;
+  if (elapsed >= total) {
+    duty_now_ = duty_end_;
+    return now;
+  }
+
+  int64_t next_us = total - elapsed;
+  for (int i = 0; i < T::kNumChannels; i++) {
+    const int delta = coords_end_[i] - coords_start_[i];
+    if (delta == 0) continue;
+    const int64_t span = std::abs(delta);
+    const int64_t steps = span * elapsed / total;
+    coords_now_[i] = coords_start_[i] + (delta > 0 ? steps : -steps);
+    // Time at which the coordinate will have moved by one more step.
+    const int64_t step_at = ((steps + 1) * total + span - 1) / span;
+    next_us = std::min(next_us, step_at - elapsed);
+  }
+  CoordsToDuty(coords_now_, &duty_now_);
+  return now + next_us;
+}
+
+template <class T>
+void LightBulbController<T>::WritePWM(const Duty &duty_in) {
+  const DimCurve curve = static_cast<DimCurve>(cfg_->dim_curve);
+  for (int i = 0; i < T::kNumChannels; i++) {
+    const int duty = DimCurveApply(curve, duty_in[i]);
+    if (duty == duty_out_[i]) continue;
+    outputs_.Stage(i, static_cast<float>(duty) / kDimCurveOut, "transition");
+    duty_out_[i] = duty;
+  }
+  outputs_.Commit();
 }
 
 template <class T>
 void LightBulbController<T>::UpdateOutputSpecialized(
     const struct mgos_config_lb &cfg, bool cancel_previous) {
+  const int64_t now = mgos_uptime_micros();
+  UpdateEffect(now, cfg);
+  Transition<T> t;
+  t.state_end = ConfigToState(cfg);
+  t.transition_time_micros = cfg.transition_time * 1000;
+
   if (cancel_previous) {
+    if (now < write_end_ && now - write_ts_ < kCoalesceMs * 1000) {
+      // Same scene change, end when the first write would have.
+      t.transition_time_micros = std::max(write_end_ - now, (int64_t) 0);
+    } else {
+      write_ts_ = now;
+      write_end_ = now + t.transition_time_micros;
+    }
+    if (!transitions_.empty()) {
+      RetargetTransition(now, t);
+      return;
+    }
     transitions_.clear();
   }
 
-  Transition<T> t;
-  t.state_end = ConfigToState(cfg);
-  t.transition_time_micros = cfg.transition_time * 1000;
-  transitions_.emplace_back(t);
+  transitions_.push_back(t);
 
   StartPendingTransitions();
 }
 
+template <class T>
+void LightBulbController<T>::RetargetTransition(int64_t now,
+                                                const Transition<T> &t) {
+  Interpolate(now);
+  transitions_.clear();
+  transitions_.push_back(t);
+  BeginTransition(now);
+  // Next tick right away: writes the current duty and reschedules.
+  AnimationScheduler::Get()->Add(this);
+}
+
 template <class T>
 void LightBulbController<T>::StartPendingTransitions() {
-  if (transition_timer_.IsValid() || transitions_.empty()) {
+  if (transitions_.size() != 1) {
     // already running or no further transitions queued
     return;
   }
 
-  const auto &cur = transitions_.front();
-  state_start_ = state_now_;
+  BeginTransition(mgos_uptime_micros());
+  // first tick computes when the next one is due
+  AnimationScheduler::Get()->Add(this);
+}
 
-  // restarting transition timer to fade
-  transition_start_ = mgos_uptime_micros();
-  transition_timer_.Reset(10, MGOS_TIMER_REPEAT);
+template <class T>
+void LightBulbController<T>::BeginTransition(int64_t now) {
+  const auto &cur = transitions_.front();
+  duty_end_ = StateToDuty(cur.state_end);
+  TransitionCoords(duty_now_, duty_end_, &coords_start_, &coords_end_);
+  coords_now_ = coords_start_;
+  const T state_start = DutyToState(duty_now_);
+  transition_start_ = now;
 
   LOG(LL_INFO,
       ("Starting transition: %s -> %s, %lld ms",
-       state_start_.ToString().c_str(), cur.state_end.ToString().c_str(),
+       state_start.ToString().c_str(), cur.state_end.ToString().c_str(),
        (long long) cur.transition_time_micros / 1000));
 
-  ReportTransition(cur.state_end, state_start_);
+  ReportTransition(cur.state_end, state_start);
 }
 
 template class LightBulbController<StateW>;
@@ -17,13 +17,16 @@
 
 #pragma once
 
-#include <deque>
+#include <array>
 #include <functional>
 
 #include "mgos_sys_config.h"
-#include "mgos_timers.hpp"
 
+#include "shelly_animation_scheduler.hpp"
 #include "shelly_common.hpp"
+#include "shelly_dim_curve.hpp"
+#include "shelly_light_effect.hpp"
+#include "shelly_output.hpp"
 
 namespace shelly {
 
@@ -50,6 +53,13 @@ class LightBulbControllerBase {
   bool IsOn() const;
   bool IsOff() const;
 
+  // Resolution of brightness during transitions, in steps of full scale.
+  // Mapped to PWM duty by the dimming curve on output.
+  static constexpr int kPWMSteps = kDimCurveIn;
+  // Writes that cancel the previous ones within this time of the first are
+  // coalesced into one transition, e.g. HAP setting on, brightness and hue.
+  static constexpr int kCoalesceMs = 100;
+
  protected:
   struct mgos_config_lb *cfg_;
   const UpdateFn update_;
@@ -61,33 +71,131 @@ struct Transition {
   int64_t transition_time_micros = 0;
 };
 
+// Fixed capacity FIFO of transitions, front is the one running.
 template <class T>
-class LightBulbController : public LightBulbControllerBase {
+class TransitionQueue {
  public:
-  LightBulbController(struct mgos_config_lb *cfg)
+  static constexpr int kCapacity = 8;
+
+  bool empty() const {
+    return size_ == 0;
+  }
+  int size() const {
+    return size_;
+  }
+  Transition<T> &front() {
+    return items_[head_];
+  }
+  // If full, the last transition is replaced.
+  void push_back(const Transition<T> &t) {
+    if (size_ == kCapacity) size_--;
+    items_[(head_ + size_) % kCapacity] = t;
+    size_++;
+  }
+  void pop_front() {
+    head_ = (head_ + 1) % kCapacity;
+    size_--;
+  }
+  void clear() {
+    head_ = size_ = 0;
+  }
+
+ private:
+  std::array<Transition<T>, kCapacity> items_;
+  int head_ = 0;
+  int size_ = 0;
+};
+
+template <class T>
+class LightBulbController : public LightBulbControllerBase,
+                            public AnimationScheduler::Client {
+ public:
+  // Outputs of the channels, in order.
+  LightBulbController(struct mgos_config_lb *cfg,
+                      const std::vector<Output *> &outs)
       : LightBulbControllerBase(
             cfg, std::bind(&LightBulbController<T>::UpdateOutputSpecialized,
                            this, _1, _2)),
-        transition_timer_(
-            std::bind(&LightBulbController<T>::TransitionTimerCB, this)) {
+        outputs_(outs) {
+    duty_out_.fill(-1);
   }
   LightBulbController(const LightBulbControllerBase &other) = delete;
+  virtual ~LightBulbController();
+
+ protected:
+  // Duty of each channel, in PWM steps. Also used for coordinates of the
+  // space transitions are interpolated in.
+  typedef std::array<int, T::kNumChannels> Duty;
+
+  // Transitions are linear in a space of kNumChannels coordinates, by
+  // default the channel duty itself. Returns coordinates of a transition
+  // from one duty to another.
+  virtual void TransitionCoords(const Duty &from, const Duty &to,
+                                Duty *from_coords, Duty *to_coords);
+  virtual void CoordsToDuty(const Duty &coords, Duty *duty) const;
+  // Applies an effect frame to the output duty. By default only the level,
+  // which scales all channels.
+  virtual void ApplyEffect(const LightEffectFrame &f, Duty *duty) const;
 
  private:
-  mgos::Timer transition_timer_;
   int64_t transition_start_ = 0;
-
-  T state_start_{};
-  T state_now_{};
-
-  std::deque<Transition<T>> transitions_;
+  // First of the coalesced writes and when its transition is due to end.
+  int64_t write_ts_ = 0;
+  int64_t write_end_ = 0;
+
+  Duty coords_start_{};
+  Duty coords_end_{};
+  Duty coords_now_{};
+  Duty duty_end_{};
+  Duty duty_now_{};
+  // As last written to the outputs, after the dimming curve, in
+  // 1/kDimCurveOut. -1 - not written yet.
+  Duty duty_out_;
+  OutputGroup outputs_;
+
+  TransitionQueue<T> transitions_;
+
+  // Running effect, or the one fading out.
+  LightEffect effect_ = LightEffect::kNone;
+  // lb.effect the last effect was started for.
+  int effect_cfg_ = 0;
+  int64_t effect_start_ = 0;
+  LightEffectFrame effect_frame_{kEffectLevelMax, 0, false};
+  // Share of the effect in the output, kEffectLevelMax - all of it.
+  // Ramps from mix_from_ to mix_to_ between fade_start_ and fade_end_.
+  int mix_from_ = 0;
+  int mix_to_ = 0;
+  int64_t fade_start_ = 0;
+  int64_t fade_end_ = 0;
 
   virtual T ConfigToState(const struct mgos_config_lb &cfg) const = 0;
   virtual void ReportTransition(const T &next, const T &prev) = 0;
-  virtual void UpdatePWM(const T &state) = 0;
+
+  static Duty StateToDuty(const T &state);
+  static T DutyToState(const Duty &duty);
 
   void StartPendingTransitions();
-  void TransitionTimerCB();
+  void BeginTransition(int64_t now);
+  // Replaces the running and queued transitions with t, starting from the
+  // current duty.
+  void RetargetTransition(int64_t now, const Transition<T> &t);
+  // Interpolates duty_now_ of the running transition, returns when the next
+  // step is due.
+  int64_t Interpolate(int64_t now);
+  // Advances the transitions, returns when the next tick is due, -1 if there
+  // are none left.
+  int64_t TransitionTick(int64_t now);
+  // Starts the effect selected by cfg if it has changed, or fades out the
+  // running one.
+  void UpdateEffect(int64_t now, const struct mgos_config_lb &cfg);
+  int EffectMix(int64_t now) const;
+  // Evaluates effect_frame_, returns when the next frame is due, -1 if the
+  // effect is over or there is nothing to show.
+  int64_t EffectTick(int64_t now);
+  // AnimationScheduler::Client interface impl.
+  int64_t AnimationTick(int64_t now) override;
+  // Writes the channels whose output duty has changed, all at once.
+  void WritePWM(const Duty &duty);
   void UpdateOutputSpecialized(const struct mgos_config_lb &cfg,
                                bool cancel_previous);
 };
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shelly_light_effect.hpp"
+
+#include <algorithm>
+
+#include "shelly_color.hpp"
+
+namespace shelly {
+
+namespace {
+
+// Waveforms, 0 - lowest level, 255 - full.
+
+// Breathing: exp(-cos(2 * pi * x)), normalized.
+const uint8_t kBreatheTable[] = {
+    0,   0,   1,   2,   3,   5,   7,   10,  14,  18,  22,  28,  34,
+    41,  49,  58,  69,  80,  92,  105, 119, 134, 149, 165, 180, 195,
+    209, 222, 233, 243, 249, 254, 255, 254, 249, 243, 233, 222, 209,
+    195, 180, 165, 149, 134, 119, 105, 92,  80,  69,  58,  49,  41,
+    34,  28,  22,  18,  14,  10,  7,   5,   3,   2,   1,   0,
+};
+
+// Candle: low-pass filtered pseudo-random flicker with occasional gusts.
+const uint8_t kCandleTable[] = {
+    152, 143, 165, 172, 157, 161, 213, 244, 217, 212, 240, 245, 221,
+    188, 134, 111, 145, 165, 172, 220, 242, 185, 152, 197, 249, 220,
+    142, 124, 175, 124, 28,  100, 98,  0,   85,  204, 120, 22,  139,
+    245, 127, 25,  117, 177, 202, 255, 230, 152, 117, 134, 142, 163,
+    186, 178, 173, 171, 180, 166, 156, 185, 182, 192, 224, 200,
+};
+
+// Sunrise: smoothstep, the last entry is the end.
+const uint8_t kSunriseTable[] = {
+    0,   1,   3,   6,   11,  17,  24,  31,  40,  49,  59,
+    70,  81,  92,  104, 116, 128, 139, 151, 163, 174, 185,
+    196, 206, 215, 224, 231, 238, 244, 249, 252, 254, 255,
+};
+
+struct EffectDesc {
+  const uint8_t *table;  // nullptr - level is not modulated.
+  int table_size;
+  bool loop;
+  bool depth;  // Modulation depth is configurable, otherwise full.
+  bool hue;    // Hue goes round once per period.
+};
+
+#define TABLE(t) t, (int) (sizeof(t) / sizeof(t[0]))
+
+const EffectDesc kEffects[] = {
+    {nullptr, 0, true, false, false},             // kNone
+    {TABLE(kBreatheTable), true, true, false},    // kBreathe
+    {TABLE(kCandleTable), true, true, false},     // kCandle
+    {nullptr, 0, true, false, true},              // kColorLoop
+    {TABLE(kSunriseTable), false, false, false},  // kSunrise
+};
+
+#undef TABLE
+
+static_assert(sizeof(kEffects) / sizeof(kEffects[0]) == (int) LightEffect::kMax,
+              "effect table must match LightEffect");
+
+}  // namespace
+
+LightEffectFrame LightEffectEval(LightEffect effect, int64_t t_ms,
+                                 int period_ms, int depth) {
+  LightEffectFrame f = {kEffectLevelMax, 0, false};
+  if (effect <= LightEffect::kNone || effect >= LightEffect::kMax) return f;
+  const EffectDesc &d = kEffects[(int) effect];
+  period_ms = std::max(period_ms, 1);
+  int64_t pos;
+  if (d.loop) {
+    pos = t_ms % period_ms;
+  } else if (t_ms >= period_ms) {
+    f.done = true;
+    return f;
+  } else {
+    pos = t_ms;
+  }
+  if (d.hue) {
+    const int h = pos * kHueMax / period_ms;
+    f.hue_shift = (h > kHueMax / 2 ? h - kHueMax : h);
+  }
+  if (d.table != nullptr) {
+    // Position in the table, 8 fractional bits. One-shot tables end on the
+    // last entry, looping ones wrap around to the first.
+    const int num_segments = d.table_size - (d.loop ? 0 : 1);
+    const int64_t x = (pos << 8) * num_segments / period_ms;
+    const int i = x >> 8, frac = x & 0xff;
+    const int a = d.table[i], b = d.table[(i + 1) % d.table_size];
+    const int sample = (a * (256 - frac) + b * frac) >> 8;
+    const int range =
+        (d.depth ? std::min(std::max(depth, 0), 100) * kEffectLevelMax / 100
+                 : kEffectLevelMax);
+    f.level = kEffectLevelMax - range * (255 - sample) / 255;
+  }
+  return f;
+}
+
+LightEffectFrame LightEffectMix(const LightEffectFrame &f, int mix) {
+  LightEffectFrame res = f;
+  res.level =
+      kEffectLevelMax - (kEffectLevelMax - f.level) * mix / kEffectLevelMax;
+  res.hue_shift = f.hue_shift * mix / kEffectLevelMax;
+  return res;
+}
+
+bool LightEffectLoops(LightEffect effect) {
+  if (effect <= LightEffect::kNone || effect >= LightEffect::kMax) return true;
+  return kEffects[(int) effect].loop;
+}
+
+}  // namespace shelly
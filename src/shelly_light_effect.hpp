@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+// NB: This file is also built on the host by tools/light_bench,
+// it must not depend on Mongoose OS.
+
+namespace shelly {
+
+// On-device light effects, played by LightBulbController on top of its
+// transitions. Effects are waveform tables evaluated in fixed point.
+// NB: Keep in sync with lb.effect in mos.yml.
+enum class LightEffect {
+  kNone = 0,
+  kBreathe = 1,
+  kCandle = 2,
+  kColorLoop = 3,  // Colour bulbs only.
+  kSunrise = 4,    // One-shot, over one period.
+  kMax,
+};
+
+// Effects are played at a steady frame rate, 50 fps.
+static constexpr int kEffectFrameMs = 20;
+static constexpr int kEffectLevelMax = 1024;
+
+struct LightEffectFrame {
+  // Scale of the channel duty, [0; kEffectLevelMax].
+  int level;
+  // Added to the hue, (-kHueMax / 2; kHueMax / 2].
+  int hue_shift;
+  // A one-shot effect has finished, the frame is that of no effect.
+  bool done;
+};
+
+// Frame of the effect t_ms into it. period_ms is that of one cycle, or the
+// duration of a one-shot effect. depth is the level modulation of breathe
+// and candle, in % of brightness.
+LightEffectFrame LightEffectEval(LightEffect effect, int64_t t_ms,
+                                 int period_ms, int depth);
+
+// Blends the frame with no effect, mix in [0; kEffectLevelMax].
+LightEffectFrame LightEffectMix(const LightEffectFrame &f, int mix);
+
+// Looping effects fade in and out, one-shot ones start right away.
+bool LightEffectLoops(LightEffect effect);
+
+}  // namespace shelly
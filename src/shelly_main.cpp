@@ -55,6 +55,7 @@
 #include "shelly_input.hpp"
 #include "shelly_ota.hpp"
 #include "shelly_output.hpp"
+#include "shelly_pm_journal.hpp"
 #include "shelly_rpc_service.hpp"
 #include "shelly_switch.hpp"
 #include "shelly_sys_led_btn.hpp"
@@ -116,6 +117,8 @@ static uint8_t s_service_flags = 0;
 static std::vector<std::unique_ptr<Input>> s_inputs;
 static std::vector<std::unique_ptr<Output>> s_outputs;
 static std::vector<std::unique_ptr<PowerMeter>> s_pms;
+static std::unique_ptr<PMEnergyJournal> s_pm_journal;
+static std::vector<std::unique_ptr<PMHistory>> s_pm_hist;
 static std::vector<std::unique_ptr<mgos::hap::Accessory>> s_accs;
 static std::vector<const HAPAccessory *> s_hap_accs;
 static std::unique_ptr<TempSensor> s_sys_temp_sensor;
@@ -167,6 +170,16 @@ Output *FindOutput(int id) {
 PowerMeter *FindPM(int id) {
   return FindById(s_pms, id);
 }
+PMHistory *FindPMHistory(int pm_id) {
+  for (auto &h : s_pm_hist) {
+    if (h->pm()->id() == pm_id) return h.get();
+  }
+  return nullptr;
+}
+
+static std::string PMHistoryFileName(int pm_id) {
+  return mgos::SPrintf(PM_HISTORY_FILE_NAME_FMT, pm_id);
+}
 
 void CreateHAPSensors(std::vector<std::unique_ptr<TempSensor>> *sensors,
                       std::vector<std::unique_ptr<Component>> *comps,
@@ -263,6 +276,9 @@ void CreateHAPSwitch(int id, const struct mgos_config_sw *sw_cfg,
     sw2->set_primary(true);
     pri_acc->SetCategory(cat);
     pri_acc->AddService(sw2);
+    if (sw2->GetEveHistoryService() != nullptr) {
+      pri_acc->AddService(sw2->GetEveHistoryService());
+    }
     // This was requested in
     // https://github.com/mongoose-os-apps/shelly-homekit/issues/237 however,
     // without https://github.com/mongoose-os-libs/dns-sd/issues/5 it causes
@@ -278,6 +294,9 @@ void CreateHAPSwitch(int id, const struct mgos_config_sw *sw_cfg,
                                  sw_cfg->name, GetIdentifyCB(), svr));
     acc->AddHAPService(&mgos_hap_accessory_information_service);
     acc->AddService(sw2);
+    if (sw2->GetEveHistoryService() != nullptr) {
+      acc->AddService(sw2->GetEveHistoryService());
+    }
     accs->push_back(std::move(acc));
   }
   if (sw_cfg->in_mode == (int) InMode::kDetached) {
@@ -629,6 +648,15 @@ static void RebootCB(int ev, void *ev_data, void *userdata) {
       LOG(LL_ERROR, ("Failed to increment CN"));
     }
   }
+  if (ev == MGOS_EVENT_REBOOT && s_pm_journal != nullptr) {
+    s_pm_journal->Commit(true /* force */);
+  }
+  if (ev == MGOS_EVENT_REBOOT &&
+      mgos_sys_config_get_shelly_pm_history_persist()) {
+    for (const auto &h : s_pm_hist) {
+      h->Save(PMHistoryFileName(h->pm()->id()));
+    }
+  }
   (void) ev;
   (void) ev_data;
   (void) userdata;
@@ -843,6 +871,17 @@ void InitApp() {
 
   LOG(LL_INFO, ("=== Creating peripherals"));
   CreatePeripherals(&s_inputs, &s_outputs, &s_pms, &s_sys_temp_sensor);
+  if (!s_pms.empty()) {
+    s_pm_journal.reset(new PMEnergyJournal(PM_JOURNAL_FILE_NAME, &s_pms));
+    s_pm_journal->Restore();
+  }
+  for (auto &pm : s_pms) {
+    std::unique_ptr<PMHistory> h(new PMHistory(pm.get()));
+    if (mgos_sys_config_get_shelly_pm_history_persist()) {
+      h->Load(PMHistoryFileName(pm->id()));
+    }
+    s_pm_hist.emplace_back(std::move(h));
+  }
   if (s_sys_temp_sensor) {
     Status st = s_sys_temp_sensor->Init();
     if (!st.ok()) {
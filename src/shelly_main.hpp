@@ -28,6 +28,7 @@
 #include "shelly_input.hpp"
 #include "shelly_output.hpp"
 #include "shelly_pm.hpp"
+#include "shelly_pm_history.hpp"
 #include "shelly_reset.hpp"
 #include "shelly_temp_sensor.hpp"
 
@@ -35,6 +36,8 @@
 #define AUTH_FILE_NAME "passwd256"
 #define ACL_FILE_NAME "rpc_acl.json"
 #define KVS_FILE_NAME "kvs.json"
+#define PM_JOURNAL_FILE_NAME "pm_energy.jnl"
+#define PM_HISTORY_FILE_NAME_FMT "pm_hist_%d.bin"
 
 namespace shelly {
 
@@ -45,6 +48,7 @@ void RestoreUART();
 Input *FindInput(int id);
 Output *FindOutput(int id);
 PowerMeter *FindPM(int id);
+PMHistory *FindPMHistory(int pm_id);
 
 void CreateHAPSensors(std::vector<std::unique_ptr<TempSensor>> *sensors,
                       std::vector<std::unique_ptr<Component>> *comps,
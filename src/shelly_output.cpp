@@ -17,8 +17,11 @@
 
 #include "shelly_output.hpp"
 
+#include <cmath>
+
 #include "mgos.hpp"
 #include "mgos_gpio.h"
+#include "mgos_system.h"
 
 #if CS_PLATFORM != CS_P_ESP8266
 #include "driver/gpio.h"
@@ -28,8 +31,48 @@
 #include "mgos_pwm.h"
 #endif
 
+#if CS_PLATFORM == CS_P_ESP32 && defined(MGOS_HAVE_PWM)
+#define SHELLY_PWM_LEDC 1
+#include "driver/ledc.h"
+#endif
+
 namespace shelly {
 
+static constexpr int kPWMFreq = 400;
+
+#ifdef SHELLY_PWM_LEDC
+// OutputPin drives the LEDC itself rather than through mgos_pwm_set(),
+// which writes duty and applies it in one go. Channels and the timer are
+// taken from the top, mgos_pwm_set() allocates from the bottom.
+static constexpr ledc_mode_t kLEDCMode = LEDC_HIGH_SPEED_MODE;
+static constexpr ledc_timer_t kLEDCTimer = LEDC_TIMER_3;
+static constexpr int kLEDCBits = 13;
+static int s_ledc_next_ch = LEDC_CHANNEL_MAX - 1;
+
+// Returns the channel, -1 if none is left.
+static int LEDCSetup(int pin) {
+  static bool s_timer_ok = false;
+  if (!s_timer_ok) {
+    ledc_timer_config_t tc = {};
+    tc.speed_mode = kLEDCMode;
+    tc.duty_resolution = (ledc_timer_bit_t) kLEDCBits;
+    tc.timer_num = kLEDCTimer;
+    tc.freq_hz = kPWMFreq;
+    if (ledc_timer_config(&tc) != ESP_OK) return -1;
+    s_timer_ok = true;
+  }
+  if (s_ledc_next_ch < 0) return -1;
+  ledc_channel_config_t cc = {};
+  cc.gpio_num = pin;
+  cc.speed_mode = kLEDCMode;
+  cc.channel = (ledc_channel_t) s_ledc_next_ch;
+  cc.timer_sel = kLEDCTimer;
+  cc.duty = 0;
+  if (ledc_channel_config(&cc) != ESP_OK) return -1;
+  return s_ledc_next_ch--;
+}
+#endif
+
 Output::Output(int id) : id_(id) {
 }
 
@@ -40,6 +83,56 @@ int Output::id() const {
   return id_;
 }
 
+Status Output::StagePWM(float duty, const char *source) {
+  staged_duty_ = duty;
+  staged_source_ = source;
+  return Status::OK();
+}
+
+void Output::LatchPWM() {
+  if (staged_duty_ < 0) return;
+  SetStatePWM(staged_duty_, staged_source_);
+  staged_duty_ = -1;
+}
+
+void Output::HoldPWM(bool hold) {
+  (void) hold;
+}
+
+OutputGroup::OutputGroup(const std::vector<Output *> &outs) : outs_(outs) {
+}
+
+int OutputGroup::size() const {
+  return outs_.size();
+}
+
+Output *OutputGroup::out(int i) const {
+  return outs_[i];
+}
+
+Status OutputGroup::Stage(int i, float duty, const char *source) {
+  if (outs_[i] == nullptr) return Status::OK();
+  Status st = outs_[i]->StagePWM(duty, source);
+  if (st.ok()) staged_ |= (1 << i);
+  return st;
+}
+
+void OutputGroup::Commit() {
+  if (staged_ == 0) return;
+  mgos_ints_disable();
+  for (int i = 0; i < (int) outs_.size(); i++) {
+    if (staged_ & (1 << i)) outs_[i]->HoldPWM(true);
+  }
+  for (int i = 0; i < (int) outs_.size(); i++) {
+    if (staged_ & (1 << i)) outs_[i]->LatchPWM();
+  }
+  for (int i = 0; i < (int) outs_.size(); i++) {
+    if (staged_ & (1 << i)) outs_[i]->HoldPWM(false);
+  }
+  mgos_ints_enable();
+  staged_ = 0;
+}
+
 OutputPin::OutputPin(int id, int pin, int on_value)
     : Output(id),
       pin_(pin),
@@ -69,7 +162,12 @@ int OutputPin::pin() const {
 
 Status OutputPin::SetState(bool on, const char *source) {
   bool cur_state = GetState();
-  mgos_gpio_write(pin_, ((on ^ out_invert_) ? on_value_ : !on_value_));
+  const bool level = ((on ^ out_invert_) ? on_value_ : !on_value_);
+  mgos_gpio_write(pin_, level);
+#ifdef SHELLY_PWM_LEDC
+  // Once set up, the LEDC drives the pin.
+  if (ledc_ch_ >= 0) ledc_stop(kLEDCMode, (ledc_channel_t) ledc_ch_, level);
+#endif
   pulse_active_ = false;
   if (on == cur_state) return Status::OK();
   if (source == nullptr) source = "";
@@ -79,27 +177,70 @@ Status OutputPin::SetState(bool on, const char *source) {
 }
 
 Status OutputPin::SetStatePWM(float duty, const char *source) {
+  Status st = StagePWM(duty, source);
+  if (st.ok()) LatchPWM();
+  return st;
+}
+
+Status OutputPin::StagePWM(float duty, const char *source) {
 #ifdef MGOS_HAVE_PWM
-  LOG(LL_INFO, ("Duty: %.3f", duty));
+  if (source == nullptr) source = "";
+  // Every frame of transitions and effects, up to 50 per second.
+  LOG(LL_DEBUG, ("Output %d: %.3f (%s)", id(), duty, source));
+#ifdef SHELLY_PWM_LEDC
+  if (ledc_ch_ < 0) ledc_ch_ = LEDCSetup(pin_);
+  if (ledc_ch_ < 0) {
+    return mgos::Errorf(STATUS_UNAVAILABLE, "No LEDC channel for pin %d",
+                        pin_);
+  }
+  // Output from the first period after ledc_update_duty().
+  ledc_set_duty(kLEDCMode, (ledc_channel_t) ledc_ch_,
+                std::lround(duty * (1 << kLEDCBits)));
+#endif
+  staged_duty_ = duty;
+  return Status::OK();
+#else
+  (void) duty;
+  (void) source;
+  return Status::UNIMPLEMENTED();
+#endif
+}
+
+void OutputPin::LatchPWM() {
+#ifdef MGOS_HAVE_PWM
+  if (staged_duty_ < 0) return;
+  const float duty = staged_duty_;
+  staged_duty_ = -1;
+#ifdef SHELLY_PWM_LEDC
+  (void) duty;
+  ledc_update_duty(kLEDCMode, (ledc_channel_t) ledc_ch_);
+#else
   if (duty == 0) {
     mgos_pwm_set(pin_, 0, 0);
   }
 #if CS_PLATFORM == CS_P_ESP8266
   else if (duty == 1) {
     mgos_gpio_write(pin_, 1);
-    LOG(LL_INFO,
-        ("Output %d: %s (%s)", id(), (duty == 0 ? "OFF" : "ON"), source));
   }
 #endif
   else {
-    mgos_pwm_set(pin_, 400, duty);
-    LOG(LL_INFO, ("Output %d: %f (%s)", id(), duty, source));
+    mgos_pwm_set(pin_, kPWMFreq, duty);
+  }
+#endif
+#endif
+}
+
+void OutputPin::HoldPWM(bool hold) {
+#ifdef SHELLY_PWM_LEDC
+  if (ledc_ch_ < 0) return;
+  // The timer is shared, the first release resumes it.
+  if (hold) {
+    ledc_timer_pause(kLEDCMode, kLEDCTimer);
+  } else {
+    ledc_timer_resume(kLEDCMode, kLEDCTimer);
   }
-  return Status::OK();
 #else
-  (void) duty;
-  (void) source;
-  return Status::UNIMPLEMENTED();
+  (void) hold;
 #endif
 }
 
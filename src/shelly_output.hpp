@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include "shelly_common.hpp"
 
 #include "mgos_timers.hpp"
@@ -35,11 +37,47 @@ class Output {
   virtual Status Pulse(bool on, int duration_ms, const char *source) = 0;
   virtual void SetInvert(bool out_invert) = 0;
 
+  // Two phase PWM update, see OutputGroup. StagePWM() prepares the duty and
+  // LatchPWM() applies it, it must be quick and must not log.
+  // By default latching is SetStatePWM().
+  virtual Status StagePWM(float duty, const char *source);
+  virtual void LatchPWM();
+  // While held, no new PWM period starts and latched duty waits for the
+  // release. Only where the hardware can do it, by default a no-op.
+  virtual void HoldPWM(bool hold);
+
+ protected:
+  float staged_duty_ = -1;  // -1 - nothing staged.
+  const char *staged_source_ = nullptr;
+
  private:
   const int id_;
   Output(const Output &other) = delete;
 };
 
+// Outputs whose duty changes together, e.g. channels of a light.
+// Values are staged and then latched in one go by Commit(), so that no PWM
+// period shows a mix of old and new ones. Latching is done with interrupts
+// disabled: on ESP8266 that keeps the PWM interrupt from starting a period
+// halfway. On ESP32 duty is written to the LEDC when staged, latching only
+// sets the update bits, and the outputs are held meanwhile, which pauses
+// the LEDC timer so that its period cannot end between two of them.
+class OutputGroup {
+ public:
+  // nullptr entries are allowed and ignored.
+  explicit OutputGroup(const std::vector<Output *> &outs);
+
+  int size() const;
+  Output *out(int i) const;
+
+  Status Stage(int i, float duty, const char *source);
+  void Commit();
+
+ private:
+  const std::vector<Output *> outs_;
+  uint32_t staged_ = 0;  // Bit per output.
+};
+
 class OutputPin : public Output {
  public:
   OutputPin(int id, int pin, int on_value);
@@ -52,6 +90,9 @@ class OutputPin : public Output {
   Status Pulse(bool on, int duration_ms, const char *source) override;
   int pin() const;
   void SetInvert(bool out_invert) override;
+  Status StagePWM(float duty, const char *source) override;
+  void LatchPWM() override;
+  void HoldPWM(bool hold) override;
 
  protected:
   bool out_invert_ = false;
@@ -64,6 +105,7 @@ class OutputPin : public Output {
 
   bool pulse_active_ = false;
   mgos::Timer pulse_timer_;
+  int ledc_ch_ = -1;  // ESP32: LEDC channel, -1 - not set up yet.
 
   OutputPin(const OutputPin &other) = delete;
 };
@@ -17,6 +17,10 @@
 
 #include "shelly_pm.hpp"
 
+#include "mgos.hpp"
+
+#include "shelly_pm_protection.hpp"
+
 namespace shelly {
 
 PowerMeter::PowerMeter(int id) : id_(id) {
@@ -29,4 +33,118 @@ int PowerMeter::id() const {
   return id_;
 }
 
+StatusOr<PowerMeter::Measurement> PowerMeter::GetMeasurement() {
+  return meas_;
+}
+
+StatusOr<float> PowerMeter::GetPowerW() {
+  auto mv = GetMeasurement();
+  if (!mv.ok()) return mv.status();
+  return mv.ValueOrDie().power_w;
+}
+
+StatusOr<float> PowerMeter::GetEnergyWH() {
+  auto mv = GetMeasurement();
+  if (!mv.ok()) return mv.status();
+  return mv.ValueOrDie().energy_wh;
+}
+
+const PowerMeter::Measurement &PowerMeter::SetMeasurement(
+    const Measurement &m) {
+  uint32_t seq = meas_.seq + 1;
+  meas_ = m;
+  meas_.seq = seq;
+  meas_.ts = mgos_uptime_micros();
+  if (protection_ != nullptr) protection_->Check(meas_);
+  CallHandlers();
+  return meas_;
+}
+
+PowerMeter::HandlerID PowerMeter::AddHandler(HandlerFn h,
+                                             const HandlerOpts &opts) {
+  Handler hh;
+  hh.fn = h;
+  hh.opts = opts;
+  int i;
+  for (i = 0; i < (int) handlers_.size(); i++) {
+    if (handlers_[i].fn == nullptr) {
+      handlers_[i] = hh;
+      return i;
+    }
+  }
+  handlers_.push_back(hh);
+  return i;
+}
+
+void PowerMeter::RemoveHandler(HandlerID hi) {
+  if (hi < 0 || hi >= (int) handlers_.size()) return;
+  handlers_[hi].fn = nullptr;
+}
+
+void PowerMeter::CallHandlers() {
+  // Handlers may add more handlers, don't use iterators.
+  for (size_t i = 0; i < handlers_.size(); i++) {
+    Handler &h = handlers_[i];
+    if (h.fn == nullptr) continue;
+    const HandlerOpts &o = h.opts;
+    if (h.last.ts != 0) {
+      int64_t elapsed_ms = (meas_.ts - h.last.ts) / 1000;
+      if (elapsed_ms < o.min_interval_ms) continue;
+      bool changed = (o.power_delta_w <= 0 && o.energy_delta_wh <= 0);
+      if (o.power_delta_w > 0 &&
+          std::fabs(meas_.power_w - h.last.power_w) >= o.power_delta_w) {
+        changed = true;
+      }
+      if (o.energy_delta_wh > 0 &&
+          std::fabs(meas_.energy_wh - h.last.energy_wh) >= o.energy_delta_wh) {
+        changed = true;
+      }
+      if (o.max_interval_ms > 0 && elapsed_ms >= o.max_interval_ms) {
+        changed = true;
+      }
+      if (!changed) continue;
+    }
+    h.last = meas_;
+    // Copy, the handler may remove itself.
+    HandlerFn fn = h.fn;
+    fn(meas_);
+  }
+}
+
+void PowerMeter::SetProtection(PMProtection *p) {
+  protection_ = p;
+}
+
+PMProtection *PowerMeter::protection() const {
+  return protection_;
+}
+
+// static
+void PowerMeter::ComputePowerFactor(Measurement *m) {
+  float s = m->voltage_v * m->current_a;  // Apparent power, VA.
+  if (std::isnan(s)) return;
+  float p = std::fabs(m->power_w);
+  if (s < 1) return;  // Below noise level, PF is meaningless.
+  if (p > s) {
+    // Readings are not perfectly in sync, clamp.
+    m->power_factor = 1;
+    m->reactive_power_var = 0;
+    return;
+  }
+  m->power_factor = p / s;
+  m->reactive_power_var = std::sqrt(s * s - p * p);
+}
+
+double PowerMeter::GetTotalEnergyWH() const {
+  return energy_wh_;
+}
+
+void PowerMeter::SetTotalEnergyWH(double wh) {
+  energy_wh_ = wh;
+}
+
+void PowerMeter::AddEnergyWH(double wh) {
+  energy_wh_ += wh;
+}
+
 }  // namespace shelly
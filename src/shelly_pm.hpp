@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include <cmath>
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -24,19 +26,87 @@
 
 namespace shelly {
 
+class PMProtection;
+
 class PowerMeter {
  public:
+  // Values from a single measurement cycle.
+  // Quantities the meter does not provide are NAN.
+  struct Measurement {
+    uint32_t seq = 0;  // Incremented with every new measurement.
+    int64_t ts = 0;    // Uptime when taken, microseconds.
+    float power_w = 0;
+    float energy_wh = 0;
+    float voltage_v = NAN;
+    float current_a = NAN;
+    float frequency_hz = NAN;
+    float power_factor = NAN;
+    float reactive_power_var = NAN;
+  };
+
   explicit PowerMeter(int id);
   virtual ~PowerMeter();
 
   int id() const;
 
   virtual Status Init() = 0;
-  virtual StatusOr<float> GetPowerW() = 0;
-  virtual StatusOr<float> GetEnergyWH() = 0;
+  // Returns the latest measurement.
+  virtual StatusOr<Measurement> GetMeasurement();
+  // Shortcuts for the respective fields of the latest measurement.
+  virtual StatusOr<float> GetPowerW();
+  virtual StatusOr<float> GetEnergyWH();
+
+  // Handlers are called with new measurements as they are taken.
+  // A measurement is delivered when power or energy moved by at least the
+  // respective delta since the last delivery to this handler (with both
+  // deltas at 0 every measurement is delivered), but not more often than
+  // min_interval_ms. With max_interval_ms set, a measurement is delivered at
+  // least that often even if nothing changed.
+  struct HandlerOpts {
+    float power_delta_w = 0;
+    float energy_delta_wh = 0;
+    int min_interval_ms = 0;
+    int max_interval_ms = 0;
+  };
+  typedef int HandlerID;
+  static constexpr HandlerID kInvalidHandlerID = -1;
+  typedef std::function<void(const Measurement &m)> HandlerFn;
+  HandlerID AddHandler(HandlerFn h, const HandlerOpts &opts);
+  void RemoveHandler(HandlerID hi);
+
+  // Protection is checked with every measurement, ahead of the handlers.
+  // Drivers may override this to set up early detection of excess load.
+  virtual void SetProtection(PMProtection *p);
+  PMProtection *protection() const;
+
+  // Total active energy accumulated by this meter, Wh.
+  // Survives restarts when backed by PMEnergyJournal.
+  double GetTotalEnergyWH() const;
+  void SetTotalEnergyWH(double wh);
+
+ protected:
+  // Drivers report energy measured since the previous call.
+  void AddEnergyWH(double wh);
+  // Drivers publish a new measurement once per cycle, seq and ts are set here.
+  const Measurement &SetMeasurement(const Measurement &m);
+  // Derives power factor and reactive power from P, V and I, if available.
+  static void ComputePowerFactor(Measurement *m);
 
  private:
+  struct Handler {
+    HandlerFn fn;
+    HandlerOpts opts;
+    Measurement last;  // Last measurement delivered, ts 0 - none yet.
+  };
+
+  void CallHandlers();
+
   const int id_;
+  Measurement meas_;
+  std::vector<Handler> handlers_;
+  PMProtection *protection_ = nullptr;
+  // Double: float would drop small increments once the total gets large.
+  double energy_wh_ = 0;
 
   PowerMeter(const PowerMeter &other) = delete;
 };
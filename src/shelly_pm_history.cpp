@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shelly_pm_history.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "common/cs_crc32.h"
+#include "mgos.hpp"
+
+namespace shelly {
+
+#define PMH_FILE_MAGIC 0x31484D50  // "PMH1"
+// Rings are sized for the samples they must hold at 2 bytes each, the
+// varint delta of a realistic load.
+#define PMH_SAMPLE_BYTES 2
+#if CS_PLATFORM == CS_P_ESP8266
+// Per meter, and the Shelly 2.5 has two.
+#define PMH_MIN_SAMPLES 360   // 6 hours of minutes, 8 blocks, 1K.
+#define PMH_HOUR_SAMPLES 168  // A week of hours, 4 blocks, 512 bytes.
+#else
+#define PMH_MIN_SAMPLES 1440  // A day of minutes, 27 blocks, ~3.4K.
+#define PMH_HOUR_SAMPLES 744  // A 31 day month of hours, 15 blocks, ~1.9K.
+#endif
+#define PMH_MAX_PAGE_BLOCKS 8
+#define PMH_TIMER_INTERVAL_MS 5000
+// Wall clock time before 2020-01-01 has not been set yet.
+#define PMH_MIN_VALID_TIME 1577836800
+
+// Zigzag varint of a 32 bit value takes at most 5 bytes.
+static constexpr size_t kMaxVarintLen = 5;
+
+// A block is closed with up to kMaxVarintLen bytes unused, and starting a new
+// one in a full ring drops the oldest, hence the extra block.
+static constexpr size_t kBlockSamples =
+    (PMHistorySeries::kBlockDataLen - kMaxVarintLen) / PMH_SAMPLE_BYTES;
+
+static constexpr size_t BlocksFor(size_t num_samples) {
+  return (num_samples + kBlockSamples - 1) / kBlockSamples + 1;
+}
+
+PMHistorySeries::PMHistorySeries(int interval, size_t max_blocks)
+    : interval_(interval), blocks_(max_blocks) {
+}
+
+int PMHistorySeries::interval() const {
+  return interval_;
+}
+
+size_t PMHistorySeries::num_blocks() const {
+  return num_;
+}
+
+// static
+void PMHistorySeries::PutVarint(Block *b, int32_t v) {
+  uint32_t zz = (((uint32_t) v) << 1) ^ ((uint32_t) (v >> 31));
+  while (zz >= 0x80) {
+    b->data[b->len++] = (uint8_t) (zz | 0x80);
+    zz >>= 7;
+  }
+  b->data[b->len++] = (uint8_t) zz;
+}
+
+void PMHistorySeries::Add(uint32_t ts, int32_t value) {
+  Block *b = (num_ > 0 ? &blocks_[head_] : nullptr);
+  if (b == nullptr || ts != b->start + b->num * (uint32_t) interval_ ||
+      b->len + kMaxVarintLen > kBlockDataLen) {
+    head_ = (num_ > 0 ? (head_ + 1) % blocks_.size() : 0);
+    if (num_ < blocks_.size()) num_++;
+    b = &blocks_[head_];
+    b->start = ts;
+    b->num = 0;
+    b->len = 0;
+    PutVarint(b, value);
+  } else {
+    PutVarint(b, value - last_value_);
+  }
+  b->num++;
+  last_value_ = value;
+}
+
+const PMHistorySeries::Block &PMHistorySeries::GetBlock(size_t i) const {
+  return blocks_[(head_ + blocks_.size() - num_ + 1 + i) % blocks_.size()];
+}
+
+// static
+std::vector<int32_t> PMHistorySeries::Decode(const Block &b) {
+  std::vector<int32_t> res;
+  res.reserve(b.num);
+  uint32_t zz = 0;
+  int shift = 0;
+  for (size_t i = 0; i < b.len && i < kBlockDataLen; i++) {
+    zz |= ((uint32_t) (b.data[i] & 0x7F)) << shift;
+    if (b.data[i] & 0x80) {
+      shift += 7;
+      continue;
+    }
+    res.push_back((int32_t) (zz >> 1) ^ -((int32_t) (zz & 1)));
+    zz = 0;
+    shift = 0;
+  }
+  return res;
+}
+
+Status PMHistorySeries::Save(FILE *fp) const {
+  uint32_t hdr[4] = {(uint32_t) interval_, (uint32_t) blocks_.size(), head_,
+                     num_};
+  uint32_t crc = cs_crc32(0, hdr, sizeof(hdr));
+  crc = cs_crc32(crc, blocks_.data(), blocks_.size() * sizeof(Block));
+  if (fwrite(hdr, sizeof(hdr), 1, fp) != 1 ||
+      fwrite(blocks_.data(), sizeof(Block), blocks_.size(), fp) !=
+          blocks_.size() ||
+      fwrite(&crc, sizeof(crc), 1, fp) != 1) {
+    return mgos::Errorf(STATUS_UNAVAILABLE, "write failed");
+  }
+  return Status::OK();
+}
+
+Status PMHistorySeries::Load(FILE *fp) {
+  uint32_t hdr[4], crc = 0;
+  if (fread(hdr, sizeof(hdr), 1, fp) != 1) {
+    return mgos::Errorf(STATUS_DATA_LOSS, "read failed");
+  }
+  if (hdr[0] != (uint32_t) interval_ || hdr[1] != blocks_.size() ||
+      hdr[2] >= blocks_.size() || hdr[3] > blocks_.size()) {
+    return mgos::Errorf(STATUS_INVALID_ARGUMENT, "layout mismatch");
+  }
+  std::vector<Block> blocks(blocks_.size());
+  if (fread(blocks.data(), sizeof(Block), blocks.size(), fp) !=
+          blocks.size() ||
+      fread(&crc, sizeof(crc), 1, fp) != 1) {
+    return mgos::Errorf(STATUS_DATA_LOSS, "read failed");
+  }
+  uint32_t crc2 = cs_crc32(0, hdr, sizeof(hdr));
+  crc2 = cs_crc32(crc2, blocks.data(), blocks.size() * sizeof(Block));
+  if (crc != crc2) {
+    return mgos::Errorf(STATUS_DATA_LOSS, "bad checksum");
+  }
+  blocks_.swap(blocks);
+  head_ = hdr[2];
+  num_ = hdr[3];
+  last_value_ = 0;
+  if (num_ > 0) {
+    for (int32_t v : Decode(blocks_[head_])) last_value_ += v;
+  }
+  return Status::OK();
+}
+
+PMIntervalTracker::PMIntervalTracker(int interval) : interval_(interval) {
+}
+
+int PMIntervalTracker::interval() const {
+  return interval_;
+}
+
+bool PMIntervalTracker::Update(double now, double wh, uint32_t *start,
+                               double *dwh, double *dt) {
+  uint32_t cur = ((uint32_t) now / interval_) * interval_;
+  if (start_ == cur) return false;
+  *start = start_;
+  *dt = now - start_time_;
+  *dwh = wh - start_wh_;
+  // Skip intervals interrupted by a clock jump or a counter reset.
+  bool res = (start_ != 0 && cur == start_ + interval_ && *dt > 0 &&
+              *dwh >= 0);
+  start_ = cur;
+  start_time_ = now;
+  start_wh_ = wh;
+  return res;
+}
+
+constexpr PMHistory::HandlerID PMHistory::kInvalidHandlerID;
+
+PMHistory::PMHistory(PowerMeter *pm)
+    : pm_(pm),
+      min_(60, BlocksFor(PMH_MIN_SAMPLES)),
+      hour_(3600, BlocksFor(PMH_HOUR_SAMPLES)),
+      min_slot_(min_.interval()),
+      hour_slot_(hour_.interval()),
+      timer_(std::bind(&PMHistory::TimerCB, this)) {
+  timer_.Reset(PMH_TIMER_INTERVAL_MS, MGOS_TIMER_REPEAT);
+}
+
+PowerMeter *PMHistory::pm() const {
+  return pm_;
+}
+
+const PMHistorySeries &PMHistory::minutes() const {
+  return min_;
+}
+
+const PMHistorySeries &PMHistory::hours() const {
+  return hour_;
+}
+
+PMHistory::HandlerID PMHistory::AddIntervalHandler(int interval,
+                                                   IntervalHandlerFn h) {
+  int i;
+  for (i = 0; i < (int) handlers_.size(); i++) {
+    if (handlers_[i].fn == nullptr) {
+      handlers_[i] = {PMIntervalTracker(interval), h};
+      return i;
+    }
+  }
+  handlers_.push_back({PMIntervalTracker(interval), h});
+  return i;
+}
+
+void PMHistory::RemoveIntervalHandler(HandlerID hi) {
+  if (hi < 0) return;
+  handlers_[hi].fn = nullptr;
+}
+
+void PMHistory::TimerCB() {
+  double now = mg_time(), wh = pm_->GetTotalEnergyWH();
+  // Samples are bucketed by wall clock time, wait for SNTP.
+  if (now < PMH_MIN_VALID_TIME) return;
+  uint32_t start;
+  double dwh, dt;
+  if (min_slot_.Update(now, wh, &start, &dwh, &dt)) {
+    min_.Add(start, (int32_t) std::lround(dwh * 3600 / dt * 10));
+  }
+  if (hour_slot_.Update(now, wh, &start, &dwh, &dt)) {
+    hour_.Add(start, (int32_t) std::lround(dwh * 10));
+  }
+  for (auto &h : handlers_) {
+    if (h.fn == nullptr) continue;
+    if (h.tracker.Update(now, wh, &start, &dwh, &dt)) {
+      h.fn(start, dwh * 3600 / dt);
+    }
+  }
+}
+
+StatusOr<std::string> PMHistory::GetJSON(const std::string &series, int offset,
+                                         int limit) const {
+  const PMHistorySeries *s;
+  const char *unit;
+  if (series == "min") {
+    s = &min_;
+    unit = "W";
+  } else if (series == "hour") {
+    s = &hour_;
+    unit = "Wh";
+  } else {
+    return mgos::Errorf(STATUS_INVALID_ARGUMENT, "invalid series");
+  }
+  const int total = s->num_blocks();
+  if (offset < 0) offset = 0;
+  if (limit <= 0 || limit > PMH_MAX_PAGE_BLOCKS) limit = PMH_MAX_PAGE_BLOCKS;
+  int end = std::min(offset + limit, total);
+  std::string res = mgos::JSONPrintStringf(
+      "{id: %d, series: %Q, interval: %d, unit: %Q, scale: %.1f, total: %d, "
+      "offset: %d, next: %d, blocks: [",
+      pm_->id(), series.c_str(), s->interval(), unit, 0.1, total, offset,
+      (end < total ? end : -1));
+  for (int i = offset; i < end; i++) {
+    const auto &b = s->GetBlock(i);
+    if (i > offset) res.append(", ");
+    mgos::JSONAppendStringf(&res, "{ts: %u, v: [", (unsigned) b.start);
+    bool first = true;
+    for (int32_t v : PMHistorySeries::Decode(b)) {
+      mgos::JSONAppendStringf(&res, (first ? "%d" : ",%d"), (int) v);
+      first = false;
+    }
+    res.append("]}");
+  }
+  res.append("]}");
+  return res;
+}
+
+Status PMHistory::Save(const std::string &file_name) const {
+  std::string tmp_name = file_name + ".tmp";
+  FILE *fp = fopen(tmp_name.c_str(), "wb");
+  if (fp == nullptr) {
+    return mgos::Errorf(STATUS_UNAVAILABLE, "failed to open %s",
+                        tmp_name.c_str());
+  }
+  uint32_t magic = PMH_FILE_MAGIC;
+  Status st = Status::OK();
+  if (fwrite(&magic, sizeof(magic), 1, fp) != 1) {
+    st = mgos::Errorf(STATUS_UNAVAILABLE, "write failed");
+  }
+  if (st.ok()) st = min_.Save(fp);
+  if (st.ok()) st = hour_.Save(fp);
+  fclose(fp);
+  if (st.ok() && rename(tmp_name.c_str(), file_name.c_str()) != 0) {
+    st = mgos::Errorf(STATUS_UNAVAILABLE, "failed to rename %s",
+                      tmp_name.c_str());
+  }
+  if (!st.ok()) remove(tmp_name.c_str());
+  return st;
+}
+
+Status PMHistory::Load(const std::string &file_name) {
+  FILE *fp = fopen(file_name.c_str(), "rb");
+  if (fp == nullptr) {
+    return mgos::Errorf(STATUS_NOT_FOUND, "no history");
+  }
+  uint32_t magic = 0;
+  Status st = Status::OK();
+  if (fread(&magic, sizeof(magic), 1, fp) != 1 || magic != PMH_FILE_MAGIC) {
+    st = mgos::Errorf(STATUS_INVALID_ARGUMENT, "bad magic");
+  }
+  if (st.ok()) st = min_.Load(fp);
+  if (st.ok()) st = hour_.Load(fp);
+  fclose(fp);
+  if (st.ok()) {
+    LOG(LL_INFO, ("PM %d: restored history, %d + %d blocks", pm_->id(),
+                  (int) min_.num_blocks(), (int) hour_.num_blocks()));
+  }
+  return st;
+}
+
+}  // namespace shelly
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "mgos_timers.hpp"
+
+#include "shelly_common.hpp"
+#include "shelly_pm.hpp"
+
+namespace shelly {
+
+// Fixed-size ring of equally spaced integer samples.
+//
+// Samples are kept in fixed-size blocks as zigzag varints: the first sample
+// of a block is absolute, the rest are deltas from the previous one, so a
+// slowly changing signal takes one byte per sample. A new block is started
+// when the current one is full or when there is a gap in time; once all
+// blocks are used the oldest one is dropped.
+class PMHistorySeries {
+ public:
+  static constexpr size_t kBlockDataLen = 120;
+
+  struct Block {
+    uint32_t start;  // Timestamp of the first sample.
+    uint16_t num;    // Number of samples.
+    uint16_t len;    // Bytes of data used.
+    uint8_t data[kBlockDataLen];
+  };
+
+  PMHistorySeries(int interval, size_t max_blocks);
+
+  int interval() const;
+  size_t num_blocks() const;
+
+  // ts is the start of the sample's interval.
+  void Add(uint32_t ts, int32_t value);
+
+  // Block 0 is the oldest.
+  const Block &GetBlock(size_t i) const;
+
+  // Returns encoded values of the block: absolute first, then deltas.
+  static std::vector<int32_t> Decode(const Block &b);
+
+  Status Save(FILE *fp) const;
+  Status Load(FILE *fp);
+
+ private:
+  static void PutVarint(Block *b, int32_t v);
+
+  const int interval_;
+  std::vector<Block> blocks_;
+  uint32_t head_ = 0;  // Newest block.
+  uint32_t num_ = 0;   // Blocks in use.
+  int32_t last_value_ = 0;
+};
+
+// Energy used by a meter over consecutive wall clock intervals, aligned to
+// multiples of the interval. Fed the time and the energy counter at least a
+// few times per interval, reports each one as it ends; intervals cut short
+// by a clock jump or a counter reset are skipped.
+class PMIntervalTracker {
+ public:
+  explicit PMIntervalTracker(int interval);
+
+  int interval() const;
+
+  // Returns true when an interval has ended, with its start, the energy
+  // used and the time it took.
+  bool Update(double now, double wh, uint32_t *start, double *dwh,
+              double *dt);
+
+ private:
+  int interval_;
+  uint32_t start_ = 0;
+  double start_time_ = 0;
+  double start_wh_ = 0;
+};
+
+// Power and energy history of a single meter:
+// average power per minute (0.1 W) and energy per hour (0.1 Wh).
+// Both are derived from the meter's energy counter, so no extra sampling is
+// needed and averages are exact regardless of the meter's update rate.
+// Timestamps are wall clock time, nothing is recorded until it is set.
+class PMHistory {
+ public:
+  explicit PMHistory(PowerMeter *pm);
+
+  PowerMeter *pm() const;
+  const PMHistorySeries &minutes() const;
+  const PMHistorySeries &hours() const;
+
+  // Returns a page of series ("min" or "hour") blocks as JSON.
+  StatusOr<std::string> GetJSON(const std::string &series, int offset,
+                                int limit) const;
+
+  // Other logs of the meter, e.g. Eve history, get the average power over
+  // their own intervals from the history's timer.
+  typedef int HandlerID;
+  static constexpr HandlerID kInvalidHandlerID = -1;
+  typedef std::function<void(uint32_t start, float power_w)> IntervalHandlerFn;
+  HandlerID AddIntervalHandler(int interval, IntervalHandlerFn h);
+  void RemoveIntervalHandler(HandlerID hi);
+
+  // Mirror to flash, done on orderly reboot.
+  Status Save(const std::string &file_name) const;
+  Status Load(const std::string &file_name);
+
+ private:
+  struct IntervalHandler {
+    PMIntervalTracker tracker;
+    IntervalHandlerFn fn;
+  };
+
+  void TimerCB();
+
+  PowerMeter *const pm_;
+  PMHistorySeries min_, hour_;
+  PMIntervalTracker min_slot_, hour_slot_;
+  std::vector<IntervalHandler> handlers_;
+
+  mgos::Timer timer_;
+
+  PMHistory(const PMHistory &other) = delete;
+};
+
+}  // namespace shelly
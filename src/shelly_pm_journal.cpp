@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shelly_pm_journal.hpp"
+
+#include <sys/stat.h>
+
+#include <cmath>
+#include <cstdio>
+
+#include "common/cs_crc32.h"
+#include "mgos.hpp"
+#include "mgos_sys_config.h"
+
+namespace shelly {
+
+#define PMJ_RECORD_MAGIC 0xE7
+// Compact once the file grows beyond this.
+#define PMJ_MAX_FILE_SIZE 2048
+// Changes smaller than this are only committed when forced (e.g. on reboot).
+#define PMJ_MIN_DELTA_WH 1.0
+#define PMJ_MIN_INTERVAL_SEC 60
+
+struct PMEnergyJournal::Record {
+  uint8_t magic;
+  uint8_t pm_id;
+  uint16_t reserved;
+  uint32_t seq;
+  uint64_t energy_mwh;
+  uint32_t crc;  // Over all the preceding fields.
+} __attribute__((packed));
+
+PMEnergyJournal::PMEnergyJournal(
+    const std::string &file_name,
+    const std::vector<std::unique_ptr<PowerMeter>> *pms)
+    : file_name_(file_name),
+      pms_(pms),
+      committed_wh_(pms->size(), 0),
+      commit_timer_(std::bind(&PMEnergyJournal::CommitTimerCB, this)) {
+  int interval = mgos_sys_config_get_shelly_pm_journal_interval();
+  if (interval < PMJ_MIN_INTERVAL_SEC) interval = PMJ_MIN_INTERVAL_SEC;
+  commit_timer_.Reset(interval * 1000, MGOS_TIMER_REPEAT);
+}
+
+PMEnergyJournal::~PMEnergyJournal() {
+}
+
+Status PMEnergyJournal::Restore() {
+  FILE *fp = fopen(file_name_.c_str(), "rb");
+  if (fp == nullptr) {
+    // Compaction may have been interrupted before the rename.
+    std::string tmp_name = file_name_ + ".tmp";
+    if (rename(tmp_name.c_str(), file_name_.c_str()) == 0) {
+      fp = fopen(file_name_.c_str(), "rb");
+    }
+  }
+  if (fp == nullptr) {
+    return mgos::Errorf(STATUS_NOT_FOUND, "no journal");
+  }
+  Record r;
+  int num_records = 0, num_bad = 0;
+  std::vector<double> restored_wh(pms_->size(), -1);
+  while (fread(&r, sizeof(r), 1, fp) == 1) {
+    if (r.magic != PMJ_RECORD_MAGIC ||
+        r.crc != cs_crc32(0, &r, offsetof(Record, crc))) {
+      // Most likely a torn write at the end, keep what we have.
+      num_bad++;
+      continue;
+    }
+    num_records++;
+    if (r.seq > seq_) seq_ = r.seq;
+    for (size_t i = 0; i < pms_->size(); i++) {
+      if ((*pms_)[i]->id() == r.pm_id) {
+        restored_wh[i] = r.energy_mwh / 1000.0;
+      }
+    }
+  }
+  fclose(fp);
+  for (size_t i = 0; i < pms_->size(); i++) {
+    if (restored_wh[i] < 0) continue;
+    PowerMeter *pm = (*pms_)[i].get();
+    pm->SetTotalEnergyWH(restored_wh[i] + pm->GetTotalEnergyWH());
+    committed_wh_[i] = restored_wh[i];
+    LOG(LL_INFO, ("PM %d: restored %.3f Wh", pm->id(), restored_wh[i]));
+  }
+  LOG(LL_DEBUG, ("PMJ: %d records, %d bad, seq %u", num_records, num_bad,
+                 (unsigned) seq_));
+  return Status::OK();
+}
+
+Status PMEnergyJournal::Commit(bool force) {
+  size_t num_changed = 0;
+  for (size_t i = 0; i < pms_->size(); i++) {
+    double delta = (*pms_)[i]->GetTotalEnergyWH() - committed_wh_[i];
+    if (delta >= PMJ_MIN_DELTA_WH || (force && delta != 0)) num_changed++;
+  }
+  if (num_changed == 0) return Status::OK();
+  struct stat st;
+  if (stat(file_name_.c_str(), &st) == 0 &&
+      st.st_size + num_changed * sizeof(Record) > PMJ_MAX_FILE_SIZE) {
+    return Compact();
+  }
+  FILE *fp = fopen(file_name_.c_str(), "ab");
+  if (fp == nullptr) {
+    return mgos::Errorf(STATUS_UNAVAILABLE, "failed to open %s",
+                        file_name_.c_str());
+  }
+  Status res;
+  for (size_t i = 0; i < pms_->size(); i++) {
+    const PowerMeter *pm = (*pms_)[i].get();
+    double wh = pm->GetTotalEnergyWH();
+    double delta = wh - committed_wh_[i];
+    if (delta < PMJ_MIN_DELTA_WH && !(force && delta != 0)) continue;
+    res = Append(fp, pm);
+    if (!res.ok()) break;
+    committed_wh_[i] = wh;
+  }
+  fclose(fp);
+  return res;
+}
+
+Status PMEnergyJournal::Append(FILE *fp, const PowerMeter *pm) {
+  Record r = {};
+  r.magic = PMJ_RECORD_MAGIC;
+  r.pm_id = pm->id();
+  r.seq = ++seq_;
+  r.energy_mwh = (uint64_t) std::llround(pm->GetTotalEnergyWH() * 1000.0);
+  r.crc = cs_crc32(0, &r, offsetof(Record, crc));
+  if (fwrite(&r, sizeof(r), 1, fp) != 1) {
+    return mgos::Errorf(STATUS_UNAVAILABLE, "failed to write %s",
+                        file_name_.c_str());
+  }
+  return Status::OK();
+}
+
+Status PMEnergyJournal::Compact() {
+  std::string tmp_name = file_name_ + ".tmp";
+  FILE *fp = fopen(tmp_name.c_str(), "wb");
+  if (fp == nullptr) {
+    return mgos::Errorf(STATUS_UNAVAILABLE, "failed to open %s",
+                        tmp_name.c_str());
+  }
+  Status res;
+  for (const auto &pm : *pms_) {
+    res = Append(fp, pm.get());
+    if (!res.ok()) break;
+  }
+  fclose(fp);
+  if (!res.ok()) {
+    remove(tmp_name.c_str());
+    return res;
+  }
+  remove(file_name_.c_str());
+  if (rename(tmp_name.c_str(), file_name_.c_str()) != 0) {
+    return mgos::Errorf(STATUS_UNAVAILABLE, "failed to rename %s",
+                        tmp_name.c_str());
+  }
+  for (size_t i = 0; i < pms_->size(); i++) {
+    committed_wh_[i] = (*pms_)[i]->GetTotalEnergyWH();
+  }
+  LOG(LL_DEBUG, ("PMJ: compacted, seq %u", (unsigned) seq_));
+  return Status::OK();
+}
+
+void PMEnergyJournal::CommitTimerCB() {
+  Status st = Commit(false /* force */);
+  if (!st.ok()) {
+    LOG(LL_ERROR, ("PMJ: commit failed: %s", st.ToString().c_str()));
+  }
+}
+
+}  // namespace shelly
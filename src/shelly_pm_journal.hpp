@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mgos_timers.hpp"
+
+#include "shelly_common.hpp"
+#include "shelly_pm.hpp"
+
+namespace shelly {
+
+// Persists accumulated energy of power meters across restarts.
+//
+// Counters are appended as small fixed-size, checksummed records to a file,
+// the last valid record for each meter wins on restore. Appends happen once
+// per commit interval (shelly.pm_journal_interval) and only for meters whose
+// counter moved, so the number of flash writes per hour is bounded regardless
+// of load. When the file reaches its size limit it is compacted into a single
+// snapshot, which spreads writes over the file system instead of rewriting
+// the same block.
+class PMEnergyJournal {
+ public:
+  PMEnergyJournal(const std::string &file_name,
+                  const std::vector<std::unique_ptr<PowerMeter>> *pms);
+  ~PMEnergyJournal();
+
+  // Loads counters from the journal into the meters.
+  Status Restore();
+
+  // Appends counters that changed since the last commit.
+  // Unless forced, small changes are held back until they add up.
+  Status Commit(bool force);
+
+ private:
+  struct Record;
+
+  Status Append(FILE *fp, const PowerMeter *pm);
+  Status Compact();
+  void CommitTimerCB();
+
+  const std::string file_name_;
+  const std::vector<std::unique_ptr<PowerMeter>> *pms_;
+
+  uint32_t seq_ = 0;
+  std::vector<double> committed_wh_;
+
+  mgos::Timer commit_timer_;
+
+  PMEnergyJournal(const PMEnergyJournal &other) = delete;
+};
+
+}  // namespace shelly
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shelly_pm_protection.hpp"
+
+#include <cmath>
+
+namespace shelly {
+
+PMProtection::PMProtection(PowerMeter *pm, Output *out, TripCB cb)
+    : pm_(pm), out_(out), cb_(cb) {
+  pm_->SetProtection(this);
+}
+
+PMProtection::~PMProtection() {
+  pm_->SetProtection(nullptr);
+}
+
+const PMProtection::Limits &PMProtection::limits() const {
+  return limits_;
+}
+
+void PMProtection::SetLimits(const Limits &limits) {
+  limits_ = limits;
+  over_since_ = 0;
+  // Let the driver pick up the new limits.
+  pm_->SetProtection(this);
+}
+
+bool PMProtection::IsEnabled() const {
+  return (limits_.max_power_w > 0 || limits_.max_current_a > 0);
+}
+
+bool PMProtection::IsTripped() const {
+  return (trip_reason_ != TripReason::kNone);
+}
+
+PMProtection::TripReason PMProtection::trip_reason() const {
+  return trip_reason_;
+}
+
+float PMProtection::trip_value() const {
+  return trip_value_;
+}
+
+void PMProtection::Reset() {
+  if (!IsTripped()) return;
+  LOG(LL_INFO, ("PM %d: %s trip cleared", pm_->id(),
+                TripReasonStr(trip_reason_)));
+  trip_reason_ = TripReason::kNone;
+  trip_value_ = 0;
+  over_since_ = 0;
+}
+
+void PMProtection::Check(const PowerMeter::Measurement &m) {
+  if (!IsEnabled() || IsTripped()) return;
+  TripReason reason = TripReason::kNone;
+  float value = 0;
+  if (limits_.max_power_w > 0 && m.power_w > limits_.max_power_w) {
+    reason = TripReason::kOverPower;
+    value = m.power_w;
+  } else if (limits_.max_current_a > 0 && !std::isnan(m.current_a) &&
+             m.current_a > limits_.max_current_a) {
+    reason = TripReason::kOverCurrent;
+    value = m.current_a;
+  }
+  if (reason == TripReason::kNone || !out_->GetState()) {
+    over_since_ = 0;
+    return;
+  }
+  if (over_since_ == 0) over_since_ = m.ts;
+  if ((m.ts - over_since_) / 1000 < limits_.hold_ms) return;
+  // Output first, everything else can wait.
+  out_->SetState(false, TripReasonStr(reason));
+  trip_reason_ = reason;
+  trip_value_ = value;
+  over_since_ = 0;
+  LOG(LL_ERROR, ("PM %d: %s (%.3f), output %d turned off", pm_->id(),
+                 TripReasonStr(reason), value, out_->id()));
+  if (cb_ != nullptr) cb_(reason);
+}
+
+// static
+const char *PMProtection::TripReasonStr(TripReason reason) {
+  switch (reason) {
+    case TripReason::kNone:
+      return "none";
+    case TripReason::kOverPower:
+      return "overpower";
+    case TripReason::kOverCurrent:
+      return "overcurrent";
+  }
+  return "";
+}
+
+}  // namespace shelly
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <functional>
+
+#include "shelly_common.hpp"
+#include "shelly_output.hpp"
+#include "shelly_pm.hpp"
+
+namespace shelly {
+
+// Turns off an output when power or current drawn through it stays above
+// the limit for the hold time.
+// Checked by the meter with every measurement before it is handed out to
+// other consumers, so the output trips on the first sample past the hold
+// time instead of waiting for a periodic status check. Drivers that can
+// detect excess power between measurements (BL0937) use the limits to
+// trigger an early measurement.
+class PMProtection {
+ public:
+  enum class TripReason {
+    kNone = 0,
+    kOverPower = 1,
+    kOverCurrent = 2,
+  };
+
+  struct Limits {
+    float max_power_w = 0;    // 0 - no limit.
+    float max_current_a = 0;  // 0 - no limit.
+    int hold_ms = 0;          // How long the limit must be exceeded.
+  };
+
+  // Called after the output has been turned off.
+  typedef std::function<void(TripReason reason)> TripCB;
+
+  PMProtection(PowerMeter *pm, Output *out, TripCB cb);
+  ~PMProtection();
+
+  const Limits &limits() const;
+  void SetLimits(const Limits &limits);
+  bool IsEnabled() const;
+
+  bool IsTripped() const;
+  TripReason trip_reason() const;
+  // Reading that caused the trip, W or A.
+  float trip_value() const;
+  // Clears the trip, called when the output is turned back on.
+  void Reset();
+
+  void Check(const PowerMeter::Measurement &m);
+
+  static const char *TripReasonStr(TripReason reason);
+
+ private:
+  PowerMeter *const pm_;
+  Output *const out_;
+  const TripCB cb_;
+  Limits limits_;
+
+  int64_t over_since_ = 0;  // When the limit was first exceeded, 0 - not.
+  TripReason trip_reason_ = TripReason::kNone;
+  float trip_value_ = 0;
+
+  PMProtection(const PMProtection &other) = delete;
+};
+
+}  // namespace shelly
@@ -17,17 +17,19 @@
 
 #include "shelly_rgbw_controller.hpp"
 
+#include <algorithm>
+#include <cstdlib>
+
 #include "mgos.hpp"
 
 namespace shelly {
 
+static_assert(kColorMax == RGBWController::kPWMSteps,
+              "colour and transition steps must match");
+
 RGBWController::RGBWController(struct mgos_config_lb *cfg, Output *out_r,
                                Output *out_g, Output *out_b, Output *out_w)
-    : LightBulbController(cfg),
-      out_r_(out_r),
-      out_g_(out_g),
-      out_b_(out_b),
-      out_w_(out_w) {
+    : LightBulbController(cfg, {out_r, out_g, out_b, out_w}), out_w_(out_w) {
 }
 
 RGBWController::~RGBWController() {
@@ -43,87 +45,79 @@ void RGBWController::ReportTransition(const StateRGBW &next,
   }
 }
 
-void RGBWController::UpdatePWM(const StateRGBW &state) {
-  out_r_->SetStatePWM(state.r, "transition");
-  out_g_->SetStatePWM(state.g, "transition");
-  out_b_->SetStatePWM(state.b, "transition");
-
-  if (out_w_ != nullptr) {
-    out_w_->SetStatePWM(state.w, "transition");
-  }
-}
-
 StateRGBW RGBWController::ConfigToState(
     const struct mgos_config_lb &cfg) const {
   StateRGBW state{};
 
   if (!cfg.state) return state;
 
-  float h = cfg.hue / 360.0f;
-  float s = cfg.saturation / 100.0f;
-  float v = cfg.brightness / 100.0f;
-
-  if (cfg.saturation == 0) {
-    // if saturation is zero than all rgb channels same as brightness
-    state.r = state.g = state.b = v;
-  } else {
-    // otherwise calc rgb from hsv (hue, saturation, brightness)
-    int i = static_cast<int>(h * 6);
-    float f = (h * 6.0f - i);
-    float p = v * (1.0f - s);
-    float q = v * (1.0f - f * s);
-    float t = v * (1.0f - (1.0f - f) * s);
-
-    switch (i % 6) {
-      case 0:  // 0° ≤ h < 60°
-        state.r = v;
-        state.g = t;
-        state.b = p;
-        break;
-
-      case 1:  // 60° ≤ h < 120°
-        state.r = q;
-        state.g = v;
-        state.b = p;
-        break;
-
-      case 2:  // 120° ≤ h < 180°
-        state.r = p;
-        state.g = v;
-        state.b = t;
-        break;
-
-      case 3:  // 180° ≤ h < 240°
-        state.r = p;
-        state.g = q;
-        state.b = v;
-        break;
-
-      case 4:  // 240° ≤ h < 300°
-        state.r = t;
-        state.g = p;
-        state.b = v;
-        break;
-
-      case 5:  // 300° ≤ h < 360°
-        state.r = v;
-        state.g = p;
-        state.b = q;
-        break;
-    }
+  const ColorRGBW c =
+      HSVToRGBW(HSVFromConfig(cfg.hue, cfg.saturation, cfg.brightness),
+                out_w_ != nullptr /* white */);
+  state.r = static_cast<float>(c.r) / kColorMax;
+  state.g = static_cast<float>(c.g) / kColorMax;
+  state.b = static_cast<float>(c.b) / kColorMax;
+  state.w = static_cast<float>(c.w) / kColorMax;
+  return state;
+}
+
+// HSV coordinates are h, s, v and 0.
+void RGBWController::TransitionCoords(const Duty &from, const Duty &to,
+                                      Duty *from_coords, Duty *to_coords) {
+  *from_coords = from;
+  *to_coords = to;
+  space_ = TransitionSpace::kRGB;
+  if (cfg_->transition_space != (int) TransitionSpace::kHSV) return;
+  ColorHSV a = RGBWToHSV({from[0], from[1], from[2], from[3]});
+  ColorHSV b = RGBWToHSV({to[0], to[1], to[2], to[3]});
+  // Hue of black and greys is undefined, take the other end's so that
+  // fades in and out and to and from white keep the colour.
+  if (a.v == 0 || a.s == 0) a.h = b.h;
+  if (a.v == 0) a.s = b.s;
+  if (b.v == 0 || b.s == 0) b.h = a.h;
+  if (b.v == 0) b.s = a.s;
+  if (b.h - a.h > kHueMax / 2) {
+    b.h -= kHueMax;
+  } else if (a.h - b.h > kHueMax / 2) {
+    b.h += kHueMax;
+  }
+  // Brightness changes are exact and monotonic in RGB, in HSV rounding of
+  // hue and saturation at both ends would make channels wobble. Both are
+  // read back from the duty: a step of a channel moves hue by up to
+  // kHueSextant / chroma and saturation by kColorMax / v, many degrees and
+  // percent when dim, so the tolerance grows with that.
+  const int ca = std::max(a.s * a.v / kColorMax, 1);
+  const int cb = std::max(b.s * b.v / kColorMax, 1);
+  if (std::abs(b.h - a.h) <=
+          kHueSextant / 60 + kHueSextant / ca + kHueSextant / cb &&
+      std::abs(b.s - a.s) <= kColorMax / 100 + kColorMax / std::max(a.v, 1) +
+                                 kColorMax / std::max(b.v, 1)) {
+    return;
   }
+  space_ = TransitionSpace::kHSV;
+  *from_coords = {{a.h, a.s, a.v, 0}};
+  *to_coords = {{b.h, b.s, b.v, 0}};
+}
 
-  if (out_w_ != nullptr) {
-    // apply white channel to rgb if available
-    state.w = std::min(state.r, std::min(state.g, state.b));
-    state.r = state.r - state.w;
-    state.g = state.g - state.w;
-    state.b = state.b - state.w;
-  } else {
-    // otherwise turn white channel off
-    state.w = 0.0f;
+void RGBWController::CoordsToDuty(const Duty &coords, Duty *duty) const {
+  if (space_ != TransitionSpace::kHSV) {
+    *duty = coords;
+    return;
   }
-  return state;
+  const ColorRGBW c =
+      HSVToRGBW({coords[0], coords[1], coords[2]}, out_w_ != nullptr);
+  *duty = {{c.r, c.g, c.b, c.w}};
+}
+
+void RGBWController::ApplyEffect(const LightEffectFrame &f, Duty *duty) const {
+  if (f.hue_shift != 0) {
+    const Duty &d = *duty;
+    ColorHSV hsv = RGBWToHSV({d[0], d[1], d[2], d[3]});
+    hsv.h = (hsv.h + f.hue_shift + kHueMax) % kHueMax;
+    const ColorRGBW c = HSVToRGBW(hsv, out_w_ != nullptr);
+    *duty = {{c.r, c.g, c.b, c.w}};
+  }
+  LightBulbController::ApplyEffect(f, duty);
 }
 
 std::string StateRGBW::ToString() const {
@@ -16,6 +16,7 @@
  */
 
 #include "mgos_timers.hpp"
+#include "shelly_color.hpp"
 #include "shelly_light_bulb_controller.hpp"
 #include "shelly_output.hpp"
 
@@ -28,22 +29,32 @@ struct StateRGBW {
   float b;
   float w;
 
-  StateRGBW operator+(const StateRGBW &other) const {
-    return {
-        .r = r + other.r,
-        .g = g + other.g,
-        .b = b + other.b,
-        .w = w + other.w,
-    };
+  static constexpr int kNumChannels = 4;
+
+  float &operator[](int ch) {
+    switch (ch) {
+      case 0:
+        return r;
+      case 1:
+        return g;
+      case 2:
+        return b;
+      default:
+        return w;
+    }
   }
 
-  StateRGBW operator*(float a) const {
-    return {
-        .r = a * r,
-        .g = a * g,
-        .b = a * b,
-        .w = a * w,
-    };
+  float operator[](int ch) const {
+    switch (ch) {
+      case 0:
+        return r;
+      case 1:
+        return g;
+      case 2:
+        return b;
+      default:
+        return w;
+    }
   }
 
   std::string ToString() const;
@@ -61,9 +72,15 @@ class RGBWController : public LightBulbController<StateRGBW> {
   }
 
  private:
-  Output *const out_r_, *const out_g_, *const out_b_, *const out_w_;
+  Output *const out_w_;
+  // Of the current transition.
+  TransitionSpace space_ = TransitionSpace::kRGB;
+
   StateRGBW ConfigToState(const struct mgos_config_lb &cfg) const final;
   void ReportTransition(const StateRGBW &next, const StateRGBW &prev) final;
-  void UpdatePWM(const StateRGBW &state) final;
+  void TransitionCoords(const Duty &from, const Duty &to, Duty *from_coords,
+                        Duty *to_coords) final;
+  void CoordsToDuty(const Duty &coords, Duty *duty) const final;
+  void ApplyEffect(const LightEffectFrame &f, Duty *duty) const final;
 };
 }  // namespace shelly
@@ -28,6 +28,7 @@
 
 #include "shelly_debug.hpp"
 #include "shelly_hap_switch.hpp"
+#include "shelly_hap_window_covering.hpp"
 #include "shelly_main.hpp"
 #include "shelly_ota.hpp"
 #include "shelly_wifi_config.hpp"
@@ -391,6 +392,60 @@ static void InjectInputEventHandler(struct mg_rpc_request_info *ri,
   (void) fi;
 }
 
+static void GetPMHistoryHandler(struct mg_rpc_request_info *ri, void *cb_arg,
+                                struct mg_rpc_frame_info *fi,
+                                struct mg_str args) {
+  int id = -1, offset = 0, limit = 0;
+  char *series = nullptr;
+
+  json_scanf(args.p, args.len, ri->args_fmt, &id, &series, &offset, &limit);
+  mgos::ScopedCPtr series_owner(series);
+
+  PMHistory *h = FindPMHistory(id);
+  if (h == nullptr) {
+    mg_rpc_send_errorf(ri, 400, "%s not found", "pm");
+    return;
+  }
+  auto res = h->GetJSON((series != nullptr ? series : "min"), offset, limit);
+  if (!res.ok()) {
+    SendStatusResp(ri, res.status());
+    return;
+  }
+  mg_rpc_send_responsef(ri, "%s", res.ValueOrDie().c_str());
+
+  (void) cb_arg;
+  (void) fi;
+}
+
+static void GetWCTraceHandler(struct mg_rpc_request_info *ri, void *cb_arg,
+                              struct mg_rpc_frame_info *fi,
+                              struct mg_str args) {
+  int id = -1, offset = 0, limit = 0;
+  char *kind = nullptr;
+
+  json_scanf(args.p, args.len, ri->args_fmt, &id, &kind, &offset, &limit);
+  mgos::ScopedCPtr kind_owner(kind);
+
+  for (auto &c : g_comps) {
+    if (c->id() != id || c->type() != Component::Type::kWindowCovering) {
+      continue;
+    }
+    auto *wc = static_cast<hap::WindowCovering *>(c.get());
+    auto res =
+        wc->GetTraceJSON((kind != nullptr ? kind : "cal"), offset, limit);
+    if (!res.ok()) {
+      SendStatusResp(ri, res.status());
+      return;
+    }
+    mg_rpc_send_responsef(ri, "%s", res.ValueOrDie().c_str());
+    return;
+  }
+  mg_rpc_send_errorf(ri, 400, "%s not found", "component");
+
+  (void) cb_arg;
+  (void) fi;
+}
+
 static void GetDebugInfoHandler(struct mg_rpc_request_info *ri, void *cb_arg,
                                 struct mg_rpc_frame_info *fi,
                                 struct mg_str args) {
@@ -586,6 +641,12 @@ bool RPCServiceInit(HAPAccessoryServerRef *server,
     mg_rpc_add_handler(c, "Shelly.InjectInputEvent", "{id: %d, event: %d}",
                        InjectInputEventHandler, nullptr);
     mg_rpc_add_handler(c, "Shelly.Abort", "", AbortHandler, nullptr);
+    mg_rpc_add_handler(c, "Shelly.GetPMHistory",
+                       "{id: %d, series: %Q, offset: %d, limit: %d}",
+                       GetPMHistoryHandler, nullptr);
+    mg_rpc_add_handler(c, "Shelly.GetWCTrace",
+                       "{id: %d, kind: %Q, offset: %d, limit: %d}",
+                       GetWCTraceHandler, nullptr);
     mg_rpc_add_handler(c, "Shelly.SetAuth", "{user: %Q, realm: %Q, ha1: %Q}",
                        SetAuthHandler, nullptr);
     mg_rpc_add_handler(mgos_rpc_get_global(), "Shelly.GetWifiConfig", "",
@@ -31,7 +31,8 @@ StatusLED::StatusLED(int id, int pin, int num_pixel,
       pin_(pin),
       num_pixel_(num_pixel),
       chained_led_(chained_led),
-      cfg_(cfg) {
+      cfg_(cfg),
+      chain_({this}) {
   value_ = false;
   mgos_gpio_set_mode(pin, MGOS_GPIO_MODE_OUTPUT);
   /* Keep in reset */
@@ -56,9 +57,35 @@ struct rgb {
 };
 
 Status StatusLED::SetState(bool on, const char *source) {
+  Status st = chain_.Stage(0, (on ? 1 : 0), source);
+  chain_.Commit();
+  return st;
+}
+
+Status StatusLED::StagePWM(float duty, const char *source) {
+  if (chained_led_ != nullptr) {
+    chained_led_->StagePWM(duty, source);
+  }
+  staged_duty_ = duty;
+  return Status::OK();
+}
+
+void StatusLED::LatchPWM() {
   if (chained_led_ != nullptr) {
-    chained_led_->SetState(on, source);
+    chained_led_->LatchPWM();
   }
+  if (staged_duty_ < 0) return;
+  WritePixels(staged_duty_ > 0);
+  staged_duty_ = -1;
+}
+
+void StatusLED::HoldPWM(bool hold) {
+  if (chained_led_ != nullptr) {
+    chained_led_->HoldPWM(hold);
+  }
+}
+
+void StatusLED::WritePixels(bool on) {
   value_ = on;
   // get color from config
   uint8_t mask = 0xFF;
@@ -89,7 +116,6 @@ Status StatusLED::SetState(bool on, const char *source) {
   mgos_gpio_write(pin_, 0);
   mgos_usleep(300);
   mgos_gpio_write(pin_, 1);
-  return Status::OK();
 }
 
 }  // namespace shelly
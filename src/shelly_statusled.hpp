@@ -43,10 +43,17 @@ class StatusLED : public Output {
     return Status::UNIMPLEMENTED();
   };
   void SetInvert(bool out_invert) override{};
+  // On if duty > 0. The chained LED is staged, latched and held along,
+  // before this one, so that the whole chain changes in one go.
+  Status StagePWM(float duty, const char *source) override;
+  void LatchPWM() override;
+  void HoldPWM(bool hold) override;
   int pin() const;
 
  protected:
  private:
+  void WritePixels(bool on);
+
   const int pin_;
   const int num_pixel_;
 
@@ -56,6 +63,8 @@ class StatusLED : public Output {
 
   const struct mgos_config_led *cfg_;
 
+  OutputGroup chain_;
+
   StatusLED(const StatusLED &other) = delete;
 };
 
@@ -17,6 +17,8 @@
 
 #include "shelly_switch.hpp"
 
+#include <cmath>
+
 #include "mgos.hpp"
 #include "mgos_hap_accessory.hpp"
 #include "mgos_hap_chars.hpp"
@@ -50,14 +52,16 @@ ShellySwitch::ShellySwitch(int id, Input *in, Output *out, PowerMeter *out_pm,
       led_out_(led_out),
       out_pm_(out_pm),
       cfg_(cfg),
-      auto_off_timer_(std::bind(&ShellySwitch::AutoOffTimerCB, this)),
-      power_timer_(std::bind(&ShellySwitch::PowerMeterTimerCB, this)) {
+      auto_off_timer_(std::bind(&ShellySwitch::AutoOffTimerCB, this)) {
 }
 
 ShellySwitch::~ShellySwitch() {
   for (size_t i = 0; i < in_handler_ids_.size(); i++) {
     ins_[i]->RemoveHandler(in_handler_ids_[i]);
   }
+  if (pm_handler_ != PowerMeter::kInvalidHandlerID) {
+    out_pm_->RemoveHandler(pm_handler_);
+  }
   SaveState();
 }
 
@@ -89,13 +93,34 @@ StatusOr<std::string> ShellySwitch::GetInfoJSON() const {
       cfg_->in_inverted, cfg_->initial_state, out_->GetState(), cfg_->auto_off,
       cfg_->auto_off_delay, cfg_->state_led_en, cfg_->out_inverted, hdim);
   if (out_pm_ != nullptr) {
-    auto power = out_pm_->GetPowerW();
-    if (power.ok()) {
-      mgos::JSONAppendStringf(&res, ", apower: %.3f", power.ValueOrDie());
+    mgos::JSONAppendStringf(
+        &res, ", max_power: %.1f, max_current: %.2f, overload_hold_ms: %d",
+        cfg_->max_power, cfg_->max_current, cfg_->overload_hold_ms);
+    if (protection_ != nullptr && protection_->IsTripped()) {
+      mgos::JSONAppendStringf(&res, ", trip_reason: %d, trip_value: %.3f",
+                              (int) protection_->trip_reason(),
+                              protection_->trip_value());
+    } else {
+      mgos::JSONAppendStringf(&res, ", trip_reason: %d", 0);
     }
-    auto energy = out_pm_->GetEnergyWH();
-    if (energy.ok()) {
-      mgos::JSONAppendStringf(&res, ", aenergy: %.3f", energy.ValueOrDie());
+    auto mv = out_pm_->GetMeasurement();
+    if (mv.ok()) {
+      const auto &m = mv.ValueOrDie();
+      mgos::JSONAppendStringf(&res, ", apower: %.3f, aenergy: %.3f", m.power_w,
+                              m.energy_wh);
+      if (!std::isnan(m.voltage_v)) {
+        mgos::JSONAppendStringf(&res, ", voltage: %.1f", m.voltage_v);
+      }
+      if (!std::isnan(m.current_a)) {
+        mgos::JSONAppendStringf(&res, ", current: %.3f", m.current_a);
+      }
+      if (!std::isnan(m.frequency_hz)) {
+        mgos::JSONAppendStringf(&res, ", freq: %.2f", m.frequency_hz);
+      }
+      if (!std::isnan(m.power_factor)) {
+        mgos::JSONAppendStringf(&res, ", pf: %.2f, rpower: %.3f",
+                                m.power_factor, m.reactive_power_var);
+      }
     }
   }
   res.append("}");
@@ -113,10 +138,12 @@ Status ShellySwitch::SetConfig(const std::string &config_json,
       "{name: %Q, svc_type: %d, hk_state_inverted: %B, valve_type: %d, "
       "in_mode: %d, in_inverted: %B, "
       "initial_state: %d, "
-      "auto_off: %B, auto_off_delay: %lf, state_led_en: %d, out_inverted: %B}",
+      "auto_off: %B, auto_off_delay: %lf, state_led_en: %d, out_inverted: %B, "
+      "max_power: %f, max_current: %f, overload_hold_ms: %d}",
       &cfg.name, &cfg.svc_type, &cfg.hk_state_inverted, &cfg.valve_type,
       &cfg.in_mode, &in_inverted, &cfg.initial_state, &cfg.auto_off,
-      &cfg.auto_off_delay, &cfg.state_led_en, &cfg.out_inverted);
+      &cfg.auto_off_delay, &cfg.state_led_en, &cfg.out_inverted,
+      &cfg.max_power, &cfg.max_current, &cfg.overload_hold_ms);
   mgos::ScopedCPtr name_owner((void *) cfg.name);
   // Validation.
   if (cfg.name != nullptr && strlen(cfg.name) > 64) {
@@ -149,6 +176,16 @@ Status ShellySwitch::SetConfig(const std::string &config_json,
        cfg.state_led_en != 1)) {
     return mgos::Errorf(STATUS_INVALID_ARGUMENT, "invalid %s", "state_led_en");
   }
+  if (cfg.max_power < 0) {
+    return mgos::Errorf(STATUS_INVALID_ARGUMENT, "invalid %s", "max_power");
+  }
+  if (cfg.max_current < 0) {
+    return mgos::Errorf(STATUS_INVALID_ARGUMENT, "invalid %s", "max_current");
+  }
+  if (cfg.overload_hold_ms < 0) {
+    return mgos::Errorf(STATUS_INVALID_ARGUMENT, "invalid %s",
+                        "overload_hold_ms");
+  }
   // Now copy over.
   if (cfg_->name != nullptr && strcmp(cfg_->name, cfg.name) != 0) {
     mgos_conf_set_str(&cfg_->name, cfg.name);
@@ -195,6 +232,19 @@ Status ShellySwitch::SetConfig(const std::string &config_json,
     cfg_->out_inverted = cfg.out_inverted;
     *restart_required = true;
   }
+  bool prot_was_enabled = (cfg_->max_power > 0 || cfg_->max_current > 0);
+  cfg_->max_power = cfg.max_power;
+  cfg_->max_current = cfg.max_current;
+  cfg_->overload_hold_ms = cfg.overload_hold_ms;
+  if (protection_ != nullptr) {
+    PMProtection::Limits limits;
+    limits.max_power_w = cfg_->max_power;
+    limits.max_current_a = cfg_->max_current;
+    limits.hold_ms = cfg_->overload_hold_ms;
+    protection_->SetLimits(limits);
+    // Fault characteristic is only present when protection is enabled.
+    if (protection_->IsEnabled() != prot_was_enabled) *restart_required = true;
+  }
   return Status::OK();
 }
 
@@ -232,6 +282,15 @@ Status ShellySwitch::Init() {
     in_handler_ids_.push_back(handler_id);
   }
   out_->SetInvert(cfg_->out_inverted);
+  if (out_pm_ != nullptr) {
+    protection_.reset(new PMProtection(
+        out_pm_, out_, std::bind(&ShellySwitch::ProtectionTripCB, this, _1)));
+    PMProtection::Limits limits;
+    limits.max_power_w = cfg_->max_power;
+    limits.max_current_a = cfg_->max_current;
+    limits.hold_ms = cfg_->overload_hold_ms;
+    protection_->SetLimits(limits);
+  }
   bool should_restore = (cfg_->initial_state == (int) InitialState::kLast);
   if (IsSoftReboot()) should_restore = true;
   if (should_restore) {
@@ -266,6 +325,10 @@ bool ShellySwitch::GetOutputState() const {
 
 void ShellySwitch::SetOutputState(bool new_state, const char *source) {
   bool cur_state = out_->GetState();
+  if (new_state && protection_ != nullptr && protection_->IsTripped()) {
+    protection_->Reset();
+    if (fault_char_ != nullptr) fault_char_->RaiseEvent();
+  }
   out_->SetState(new_state, source);
   if (led_out_ != nullptr) {
     led_out_->SetState((cfg_->state_led_en == 1 && new_state), source);
@@ -406,21 +469,60 @@ void ShellySwitch::AddPowerMeter(uint16_t *iid) {
       true /* supports_notification */, nullptr, "eve-total-power-consumption");
   AddChar(total_power_char_);
 
-  // Fuzz the interval a little bit to avoid many devices reporting at once.
-  power_timer_.Reset(mgos_rand_range(4500, 5500), MGOS_TIMER_REPEAT);
+  // Characteristics have 1 W and 1 kWh resolution, deltas are set so that
+  // crossing to the next value is not missed. Fuzz the interval a little bit
+  // to avoid many devices reporting at once.
+  PowerMeter::HandlerOpts opts;
+  opts.power_delta_w = 0.5;
+  opts.energy_delta_wh = 10;
+  opts.min_interval_ms = mgos_rand_range(1000, 1500);
+  pm_handler_ = out_pm_->AddHandler(
+      std::bind(&ShellySwitch::PowerMeterHandler, this, _1), opts);
+
+  // Status Fault is set while the output is off due to overload.
+  if (protection_ != nullptr && protection_->IsEnabled()) {
+    fault_char_ = new mgos::hap::UInt8Characteristic(
+        SHELLY_HAP_IID_BASE_PM_PROTECTION + id(),
+        &kHAPCharacteristicType_StatusFault, 0, 1, 1,
+        [this](HAPAccessoryServerRef *,
+               const HAPUInt8CharacteristicReadRequest *, uint8_t *value) {
+          *value = protection_->IsTripped();
+          return kHAPError_None;
+        },
+        true /* supports_notification */, nullptr,
+        kHAPCharacteristicDebugDescription_StatusFault);
+    AddChar(fault_char_);
+  }
+}
+
+void ShellySwitch::AddEveHistory() {
+  if (out_pm_ == nullptr || !cfg_->eve_history) return;
+  PMHistory *hist = FindPMHistory(out_pm_->id());
+  if (hist == nullptr) return;
+  std::unique_ptr<hap::EveHistoryService> eh(
+      new hap::EveHistoryService(id(), hist));
+  if (!eh->Init().ok()) return;
+  eve_history_ = std::move(eh);
 }
 
-void ShellySwitch::PowerMeterTimerCB() {
-  auto current_power = out_pm_->GetPowerW();
-  auto current_total_power = out_pm_->GetEnergyWH();
+mgos::hap::Service *ShellySwitch::GetEveHistoryService() const {
+  return eve_history_.get();
+}
+
+void ShellySwitch::ProtectionTripCB(PMProtection::TripReason reason) {
+  // Output is already off, bring the rest of the state in sync.
+  SetOutputState(false, PMProtection::TripReasonStr(reason));
+  if (fault_char_ != nullptr) fault_char_->RaiseEvent();
+}
 
-  if (current_power.ok() && current_power.ValueOrDie() != last_power_) {
-    last_power_ = current_power.ValueOrDie();
+void ShellySwitch::PowerMeterHandler(const PowerMeter::Measurement &m) {
+  uint16_t power = m.power_w, total_power = m.energy_wh / 1000.0f;
+  if (power != last_power_) {
+    last_power_ = power;
     power_char_->RaiseEvent();
   }
-  if (current_total_power.ok() &&
-      current_total_power.ValueOrDie() != last_total_power_) {
-    last_total_power_ = current_total_power.ValueOrDie();
+  if (total_power != last_total_power_) {
+    last_total_power_ = total_power;
     total_power_char_->RaiseEvent();
   }
 }
@@ -27,9 +27,11 @@
 #include "mgos_hap_service.hpp"
 #include "shelly_common.hpp"
 #include "shelly_component.hpp"
+#include "shelly_hap_eve_history.hpp"
 #include "shelly_input.hpp"
 #include "shelly_output.hpp"
 #include "shelly_pm.hpp"
+#include "shelly_pm_protection.hpp"
 
 namespace shelly {
 
@@ -57,6 +59,9 @@ class ShellySwitch : public Component, public mgos::hap::Service {
   // Additional input(s) are or'ed with the primary one.
   void AddInput(Input *in);
 
+  // Eve history service to be added to the accessory, if any.
+  mgos::hap::Service *GetEveHistoryService() const;
+
  protected:
   bool GetInputState() const;
 
@@ -81,12 +86,17 @@ class ShellySwitch : public Component, public mgos::hap::Service {
   ShellySwitch(const ShellySwitch &other) = delete;
 
   void AddPowerMeter(uint16_t *iid);
-  void PowerMeterTimerCB();
-  mgos::Timer power_timer_;
+  void AddEveHistory();
+  void PowerMeterHandler(const PowerMeter::Measurement &m);
+  void ProtectionTripCB(PMProtection::TripReason reason);
+  PowerMeter::HandlerID pm_handler_ = PowerMeter::kInvalidHandlerID;
   mgos::hap::Characteristic *power_char_ = nullptr;
   mgos::hap::Characteristic *total_power_char_ = nullptr;
-  float last_power_ = 0.0f;
-  float last_total_power_ = 0.0f;
+  uint16_t last_power_ = 0;
+  uint16_t last_total_power_ = 0;
+  std::unique_ptr<hap::EveHistoryService> eve_history_;
+  std::unique_ptr<PMProtection> protection_;
+  mgos::hap::Characteristic *fault_char_ = nullptr;
 };
 
 }  // namespace shelly
@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shelly_wc_trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace shelly {
+
+bool WCEndOfTravel(const WCPowerParams &p, float power_w, int elapsed_ms) {
+  return (power_w < p.idle_power_thr && elapsed_ms > p.max_ramp_up_time_ms);
+}
+
+bool WCRampUpDone(const WCPowerParams &p, float power_w) {
+  return (power_w >= p.move_power * 0.75f);
+}
+
+float WCObstructionPowerW(const WCPowerParams &p) {
+  return p.move_power * p.obstruction_power_coeff;
+}
+
+float WCBindingPowerW(const WCPowerParams &p) {
+  // A third of the way to the obstruction threshold, 1.5x at the default 2.5.
+  return p.move_power * (1 + (p.obstruction_power_coeff - 1) / 3);
+}
+
+// EMA weight of the new sample.
+static constexpr float kEMAAlpha = 0.3f;
+
+// static
+const char *WCPowerStats::TripStr(Trip trip) {
+  switch (trip) {
+    case Trip::kNone:
+      return "none";
+    case Trip::kOverpower:
+      return "overpower";
+    case Trip::kBinding:
+      return "binding";
+    case Trip::kRising:
+      return "rising";
+  }
+  return "???";
+}
+
+void WCPowerStats::Reset(const WCPowerParams &params) {
+  params_ = params;
+  num_samples_ = 0;
+  ema_ = var_ = slope_ = rise_w_ = 0;
+  num_over_ = num_elevated_ = 0;
+  elevated_begin_ = 0;
+  trip_ = Trip::kNone;
+}
+
+WCPowerStats::Trip WCPowerStats::Add(int64_t ts, float power_w) {
+  window_[num_samples_ % kWindowSize] = {ts, power_w};
+  if (num_samples_ == 0) {
+    ema_ = power_w;
+  } else {
+    float d = power_w - ema_;
+    ema_ += kEMAAlpha * d;
+    var_ = (1 - kEMAAlpha) * (var_ + kEMAAlpha * d * d);
+  }
+  num_samples_++;
+  UpdateSlope();
+  if (trip_ != Trip::kNone || params_.move_power <= 0) return trip_;
+  const float obst_w = WCObstructionPowerW(params_);
+  num_over_ = (power_w > obst_w ? num_over_ + 1 : 0);
+  if (num_over_ >= kOverpowerSamples) {
+    trip_ = Trip::kOverpower;
+    return trip_;
+  }
+  // Noise must not be able to account for the excess.
+  if (ema_ - stddev() <= WCBindingPowerW(params_)) {
+    num_elevated_ = 0;
+    return trip_;
+  }
+  if (num_elevated_ == 0) elevated_begin_ = ts;
+  num_elevated_++;
+  const float duration_s = params_.obstruction_duration_ms / 1000.0f;
+  const float elevated_s = (ts - elevated_begin_) / 1000000.0f;
+  if (num_elevated_ >= kWindowSize || elevated_s >= duration_s) {
+    trip_ = Trip::kBinding;
+  } else if (rise_w_ > 2 * stddev() &&  // Trend stands out of the noise.
+             ema_ + slope_ * duration_s >= obst_w) {
+    trip_ = Trip::kRising;
+  }
+  return trip_;
+}
+
+WCPowerStats::Trip WCPowerStats::trip() const {
+  return trip_;
+}
+
+int WCPowerStats::num_samples() const {
+  return num_samples_;
+}
+
+float WCPowerStats::ema() const {
+  return ema_;
+}
+
+float WCPowerStats::stddev() const {
+  return std::sqrt(var_);
+}
+
+float WCPowerStats::slope() const {
+  return slope_;
+}
+
+void WCPowerStats::UpdateSlope() {
+  if (num_samples_ < kWindowSize) {
+    slope_ = rise_w_ = 0;
+    return;
+  }
+  // Oldest sample is the next to be overwritten.
+  const int64_t t0 = window_[num_samples_ % kWindowSize].ts;
+  float st = 0, sp = 0, stt = 0, stp = 0;
+  for (const auto &s : window_) {
+    float t = (s.ts - t0) / 1000000.0f;
+    st += t;
+    sp += s.p;
+    stt += t * t;
+    stp += t * s.p;
+  }
+  float den = kWindowSize * stt - st * st;
+  slope_ = (den > 0 ? (kWindowSize * stp - st * sp) / den : 0);
+  const int64_t t1 = window_[(num_samples_ - 1) % kWindowSize].ts;
+  rise_w_ = slope_ * (t1 - t0) / 1000000.0f;
+}
+
+WCPowerTrace::WCPowerTrace(int max_entries) : max_entries_(max_entries) {
+}
+
+WCPowerTrace::Kind WCPowerTrace::kind() const {
+  return kind_;
+}
+
+const WCPowerParams &WCPowerTrace::params() const {
+  return params_;
+}
+
+int64_t WCPowerTrace::start() const {
+  return start_;
+}
+
+int WCPowerTrace::num_dropped() const {
+  return num_dropped_;
+}
+
+const std::vector<WCPowerTrace::Entry> &WCPowerTrace::entries() const {
+  return entries_;
+}
+
+void WCPowerTrace::Begin(Kind kind, const WCPowerParams &params,
+                         int64_t start) {
+  kind_ = kind;
+  params_ = params;
+  start_ = last_ts_ = start;
+  num_dropped_ = 0;
+  entries_.clear();
+  entries_.reserve(max_entries_);
+}
+
+void WCPowerTrace::AddState(int64_t ts, int state) {
+  Entry e;
+  e.p_dw = 0;
+  e.state = state;
+  e.dir = 0;
+  Add(ts, e);
+}
+
+void WCPowerTrace::AddSample(int64_t ts, int state, int dir, float power_w) {
+  Entry e;
+  e.p_dw = std::min(std::max(std::lround(power_w * 10), 0L), 0xffffL);
+  e.state = state;
+  e.dir = dir;
+  Add(ts, e);
+}
+
+void WCPowerTrace::Add(int64_t ts, const Entry &e) {
+  if (kind_ == Kind::kNone) return;
+  if ((int) entries_.size() >= max_entries_) {
+    num_dropped_++;
+    return;
+  }
+  int64_t dt_ms = std::max((ts - last_ts_) / 1000, (int64_t) 0);
+  entries_.push_back(e);
+  entries_.back().dt_ms = std::min(dt_ms, (int64_t) 0xffff);
+  // Keep the rounding error from accumulating.
+  last_ts_ += entries_.back().dt_ms * 1000;
+}
+
+namespace {
+
+struct Sample {
+  int t_ms;  // Since the beginning of the pass.
+  float p;
+};
+
+void AnalyzePass(const WCPowerParams &params, const std::vector<Sample> &ss,
+                 WCTracePass *res) {
+  res->num_samples = ss.size();
+  res->duration_ms = ss.back().t_ms;
+  // Replay the calibration pass: every sample is averaged until the end of
+  // travel is detected.
+  float p_sum = 0;
+  size_t end = ss.size();
+  for (size_t i = 0; i < ss.size(); i++) {
+    p_sum += ss[i].p;
+    if (WCEndOfTravel(params, ss[i].p, ss[i].t_ms)) {
+      res->travel_ms = ss[i].t_ms;
+      end = i;
+      break;
+    }
+  }
+  res->mean_power_w = p_sum / std::min(end + 1, ss.size());
+  // Steady power is measured over the middle half of the powered interval,
+  // away from ramp up and stop transients.
+  int first_on = -1, last_on = -1;
+  for (size_t i = 0; i < end; i++) {
+    if (ss[i].p < params.idle_power_thr) continue;
+    if (first_on < 0) first_on = ss[i].t_ms;
+    last_on = ss[i].t_ms;
+  }
+  if (first_on < 0) return;
+  const int q = (last_on - first_on) / 4;
+  float steady_sum = 0, on_sum = 0;
+  int steady_num = 0, on_num = 0;
+  for (size_t i = 0; i < end; i++) {
+    if (ss[i].p < params.idle_power_thr) continue;
+    on_sum += ss[i].p;
+    on_num++;
+    if (ss[i].t_ms < first_on + q || ss[i].t_ms > last_on - q) continue;
+    steady_sum += ss[i].p;
+    steady_num++;
+  }
+  res->steady_power_w =
+      (steady_num > 0 ? steady_sum / steady_num : on_sum / on_num);
+  WCPowerParams sp = params;
+  sp.move_power = res->steady_power_w;
+  for (size_t i = 0; i < end; i++) {
+    if (res->ramp_up_ms < 0) {
+      if (!WCRampUpDone(sp, ss[i].p)) continue;
+      res->ramp_up_ms = ss[i].t_ms;
+    }
+    res->peak_power_w = std::max(res->peak_power_w, ss[i].p);
+  }
+  const WCPowerParams &op = (params.move_power > 0 ? params : sp);
+  res->obst_power_w = WCObstructionPowerW(op);
+  res->obst_margin_w = res->obst_power_w - res->peak_power_w;
+  // Replay obstruction detection: it starts with the sample after ramp up.
+  WCPowerStats stats;
+  stats.Reset(op);
+  bool moving = false;
+  for (size_t i = 0; i < end; i++) {
+    if (!moving) {
+      moving = WCRampUpDone(op, ss[i].p);
+      continue;
+    }
+    if (stats.Add(ss[i].t_ms * 1000LL, ss[i].p) != WCPowerStats::Trip::kNone) {
+      res->obst_trip_ms = ss[i].t_ms;
+      res->obst_trip = stats.trip();
+      break;
+    }
+  }
+}
+
+}  // namespace
+
+std::vector<WCTracePass> AnalyzeWCPowerTrace(const WCPowerTrace &trace) {
+  std::vector<WCTracePass> res;
+  // A pass is a run of samples for the same direction, timed from the state
+  // change that preceded it.
+  WCTracePass pass;
+  std::vector<Sample> ss;
+  int t_ms = 0, state_ms = 0;
+  auto flush = [&]() {
+    if (ss.empty()) return;
+    AnalyzePass(trace.params(), ss, &pass);
+    res.push_back(pass);
+    ss.clear();
+  };
+  for (const auto &e : trace.entries()) {
+    t_ms += e.dt_ms;
+    if (e.dir == 0) {
+      state_ms = t_ms;
+      continue;
+    }
+    if (!ss.empty() && e.dir != pass.dir) flush();
+    if (ss.empty()) {
+      pass = WCTracePass();
+      pass.state = e.state;
+      pass.dir = e.dir;
+      pass.start_ms = state_ms;
+    }
+    ss.push_back({t_ms - pass.start_ms, e.p_dw / 10.0f});
+  }
+  flush();
+  return res;
+}
+
+}  // namespace shelly
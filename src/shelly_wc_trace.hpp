@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// NB: This file is also built on the host by tools/wc_trace_analyzer,
+// it must not depend on Mongoose OS.
+
+namespace shelly {
+
+// Parameters of the window covering power model, from mgos_config_wc.
+struct WCPowerParams {
+  float idle_power_thr = 0;
+  float move_power = 0;
+  int max_ramp_up_time_ms = 0;
+  float obstruction_power_coeff = 0;
+  int obstruction_duration_ms = 0;
+};
+
+// Motor decisions based on power, shared by WindowCovering and the analyzer.
+
+// A calibration pass has reached the end of travel.
+bool WCEndOfTravel(const WCPowerParams &p, float power_w, int elapsed_ms);
+// Motor has reached the moving power after start.
+bool WCRampUpDone(const WCPowerParams &p, float power_w);
+// Power above which the motor is considered obstructed.
+float WCObstructionPowerW(const WCPowerParams &p);
+// Power above which the motor is considered binding if it persists.
+float WCBindingPowerW(const WCPowerParams &p);
+
+// Rolling statistics of the motor power during a movement, for obstruction
+// detection. Level is tracked by an EMA, noise by the exponentially weighted
+// variance around it and trend by the least squares slope over the last
+// kWindowSize samples. Trips, relative to the calibrated move power:
+//  - overpower: kOverpowerSamples consecutive samples above the obstruction
+//    threshold; single spikes are ignored;
+//  - binding: EMA above the binding threshold by more than the noise for
+//    the whole window or obstruction_duration_ms, whichever is shorter;
+//  - rising: EMA above the binding threshold and trending to reach the
+//    obstruction threshold within obstruction_duration_ms.
+class WCPowerStats {
+ public:
+  static constexpr int kWindowSize = 8;
+  static constexpr int kOverpowerSamples = 3;
+
+  enum class Trip {
+    kNone = 0,
+    kOverpower = 1,
+    kBinding = 2,
+    kRising = 3,
+  };
+
+  static const char *TripStr(Trip trip);
+
+  void Reset(const WCPowerParams &params);
+  // Returns the trip, once one has happened it sticks until reset.
+  Trip Add(int64_t ts, float power_w);
+
+  Trip trip() const;
+  int num_samples() const;  // Since reset.
+  float ema() const;
+  float stddev() const;
+  float slope() const;  // W/s, 0 until the window is full.
+
+ private:
+  struct Sample {
+    int64_t ts;
+    float p;
+  };
+
+  void UpdateSlope();
+
+  WCPowerParams params_;
+  Sample window_[kWindowSize];
+  int num_samples_ = 0;
+  float ema_ = 0;
+  float var_ = 0;
+  float slope_ = 0;
+  float rise_w_ = 0;  // Over the window, according to the slope.
+  int num_over_ = 0;          // Consecutive samples above obstruction power.
+  int num_elevated_ = 0;      // Consecutive samples above binding power.
+  int64_t elevated_begin_ = 0;
+  Trip trip_ = Trip::kNone;
+};
+
+// Timestamped power samples of a single calibration or movement.
+//
+// Samples are stored as 6 byte entries with the time delta from the previous
+// one, so a full calibration fits in ~3K. Once the buffer
+// is full further samples are counted but not stored. State changes are
+// recorded as entries with dir = 0 and no power.
+class WCPowerTrace {
+ public:
+  enum class Kind {
+    kNone = 0,
+    kCalibration = 1,
+    kMove = 2,
+  };
+
+  struct Entry {
+    uint16_t dt_ms;  // Since the previous entry, saturated.
+    uint16_t p_dw;   // Power, 0.1 W.
+    uint8_t state;   // WindowCovering state the sample was taken in.
+    uint8_t dir;     // Direction the power was measured for, 0 - state change.
+  };
+
+  explicit WCPowerTrace(int max_entries);
+
+  Kind kind() const;
+  const WCPowerParams &params() const;
+  int64_t start() const;  // Uptime, microseconds.
+  int num_dropped() const;
+  const std::vector<Entry> &entries() const;
+
+  // Starts a new trace, buffer is allocated on first use.
+  void Begin(Kind kind, const WCPowerParams &params, int64_t start);
+  void AddState(int64_t ts, int state);
+  void AddSample(int64_t ts, int state, int dir, float power_w);
+
+ private:
+  void Add(int64_t ts, const Entry &e);
+
+  const int max_entries_;
+  Kind kind_ = Kind::kNone;
+  WCPowerParams params_;
+  int64_t start_ = 0;
+  int64_t last_ts_ = 0;
+  int num_dropped_ = 0;
+  std::vector<Entry> entries_;
+};
+
+// Power profile of one state of a trace in which the motor was driven,
+// e.g. one calibration pass.
+struct WCTracePass {
+  int state = 0;  // Of the first sample.
+  int dir = 0;
+  // Times are relative to the state change that preceded the first sample,
+  // e.g. the start of a calibration pass.
+  int start_ms = 0;     // Since the beginning of the trace.
+  int duration_ms = 0;  // To the last sample.
+  int num_samples = 0;
+  int ramp_up_ms = -1;  // To reach WCRampUpDone() at steady power.
+  int travel_ms = -1;   // To WCEndOfTravel(), -1 - not reached.
+  // Up to and including the end of travel, as calibration computes it.
+  float mean_power_w = 0;
+  // Mean over the middle half of the time the motor was drawing power.
+  float steady_power_w = 0;
+  // Peak between ramp up and end of travel.
+  float peak_power_w = 0;
+  float obst_power_w = 0;   // Obstruction threshold, see below.
+  float obst_margin_w = 0;  // Obstruction threshold - peak power.
+  // When WCPowerStats would trip after ramp up, -1 - it wouldn't.
+  int obst_trip_ms = -1;
+  WCPowerStats::Trip obst_trip = WCPowerStats::Trip::kNone;
+};
+
+// Replays the trace through the power model. The obstruction threshold is
+// based on the configured move power, or the steady power if not calibrated.
+std::vector<WCTracePass> AnalyzeWCPowerTrace(const WCPowerTrace &trace);
+
+}  // namespace shelly
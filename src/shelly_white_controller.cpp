@@ -22,7 +22,7 @@
 namespace shelly {
 
 WhiteController::WhiteController(struct mgos_config_lb *cfg, Output *out_w)
-    : LightBulbController<StateW>(cfg), out_w_(out_w) {
+    : LightBulbController<StateW>(cfg, {out_w}) {
 }
 
 WhiteController::~WhiteController() {
@@ -38,10 +38,6 @@ void WhiteController::ReportTransition(const StateW &next, const StateW &prev) {
   LOG(LL_INFO, ("Output 1: %.2f => %.2f", prev.w, next.w));
 }
 
-void WhiteController::UpdatePWM(const StateW &state) {
-  out_w_->SetStatePWM(state.w, "transition");
-}
-
 std::string StateW::ToString() const {
   return mgos::SPrintf("[w=%.2f]", w);
 }
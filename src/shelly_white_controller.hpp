@@ -27,12 +27,16 @@ namespace shelly {
 struct StateW {
   float w;
 
-  StateW operator+(const StateW &other) const {
-    return {.w = w + other.w};
+  static constexpr int kNumChannels = 1;
+
+  float &operator[](int ch) {
+    (void) ch;
+    return w;
   }
 
-  StateW operator*(float a) const {
-    return {.w = a * w};
+  float operator[](int ch) const {
+    (void) ch;
+    return w;
   }
 
   std::string ToString() const;
@@ -49,10 +53,7 @@ class WhiteController : public LightBulbController<StateW> {
   }
 
  private:
-  Output *const out_w_;
-
   StateW ConfigToState(const struct mgos_config_lb &cfg) const final;
   void ReportTransition(const StateW &prev, const StateW &next) final;
-  void UpdatePWM(const StateW &state) final;
 };
 }  // namespace shelly
@@ -0,0 +1,402 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Adaptive lighting benchmark: looks up 24 hour curves shaped like the ones
+// the Home app writes with AdaptiveLightingCurve, as AdjustColorTemp() does
+// on every update and manual brightness change, and checks the result
+// against the linear scan in floating point it replaced. Then stores curves
+// as the transition control write handler does, counting heap use, and
+// throws a corpus of random and malformed curves at it.
+
+#include <malloc.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "shelly_adaptive_lighting_curve.hpp"
+
+namespace {
+
+using shelly::hap::AdaptiveLightingCurve;
+using shelly::hap::TransitionCurveArena;
+using shelly::hap::transitionEntryType;
+
+constexpr uint32_t kHourMs = 3600 * 1000;
+// Update interval the Home app asks for.
+constexpr uint32_t kUpdateIntervalMs = 60 * 1000;
+// Range of the brightness adjustment multiplier.
+constexpr int kMinMultiplier = 10, kMaxMultiplier = 100;
+
+struct CurveSpec {
+  const char *name;
+  int step_min;      // Between entries.
+  bool night_holds;  // Entries during the night hold their value.
+  float start_hour;  // Curves start at the time they are written.
+};
+
+const CurveSpec kCurves[] = {
+    {"hourly", 60, false, 12.5f},
+    {"15min", 15, false, 7.25f},
+    {"10min+hold", 10, true, 21.f},
+    {"8min+hold", 8, true, 3.f},
+};
+
+// 0 at night, 1 during the day, with a 2 h sunrise and a 3 h sunset.
+float Daylight(float h) {
+  h = std::fmod(h, 24.f);
+  float x;
+  if (h < 6.5f || h >= 21.f) return 0;
+  if (h < 8.5f) {
+    x = (h - 6.5f) / 2;
+  } else if (h < 18.f) {
+    return 1;
+  } else {
+    x = 1 - (h - 18.f) / 3;
+  }
+  return (1 - std::cos(x * static_cast<float>(M_PI))) / 2;
+}
+
+// Warm (400 mired) at night, cool (153 mired) during the day. Brighter is
+// cooler during the day.
+std::vector<transitionEntryType> MakeCurve(const CurveSpec &spec) {
+  std::vector<transitionEntryType> res;
+  const uint32_t step_ms = spec.step_min * 60 * 1000;
+  for (uint32_t t = 0; t <= 24 * kHourMs; t += step_ms) {
+    const float h = spec.start_hour + static_cast<float>(t) / kHourMs;
+    const float d = Daylight(h);
+    transitionEntryType e = {};
+    e.value = 400 - (400 - 153) * d;
+    e.adjustmentFactor = -0.4f * d;
+    e.offset = (t == 0 ? 0 : step_ms);
+    if (spec.night_holds && t != 0 && d == 0) {
+      e.offset = step_ms / 4;
+      e.duration = step_ms - e.offset;
+      e.durationPresent = true;
+    }
+    res.push_back(e);
+  }
+  return res;
+}
+
+// AdjustColorTemp() before the curve was compiled: a linear scan
+// accumulating offsets, then float interpolation.
+bool RefEval(const std::vector<transitionEntryType> &table, uint32_t offset,
+             int32_t multiplier, int *result) {
+  uint32_t offset_next = 0, offset_curr = 0;
+  transitionEntryType curr = table[0], next = table[0];
+  for (const auto &val : table) {
+    offset_next += val.offset;
+    if (val.durationPresent) offset_next += val.duration;
+    next = val;
+    if (offset <= offset_next) break;
+    curr = val;
+    offset_curr = offset_next;
+  }
+  const bool in_curve = (offset <= offset_next);
+  float duration = std::max<float>(offset_next - offset_curr, 1);
+  float elapsed = offset - offset_curr;
+  float percentage = elapsed / duration;
+  if (curr.durationPresent) {
+    if (curr.duration > elapsed) {
+      percentage = 0;
+    } else {
+      elapsed -= curr.duration;
+      duration -= curr.duration;
+      percentage = elapsed / duration;
+    }
+  }
+  percentage = std::min(std::max(percentage, 0.f), 1.f);
+  float val_interp = curr.value + (next.value - curr.value) * percentage;
+  float adj_interp =
+      curr.adjustmentFactor +
+      (next.adjustmentFactor - curr.adjustmentFactor) * percentage;
+  *result = val_interp + adj_interp * multiplier;
+  return in_curve;
+}
+
+struct Lookup {
+  uint32_t offset;
+  int32_t multiplier;
+};
+
+bool BenchCurve(const CurveSpec &spec) {
+  const std::vector<transitionEntryType> table = MakeCurve(spec);
+  AdaptiveLightingCurve curve;
+  constexpr int kNumCompiles = 1000;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < kNumCompiles; i++) {
+    curve.Compile(table.data(), table.size());
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  const double compile_us =
+      std::chrono::duration<double, std::micro>(t1 - t0).count() /
+      kNumCompiles;
+
+  // Periodic updates through the whole curve and a bit past its end, then
+  // manual brightness changes at random times.
+  std::vector<Lookup> lookups;
+  for (uint32_t t = 0; t <= curve.duration() + 2 * kUpdateIntervalMs;
+       t += kUpdateIntervalMs) {
+    lookups.push_back({t, 50});
+  }
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<uint32_t> offset_dist(
+      0, curve.duration() + curve.duration() / 20);
+  std::uniform_int_distribution<int32_t> mult_dist(kMinMultiplier,
+                                                   kMaxMultiplier);
+  for (int i = 0; i < 100000; i++) {
+    lookups.push_back({offset_dist(rng), mult_dist(rng)});
+  }
+
+  int max_err = 0, num_end_mismatch = 0;
+  for (const Lookup &l : lookups) {
+    int want, got;
+    bool want_in = RefEval(table, l.offset, l.multiplier, &want);
+    bool got_in = curve.Eval(l.offset, l.multiplier, &got);
+    max_err = std::max(max_err, std::abs(got - want));
+    if (got_in != want_in) num_end_mismatch++;
+  }
+
+  // Sums go to volatile so that the loops are not optimized out.
+  volatile int sink = 0;
+  constexpr int kNumRuns = 10;
+  auto t2 = std::chrono::steady_clock::now();
+  for (int r = 0; r < kNumRuns; r++) {
+    int sum = 0;
+    for (const Lookup &l : lookups) {
+      int res;
+      curve.Eval(l.offset, l.multiplier, &res);
+      sum += res;
+    }
+    sink = sum;
+  }
+  auto t3 = std::chrono::steady_clock::now();
+  for (int r = 0; r < kNumRuns; r++) {
+    int sum = 0;
+    for (const Lookup &l : lookups) {
+      int res;
+      RefEval(table, l.offset, l.multiplier, &res);
+      sum += res;
+    }
+    sink = sum;
+  }
+  auto t4 = std::chrono::steady_clock::now();
+  (void) sink;
+  const double n = (double) kNumRuns * lookups.size();
+  const double new_ns =
+      std::chrono::duration<double, std::nano>(t3 - t2).count() / n;
+  const double old_ns =
+      std::chrono::duration<double, std::nano>(t4 - t3).count() / n;
+  printf("%-11s %7zu %7.1f %9.1f %9.1f %6.1fx %7d %7d\n", spec.name,
+         table.size(), compile_us, new_ns, old_ns, old_ns / new_ns, max_err,
+         num_end_mismatch);
+  return (max_err <= 1 && num_end_mismatch == 0);
+}
+
+// Heap use, counted by the operator new below.
+struct HeapStats {
+  size_t num_allocs = 0;
+  size_t cur = 0;
+  size_t peak = 0;
+} g_heap;
+
+// A write as the transition control handler stores it: entries come one by
+// one from the TLV reader, then the curve is compiled.
+template <class T>
+bool StoreCurve(const std::vector<transitionEntryType> &payload, T *table,
+                AdaptiveLightingCurve *curve);
+
+// Before: a vector grown per entry, as needed.
+template <>
+bool StoreCurve(const std::vector<transitionEntryType> &payload,
+                std::vector<transitionEntryType> *table,
+                AdaptiveLightingCurve *curve) {
+  table->clear();
+  for (const auto &e : payload) table->push_back(e);
+  return curve->Compile(table->data(), table->size());
+}
+
+template <>
+bool StoreCurve(const std::vector<transitionEntryType> &payload,
+                TransitionCurveArena *table, AdaptiveLightingCurve *curve) {
+  table->clear();
+  for (const auto &e : payload) {
+    if (!table->push_back(e)) return false;
+  }
+  return curve->Compile(table->begin(), table->size());
+}
+
+// When the schedule ends.
+void Release(std::vector<transitionEntryType> *table,
+             AdaptiveLightingCurve *curve) {
+  std::vector<transitionEntryType>().swap(*table);
+  curve->Clear();
+}
+
+void Release(TransitionCurveArena *table, AdaptiveLightingCurve *curve) {
+  table->release();
+  curve->Clear();
+}
+
+// Returns the heap still in use once released.
+template <class T>
+size_t BenchStore(const char *name,
+                const std::vector<std::vector<transitionEntryType>> &corpus) {
+  constexpr int kNumWrites = 1000;
+  T table;
+  AdaptiveLightingCurve curve;
+  const HeapStats before = g_heap;
+  g_heap.peak = g_heap.cur;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < kNumWrites; i++) {
+    StoreCurve(corpus[i % corpus.size()], &table, &curve);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  const size_t num_allocs = g_heap.num_allocs - before.num_allocs;
+  const size_t peak = g_heap.peak - before.cur;
+  Release(&table, &curve);
+  const size_t left = g_heap.cur - before.cur;
+  printf("%-7s %9.2f %9zu %9zu %9zu\n", name,
+         std::chrono::duration<double, std::micro>(t1 - t0).count() /
+             kNumWrites,
+         num_allocs, peak, left);
+  return left;
+}
+
+bool BenchStores() {
+  std::vector<std::vector<transitionEntryType>> corpus;
+  for (const CurveSpec &spec : kCurves) {
+    corpus.push_back(MakeCurve(spec));
+  }
+  printf("%-7s %9s %9s %9s %9s\n", "store", "us/write", "allocs", "peak B",
+         "left B");
+  BenchStore<std::vector<transitionEntryType>>("vector", corpus);
+  return (BenchStore<TransitionCurveArena>("arena", corpus) == 0);
+}
+
+// Random curves, well formed or not: lengths up to beyond the capacity,
+// non-finite and huge values, offsets and durations up to UINT32_MAX.
+// Stored curves must be accepted if and only if they are valid, must not
+// allocate once the arena is in use, except for segments of a curve longer
+// than any before, and lookups must stay within the range of the values.
+bool FuzzCurves() {
+  constexpr int kNumCases = 20000;
+  const float kSpecials[] = {NAN, INFINITY, -INFINITY, 1e30f, -1e30f, 0};
+  const uint32_t kTimes[] = {0, 1, 60000, 0x7fffffff, UINT32_MAX};
+  std::mt19937 rng(2);
+  TransitionCurveArena table;
+  AdaptiveLightingCurve curve;
+  size_t num_accepted = 0, num_failed = 0, num_allocs = 0, num_grows = 0;
+  size_t max_len = 0;  // Of curves that got as far as compiling.
+  for (int c = 0; c < kNumCases; c++) {
+    std::vector<transitionEntryType> payload(
+        rng() % 4 == 0 ? rng() % (2 * TransitionCurveArena::kMaxEntries)
+                       : rng() % 16);
+    bool valid = (!payload.empty() &&
+                  payload.size() <= TransitionCurveArena::kMaxEntries);
+    float min_v = INFINITY, max_v = -INFINITY;
+    float min_a = INFINITY, max_a = -INFINITY;
+    for (auto &e : payload) {
+      const bool special = (rng() % 64 == 0);
+      e.value = (special ? kSpecials[rng() % 6] : 100 + rng() % 400);
+      e.adjustmentFactor =
+          (rng() % 64 == 0 ? kSpecials[rng() % 6]
+                           : (static_cast<int>(rng() % 200) - 100) / 100.f);
+      e.offset = (rng() % 8 == 0 ? kTimes[rng() % 5] : rng() % 3600000);
+      e.durationPresent = (rng() % 4 == 0);
+      e.duration = (rng() % 8 == 0 ? kTimes[rng() % 5] : rng() % 3600000);
+      valid &= (std::isfinite(e.value) && std::isfinite(e.adjustmentFactor));
+      const float v = std::min(std::max(e.value, -16384.f), 16384.f);
+      const float a = std::min(std::max(e.adjustmentFactor, -16384.f), 16384.f);
+      min_v = std::min(min_v, v);
+      max_v = std::max(max_v, v);
+      min_a = std::min(min_a, a);
+      max_a = std::max(max_a, a);
+    }
+    const size_t allocs_before = g_heap.num_allocs;
+    const bool accepted = StoreCurve(payload, &table, &curve);
+    if (c > 0) num_allocs += g_heap.num_allocs - allocs_before;
+    if (!payload.empty() &&
+        payload.size() <= TransitionCurveArena::kMaxEntries &&
+        payload.size() > max_len) {
+      max_len = payload.size();
+      if (c > 0) num_grows++;
+    }
+    if (accepted != valid) {
+      num_failed++;
+      continue;
+    }
+    if (!accepted) continue;
+    num_accepted++;
+    for (int i = 0; i < 16; i++) {
+      const uint32_t offset =
+          (i == 0 ? 0 : rng() % (curve.duration() + (uint64_t) 2));
+      const int32_t m = rng() % 101;
+      const double lo = min_v + std::min(min_a * m, max_a * m) - 1;
+      const double hi = max_v + std::max(min_a * m, max_a * m) + 1;
+      int res;
+      const bool in_curve = curve.Eval(offset, m, &res);
+      if (in_curve != (offset <= curve.duration()) || res < lo || res > hi) {
+        num_failed++;
+        break;
+      }
+    }
+  }
+  printf("fuzz: %d curves, %zu accepted, %zu failed, %zu allocs (%zu grows)\n",
+         kNumCases, num_accepted, num_failed, num_allocs, num_grows);
+  return (num_failed == 0 && num_allocs <= num_grows);
+}
+
+}  // namespace
+
+// Sizes are those of the host's malloc chunks.
+void *operator new(size_t size) {
+  void *p = malloc(size);
+  if (p == nullptr) throw std::bad_alloc();
+  g_heap.num_allocs++;
+  g_heap.cur += malloc_usable_size(p);
+  g_heap.peak = std::max(g_heap.peak, g_heap.cur);
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  if (p == nullptr) return;
+  g_heap.cur -= malloc_usable_size(p);
+  free(p);
+}
+
+int main(int argc, char **argv) {
+  (void) argc;
+  (void) argv;
+  bool ok = true;
+  printf("%-11s %7s %7s %9s %9s %7s %7s %7s\n", "curve", "entries",
+         "cmp us", "new ns", "old ns", "", "max err", "end err");
+  for (const CurveSpec &spec : kCurves) {
+    ok &= BenchCurve(spec);
+  }
+  printf("\n");
+  ok &= BenchStores();
+  printf("\n");
+  ok &= FuzzCurves();
+  return (ok ? 0 : 1);
+}
@@ -0,0 +1,664 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Light bulb transition benchmark: runs transitions of the white, CCT and
+// RGBW controllers in virtual time and counts timer ticks and SetStatePWM()
+// calls, next to what the engine this replaced would do: a 10 ms timer per
+// controller writing all channels on every tick. Outputs are the PWM mock,
+// which checks that channels of a bulb never change in different periods.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mgos.hpp"
+#include "mgos_sys_config.h"
+
+#include "shelly_cct_controller.hpp"
+#include "shelly_color.hpp"
+#include "shelly_dim_curve.hpp"
+#include "shelly_animation_scheduler.hpp"
+#include "shelly_light_bulb_controller.hpp"
+#include "shelly_light_effect.hpp"
+#include "shelly_mock_pwm.hpp"
+#include "shelly_output.hpp"
+#include "shelly_rgbw_controller.hpp"
+#include "shelly_white_controller.hpp"
+
+namespace {
+
+using shelly::CCTController;
+using shelly::DimCurve;
+using shelly::LightBulbControllerBase;
+using shelly::LightEffect;
+using shelly::MockPWMOutput;
+using shelly::MockPWMTimer;
+using shelly::Output;
+using shelly::OutputGroup;
+using shelly::RGBWController;
+using shelly::Status;
+using shelly::TransitionSpace;
+using shelly::WhiteController;
+
+// Tick period of the previous engine.
+constexpr int kLegacyTickMs = 10;
+// Between writes of a step, HAP writes characteristics back to back.
+constexpr int kWriteGapMs = 5;
+constexpr int kPWMFreq = 400;
+// Of the PWM periods against the millisecond timers.
+constexpr int kPWMPhaseMicros = 37;
+#if CS_PLATFORM == CS_P_ESP8266
+constexpr const char *kPlatform = "esp8266";
+// Latching is one mgos_pwm_set().
+constexpr int kStageMicros = 0;
+constexpr int kLatchMicros = 40;
+#else
+constexpr const char *kPlatform = "esp32";
+// Staging is ledc_set_duty(), latching ledc_update_duty().
+constexpr int kStageMicros = 5;
+constexpr int kLatchMicros = 2;
+#endif
+
+class CountingOutput : public MockPWMOutput {
+ public:
+  CountingOutput(int id, MockPWMTimer *timer) : MockPWMOutput(id, timer) {
+  }
+
+  void LatchPWM() override {
+    const float duty = staged_duty_;
+    MockPWMOutput::LatchPWM();
+    if (duty < 0) return;
+    const int dir = (duty > duty_) - (duty < duty_);
+    if (dir != 0 && dir_ != 0 && dir != dir_) num_reversals_++;
+    if (dir != 0) dir_ = dir;
+    duty_ = duty;
+    num_writes_++;
+  }
+
+  // As last latched.
+  float duty() const {
+    return duty_;
+  }
+  int num_writes() const {
+    return num_writes_;
+  }
+  int num_reversals() const {
+    return num_reversals_;
+  }
+  void ResetDirection() {
+    dir_ = 0;
+  }
+
+ private:
+  float duty_ = 0;
+  int dir_ = 0;
+  int num_writes_ = 0;
+  int num_reversals_ = 0;
+};
+
+// One or more bulbs driven together, e.g. RGBW2 in white mode.
+struct Bulb {
+  std::unique_ptr<MockPWMTimer> timer{new MockPWMTimer(
+      kPWMFreq, kPWMPhaseMicros, kStageMicros, kLatchMicros)};
+  std::vector<std::unique_ptr<CountingOutput>> outs;
+  std::vector<std::unique_ptr<LightBulbControllerBase>> ctls;
+
+  void UpdateOutput(struct mgos_config_lb *cfg) {
+    for (auto &ctl : ctls) ctl->UpdateOutput(cfg, true);
+  }
+
+  int NumWrites() const {
+    int res = 0;
+    for (const auto &out : outs) res += out->num_writes();
+    return res;
+  }
+
+  // Times an output changed direction within a transition.
+  int NumReversals() const {
+    int res = 0;
+    for (const auto &out : outs) res += out->num_reversals();
+    return res;
+  }
+
+  // Of the RGBW outputs, -1 if too dark to tell.
+  float Saturation() const {
+    const float w = outs[3]->duty();
+    const float r = outs[0]->duty() + w, g = outs[1]->duty() + w,
+                b = outs[2]->duty() + w;
+    const float max = std::max(r, std::max(g, b));
+    const float min = std::min(r, std::min(g, b));
+    return (max >= 0.1f ? (max - min) / max : -1);
+  }
+};
+
+typedef std::function<Bulb(struct mgos_config_lb *cfg)> BulbFactory;
+
+struct BulbType {
+  const char *name;
+  bool color;  // RGBW outputs.
+  int transition_space;
+  BulbFactory factory;
+};
+
+Bulb MakeBulb(int num_outs) {
+  Bulb b;
+  for (int i = 0; i < num_outs; i++) {
+    b.outs.emplace_back(new CountingOutput(i + 1, b.timer.get()));
+  }
+  return b;
+}
+
+Bulb MakeRGBW(struct mgos_config_lb *cfg) {
+  Bulb b = MakeBulb(4);
+  b.ctls.emplace_back(new RGBWController(cfg, b.outs[0].get(),
+                                         b.outs[1].get(), b.outs[2].get(),
+                                         b.outs[3].get()));
+  return b;
+}
+
+const BulbType kBulbTypes[] = {
+    {"white", false, 0,
+     [](struct mgos_config_lb *cfg) {
+       Bulb b = MakeBulb(1);
+       b.ctls.emplace_back(new WhiteController(cfg, b.outs[0].get()));
+       return b;
+     }},
+    {"cct", false, 0,
+     [](struct mgos_config_lb *cfg) {
+       Bulb b = MakeBulb(2);
+       b.ctls.emplace_back(
+           new CCTController(cfg, b.outs[0].get(), b.outs[1].get()));
+       return b;
+     }},
+    {"rgbw", true, (int) TransitionSpace::kRGB, MakeRGBW},
+    {"hsv", true, (int) TransitionSpace::kHSV, MakeRGBW},
+    {"4xw", false, 0,
+     [](struct mgos_config_lb *cfg) {
+       Bulb b = MakeBulb(4);
+       for (const auto &out : b.outs) {
+         b.ctls.emplace_back(new WhiteController(cfg, out.get()));
+       }
+       return b;
+     }},
+};
+
+typedef std::function<void(struct mgos_config_lb *cfg)> WriteFn;
+
+// One or more writes, kWriteGapMs apart.
+struct Step {
+  const char *name;
+  int transition_time_ms;
+  // Only brightness changes, no output may change direction.
+  bool brightness_only;
+  std::vector<WriteFn> writes;
+};
+
+const Step kSteps[] = {
+    {"on 2s",
+     2000,
+     true,
+     {[](struct mgos_config_lb *cfg) {
+       cfg->state = 1;
+       cfg->brightness = 100;
+       cfg->hue = 30;
+       cfg->saturation = 60;
+       cfg->color_temperature = 250;
+     }}},
+    {"dim 100->40 1s",
+     1000,
+     true,
+     {[](struct mgos_config_lb *cfg) { cfg->brightness = 40; }}},
+    {"hue/ct 1s",
+     1000,
+     false,
+     {[](struct mgos_config_lb *cfg) {
+       cfg->hue = 200;
+       cfg->color_temperature = 350;
+     }}},
+    {"dim 40->38 1s",
+     1000,
+     true,
+     {[](struct mgos_config_lb *cfg) { cfg->brightness = 38; }}},
+    {"fade 38->5 60s",
+     60000,
+     true,
+     {[](struct mgos_config_lb *cfg) { cfg->brightness = 5; }}},
+    // Scene change from HAP: one write per characteristic.
+    {"scene x4 1s",
+     1000,
+     false,
+     {[](struct mgos_config_lb *cfg) { cfg->brightness = 80; },
+      [](struct mgos_config_lb *cfg) { cfg->hue = 330; },
+      [](struct mgos_config_lb *cfg) { cfg->saturation = 100; },
+      [](struct mgos_config_lb *cfg) { cfg->color_temperature = 150; }}},
+    {"off 500ms",
+     500,
+     true,
+     {[](struct mgos_config_lb *cfg) { cfg->state = 0; }}},
+};
+
+// Final output duty of a bulb after a transition to cfg.
+std::vector<float> Settle(const BulbType &bt, struct mgos_config_lb cfg) {
+  cfg.transition_time = 0;
+  Bulb b = bt.factory(&cfg);
+  b.UpdateOutput(&cfg);
+  sim::RunUntil(sim::Now() + 100 * 1000);
+  std::vector<float> res;
+  for (const auto &out : b.outs) res.push_back(out->duty());
+  return res;
+}
+
+struct Totals {
+  int64_t ticks_old = 0, ticks_new = 0;
+  int64_t writes_old = 0, writes_new = 0;
+};
+
+bool RunBulb(const BulbType &bt, Totals *tt) {
+  bool ok = true;
+  struct mgos_config_lb cfg;
+  mgos_config_lb_set_defaults(&cfg);
+  cfg.state = 0;
+  cfg.transition_space = bt.transition_space;
+  Bulb b = bt.factory(&cfg);
+  printf("%-6s %-16s %7s %7s %7s %7s %7s %5s %5s\n", bt.name, "transition",
+         "ms", "ticks", "(old)", "writes", "(old)", "rev", "sat%");
+  for (const Step &s : kSteps) {
+    const int64_t runs0 = sim::NumRuns();
+    const int writes0 = b.NumWrites();
+    const int revs0 = b.NumReversals();
+    for (auto &out : b.outs) out->ResetDirection();
+    cfg.transition_time = s.transition_time_ms;
+    for (const WriteFn &w : s.writes) {
+      if (&w != &s.writes.front()) {
+        sim::RunUntil(sim::Now() + kWriteGapMs * 1000);
+      }
+      w(&cfg);
+      b.UpdateOutput(&cfg);
+    }
+    // Lowest saturation on the way, > 1 - not measured.
+    float min_sat = 2;
+    sim::RunUntil(sim::Now() + (s.transition_time_ms + 100) * 1000, [&] {
+      if (bt.color && b.Saturation() >= 0) {
+        min_sat = std::min(min_sat, b.Saturation());
+      }
+      return false;
+    });
+    const int64_t ticks = sim::NumRuns() - runs0;
+    const int writes = b.NumWrites() - writes0;
+    const int revs = b.NumReversals() - revs0;
+    const int ticks_old =
+        std::max(1, (s.transition_time_ms + kLegacyTickMs - 1) /
+                        kLegacyTickMs) *
+        (int) b.ctls.size();
+    const int writes_old = ticks_old / b.ctls.size() * b.outs.size();
+    printf("%-6s %-16s %7d %7lld %7d %7d %7d %5d %5s\n", "", s.name,
+           s.transition_time_ms, (long long) ticks, ticks_old, writes,
+           writes_old, revs,
+           (min_sat <= 1 ? std::to_string(std::lround(min_sat * 100)).c_str()
+                         : "-"));
+    if (s.brightness_only && revs != 0) {
+      printf("  REVERSAL: %d on a brightness change\n", revs);
+      ok = false;
+    }
+    tt->ticks_old += ticks_old;
+    tt->ticks_new += ticks;
+    tt->writes_old += writes_old;
+    tt->writes_new += writes;
+    // Must end up exactly where an instant transition would.
+    const std::vector<float> want = Settle(bt, cfg);
+    for (size_t i = 0; i < b.outs.size(); i++) {
+      if (b.outs[i]->duty() == want[i]) continue;
+      printf("  MISMATCH: output %d: %.4f, want %.4f\n", (int) i + 1,
+             b.outs[i]->duty(), want[i]);
+      ok = false;
+    }
+  }
+  printf("%-6s %-16s %7d torn %d\n", "", "pwm frames", b.timer->num_frames(),
+         b.timer->num_torn());
+  if (b.timer->num_torn() != 0) ok = false;
+  return ok;
+}
+
+// Effects on a colour bulb: frames must come at the steady rate, and once an
+// effect is over or turned off the output must be exactly that of no effect.
+// Host time per frame covers the whole tick, evaluation and writes.
+bool BenchEffects() {
+  constexpr int kRunMs = 10000;
+  const struct {
+    const char *name;
+    LightEffect effect;
+    int period_ms;
+  } effects[] = {
+      {"breathe", LightEffect::kBreathe, 4000},
+      {"candle", LightEffect::kCandle, 3000},
+      {"colorloop", LightEffect::kColorLoop, 5000},
+      {"sunrise", LightEffect::kSunrise, kRunMs / 2},
+  };
+  const BulbType &bt = kBulbTypes[2];
+  bool ok = true;
+  printf("%-9s %7s %7s %7s %7s %9s %5s\n", "effect", "ms", "frames", "(want)",
+         "writes", "ns/frame", "min%");
+  for (const auto &e : effects) {
+    struct mgos_config_lb cfg;
+    mgos_config_lb_set_defaults(&cfg);
+    cfg.state = 1;
+    cfg.brightness = 80;
+    cfg.hue = 30;
+    cfg.saturation = 60;
+    cfg.transition_time = 500;
+    cfg.effect_period = e.period_ms;
+    Bulb b = bt.factory(&cfg);
+    b.UpdateOutput(&cfg);
+    sim::RunUntil(sim::Now() + 1000 * 1000);
+    float base = 0;
+    for (const auto &out : b.outs) base += out->duty();
+
+    cfg.effect = (int) e.effect;
+    b.UpdateOutput(&cfg);
+    const int64_t runs0 = sim::NumRuns();
+    const int writes0 = b.NumWrites();
+    float min = base;
+    auto t0 = std::chrono::steady_clock::now();
+    sim::RunUntil(sim::Now() + kRunMs * 1000, [&] {
+      float sum = 0;
+      for (const auto &out : b.outs) sum += out->duty();
+      min = std::min(min, sum);
+      return false;
+    });
+    auto t1 = std::chrono::steady_clock::now();
+    const int64_t frames = sim::NumRuns() - runs0;
+    const int want = std::min(kRunMs, (e.effect == LightEffect::kSunrise
+                                           ? e.period_ms
+                                           : kRunMs)) /
+                     shelly::kEffectFrameMs;
+    printf("%-9s %7d %7lld %7d %7d %9.0f %5ld\n", e.name, kRunMs,
+           (long long) frames, want, b.NumWrites() - writes0,
+           std::chrono::duration<double, std::nano>(t1 - t0).count() / frames,
+           std::lround(min / base * 100));
+    // Transition ticks may come in between, missed frames may not.
+    if (frames < want || frames > want + want / 20) ok = false;
+    // Once over, one-shot effects are off in the config too.
+    if (!shelly::LightEffectLoops(e.effect) && cfg.effect != 0) {
+      printf("  effect still set after it finished\n");
+      ok = false;
+    }
+
+    cfg.effect = (int) LightEffect::kNone;
+    b.UpdateOutput(&cfg);
+    sim::RunUntil(sim::Now() + (cfg.transition_time + 100) * 1000);
+    const std::vector<float> want_duty = Settle(bt, cfg);
+    for (size_t i = 0; i < b.outs.size(); i++) {
+      if (b.outs[i]->duty() == want_duty[i]) continue;
+      printf("  MISMATCH: output %d: %.4f, want %.4f\n", (int) i + 1,
+             b.outs[i]->duty(), want_duty[i]);
+      ok = false;
+    }
+    if (shelly::AnimationScheduler::Get()->num_active() != 0) {
+      printf("  still animating after the effect\n");
+      ok = false;
+    }
+    if (b.timer->num_torn() != 0) ok = false;
+  }
+  return ok;
+}
+
+// The same frames on four channels, written one channel at a time with
+// SetStatePWM() as before output groups, and staged and committed through an
+// OutputGroup. Frames drift against the PWM period, so boundaries fall at
+// every point of the writes. Periods that show part of a frame are torn.
+bool BenchTearing() {
+  constexpr int kNumChannels = 4;
+  constexpr int kNumFrames = 1000;
+  constexpr int64_t kFrameMicros = shelly::kEffectFrameMs * 1000 + 11;
+  bool ok = true;
+  printf("%-9s %7s %7s\n", "pwm", "frames", "torn");
+  for (bool grouped : {false, true}) {
+    MockPWMTimer timer(kPWMFreq, kPWMPhaseMicros, kStageMicros,
+                       kLatchMicros);
+    std::vector<std::unique_ptr<MockPWMOutput>> outs;
+    std::vector<Output *> group_outs;
+    for (int i = 0; i < kNumChannels; i++) {
+      outs.emplace_back(new MockPWMOutput(i + 1, &timer));
+      group_outs.push_back(outs.back().get());
+    }
+    OutputGroup group(group_outs);
+    std::vector<float> prev(kNumChannels, 0), cur(kNumChannels, 0);
+    int num_torn = 0;
+    timer.set_period_cb([&] {
+      int num_new = 0;
+      for (int i = 0; i < kNumChannels; i++) {
+        if (outs[i]->duty() == cur[i]) num_new++;
+      }
+      if (num_new > 0 && num_new < kNumChannels) num_torn++;
+    });
+    const int64_t start = sim::Now();
+    for (int k = 1; k <= kNumFrames; k++) {
+      sim::RunUntil(start + k * kFrameMicros);
+      prev = cur;
+      // Every channel changes on every frame.
+      for (int i = 0; i < kNumChannels; i++) cur[i] = ((k + i) % 7 + 1) / 8.0f;
+      for (int i = 0; i < kNumChannels; i++) {
+        if (grouped) {
+          group.Stage(i, cur[i], "bench");
+        } else {
+          outs[i]->SetStatePWM(cur[i], "bench");
+        }
+      }
+      if (grouped) group.Commit();
+    }
+    sim::RunUntil(sim::Now() + kFrameMicros);
+    outs[0]->duty();  // Runs the last boundary.
+    printf("%-9s %7d %7d\n", (grouped ? "group" : "channel"), kNumFrames,
+           num_torn);
+    // The mock must see tearing when updates are not grouped.
+    if (grouped ? (num_torn != 0 || timer.num_torn() != 0) : num_torn == 0) {
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+// Dimming curve lookup vs. computing it in floating point, as it would be
+// without the tables. Host timings, only the ratio is meaningful.
+bool BenchDimCurves() {
+  const struct {
+    const char *name;
+    DimCurve curve;
+  } curves[] = {
+      {"linear", DimCurve::kLinear},
+      {"gamma2.2", DimCurve::kGamma22},
+      {"cie1931", DimCurve::kCIE1931},
+  };
+  constexpr int kNumRuns = 2000;
+  bool ok = true;
+  printf("%-9s %9s %9s %7s %7s %7s\n", "curve", "lut ns", "float ns",
+         "max err", "1%", "10%");
+  for (const auto &c : curves) {
+    int max_err = 0;
+    for (int i = 0; i <= shelly::kDimCurveIn; i++) {
+      float y = shelly::DimCurveApplyFloat(
+          c.curve, static_cast<float>(i) / shelly::kDimCurveIn);
+      int want = std::lround(y * shelly::kDimCurveOut);
+      max_err = std::max(max_err, std::abs(DimCurveApply(c.curve, i) - want));
+    }
+    // Sums go to volatile so that the loops are not optimized out.
+    volatile int sink = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < kNumRuns; r++) {
+      int sum = 0;
+      for (int i = 0; i <= shelly::kDimCurveIn; i++) {
+        sum += DimCurveApply(c.curve, (i * 7 + r) & (shelly::kDimCurveIn - 1));
+      }
+      sink = sum;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (int r = 0; r < kNumRuns; r++) {
+      int sum = 0;
+      for (int i = 0; i <= shelly::kDimCurveIn; i++) {
+        int x = (i * 7 + r) & (shelly::kDimCurveIn - 1);
+        float y = shelly::DimCurveApplyFloat(
+            c.curve, static_cast<float>(x) / shelly::kDimCurveIn);
+        sum += std::lround(y * shelly::kDimCurveOut);
+      }
+      sink = sum;
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    (void) sink;
+    const double n = (double) kNumRuns * (shelly::kDimCurveIn + 1);
+    printf("%-9s %9.2f %9.2f %7d %7d %7d\n", c.name,
+           std::chrono::duration<double, std::nano>(t1 - t0).count() / n,
+           std::chrono::duration<double, std::nano>(t2 - t1).count() / n,
+           max_err, DimCurveApply(c.curve, shelly::kDimCurveIn / 100),
+           DimCurveApply(c.curve, shelly::kDimCurveIn / 10));
+    if (max_err > 1) ok = false;
+  }
+  return ok;
+}
+
+// HSV to RGBW in floating point, as RGBWController did before the integer
+// kernel. Reference for the golden output check.
+void RefHSVToRGBW(int hue, int saturation, int brightness, bool white,
+                  float out[4]) {
+  float h = hue / 360.0f;
+  float s = saturation / 100.0f;
+  float v = brightness / 100.0f;
+  float r, g, b;
+  if (saturation == 0) {
+    r = g = b = v;
+  } else {
+    int i = static_cast<int>(h * 6);
+    float f = (h * 6.0f - i);
+    float p = v * (1.0f - s);
+    float q = v * (1.0f - f * s);
+    float t = v * (1.0f - (1.0f - f) * s);
+    switch (i % 6) {
+      case 0:
+        r = v, g = t, b = p;
+        break;
+      case 1:
+        r = q, g = v, b = p;
+        break;
+      case 2:
+        r = p, g = v, b = t;
+        break;
+      case 3:
+        r = p, g = q, b = v;
+        break;
+      case 4:
+        r = t, g = p, b = v;
+        break;
+      default:
+        r = v, g = p, b = q;
+        break;
+    }
+  }
+  float w = (white ? std::min(r, std::min(g, b)) : 0.0f);
+  out[0] = r - w;
+  out[1] = g - w;
+  out[2] = b - w;
+  out[3] = w;
+}
+
+// Golden output check of the integer HSV to RGBW kernel against the float
+// implementation over all configurable hues and saturations, and speed of
+// both. Host timings, only the ratio is meaningful.
+bool BenchColor() {
+  using shelly::ColorRGBW;
+  using shelly::kColorMax;
+  int max_err = 0, num_off = 0, num = 0;
+  for (int white = 0; white <= 1; white++) {
+    for (int v = 0; v <= 100; v += 5) {
+      for (int s = 0; s <= 100; s++) {
+        for (int h = 0; h <= 360; h++) {
+          float want[4];
+          RefHSVToRGBW(h, s, v, white, want);
+          const ColorRGBW c =
+              shelly::HSVToRGBW(shelly::HSVFromConfig(h, s, v), white);
+          const int got[4] = {c.r, c.g, c.b, c.w};
+          for (int i = 0; i < 4; i++) {
+            int err = std::abs(got[i] - (int) std::lround(want[i] * kColorMax));
+            max_err = std::max(max_err, err);
+            if (err != 0) num_off++;
+            num++;
+          }
+        }
+      }
+    }
+  }
+  constexpr int kNumRuns = 200;
+  volatile int sink = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < kNumRuns; r++) {
+    for (int h = 0; h < 360; h++) {
+      const ColorRGBW c = shelly::HSVToRGBW(
+          shelly::HSVFromConfig(h, (h + r) % 101, (h * 3 + r) % 101), true);
+      sink = c.r + c.g + c.b + c.w;
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (int r = 0; r < kNumRuns; r++) {
+    for (int h = 0; h < 360; h++) {
+      float c[4];
+      RefHSVToRGBW(h, (h + r) % 101, (h * 3 + r) % 101, true, c);
+      sink = std::lround(c[0] * kColorMax) + std::lround(c[1] * kColorMax) +
+             std::lround(c[2] * kColorMax) + std::lround(c[3] * kColorMax);
+    }
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  (void) sink;
+  const double n = kNumRuns * 360.0;
+  printf("hsv->rgbw: int %.2f ns, float %.2f ns, max err %d/%d, %.2f%% off\n",
+         std::chrono::duration<double, std::nano>(t1 - t0).count() / n,
+         std::chrono::duration<double, std::nano>(t2 - t1).count() / n,
+         max_err, kColorMax, 100.0 * num_off / num);
+  // Saturation and brightness are quantized to 1/1024 on input, which alone
+  // accounts for up to 1.5 steps of the output.
+  return max_err <= 2;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  (void) argc;
+  (void) argv;
+  bool ok = true;
+  printf("platform: %s\n\n", kPlatform);
+  sim::SetIntsHook(MockPWMTimer::SetIntsDisabled);
+  Totals tt;
+  for (const BulbType &bt : kBulbTypes) {
+    ok &= RunBulb(bt, &tt);
+    printf("\n");
+  }
+  printf("total: ticks %lld (old %lld, %.1fx), writes %lld (old %lld, %.1fx)\n",
+         (long long) tt.ticks_new, (long long) tt.ticks_old,
+         (double) tt.ticks_old / tt.ticks_new, (long long) tt.writes_new,
+         (long long) tt.writes_old, (double) tt.writes_old / tt.writes_new);
+  printf("\n");
+  ok &= BenchEffects();
+  printf("\n");
+  ok &= BenchTearing();
+  printf("\n");
+  ok &= BenchDimCurves();
+  printf("\n");
+  ok &= BenchColor();
+  return (ok ? 0 : 1);
+}
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) Shelly-HomeKit Contributors
+# All rights reserved
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Generates mgos_sys_config.h with the structs of abstract config objects
+# (wc, gdo, in, ...) from mos.yml, so the simulation uses the same config
+# layout as the firmware.
+
+import re
+import sys
+
+TYPES = {"s": "const char *", "i": "int", "b": "int", "f": "float", "d": "double"}
+
+ENTRY_RE = re.compile(r'^\s*- \["([\w.]+)",\s*"(\w+)"(.*)$', re.M)
+VALUE_RE = re.compile(r'^,\s*("[^"]*"|[-\w.]+)')
+
+
+def c_value(typ, value):
+    if typ == "b":
+        return "1" if value == "true" else "0"
+    if typ == "s" and not value.startswith('"'):
+        return "NULL"
+    return value
+
+
+def main(mos_yml):
+    abstract = {}  # name -> {path: type}
+    defaults = {}  # name -> {path: value}
+    for key, typ, rest in ENTRY_RE.findall(open(mos_yml).read()):
+        root, _, path = key.partition(".")
+        if typ == "o":
+            if not path and "abstract: true" in rest:
+                abstract.setdefault(root, {})
+            continue
+        if path and root in abstract:
+            abstract[root][path] = typ
+            m = VALUE_RE.match(rest)
+            if m and typ in TYPES:
+                defaults.setdefault(root, {})[path] = c_value(typ, m.group(1))
+
+    out = ["// Generated from mos.yml by gen_sys_config.py, do not edit.",
+           "#pragma once", "", "#include <stdbool.h>", "",
+           '#ifdef __cplusplus', 'extern "C" {', "#endif", ""]
+
+    def emit(name, fields):
+        nested = {}
+        for path, typ in fields.items():
+            head, _, tail = path.partition(".")
+            if tail:
+                nested.setdefault(head, {})[tail] = typ
+        for head, sub in nested.items():
+            emit(name + "_" + head, sub)
+        out.append("struct %s {" % name)
+        for path, typ in fields.items():
+            head, _, tail = path.partition(".")
+            if tail:
+                member = "  struct %s_%s %s;" % (name, head, head)
+                if member not in out:
+                    out.append(member)
+            elif typ in abstract:
+                out.append("  struct mgos_config_%s %s;" % (typ, head))
+            elif typ in TYPES:
+                out.append("  %s %s;" % (TYPES[typ], head))
+        out.append("};")
+        out.append("")
+
+    for name, fields in abstract.items():
+        emit("mgos_config_" + name, fields)
+        out.append("static inline void mgos_config_%s_set_defaults("
+                   "struct mgos_config_%s *cfg) {" % (name, name))
+        for path, value in defaults.get(name, {}).items():
+            out.append("  cfg->%s = %s;" % (path, value))
+        out.append("}")
+        out.append("")
+
+    out += ["struct mgos_config {", "  int unused;", "};", "",
+            "extern struct mgos_config mgos_sys_config;", "",
+            "bool mgos_sys_config_save(const struct mgos_config *cfg, "
+            "bool try_once, char **msg);",
+            "void mgos_conf_set_str(const char **vp, const char *v);", "",
+            "#ifdef __cplusplus", "}", "#endif"]
+    print("\n".join(out))
+
+
+if __name__ == "__main__":
+    main(sys.argv[1])
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host shim for tools/wc_sim, see README.md.
+
+#pragma once
+
+#include <cstdlib>
+
+#include "common/util/status.h"
+
+namespace mgos {
+
+template <class T>
+class StatusOr {
+ public:
+  StatusOr(const T &value) : value_(value) {  // NOLINT
+  }
+  StatusOr(const Status &status) : status_(status) {  // NOLINT
+  }
+
+  bool ok() const {
+    return status_.ok();
+  }
+  const Status &status() const {
+    return status_;
+  }
+  const T &ValueOrDie() const {
+    if (!ok()) abort();
+    return value_;
+  }
+
+ private:
+  Status status_;
+  T value_{};
+};
+
+}  // namespace mgos
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host shim for tools/wc_sim, see README.md.
+// ESP-IDF GPIO driver, for code built with CS_PLATFORM = CS_P_ESP32.
+
+#pragma once
+
+typedef int gpio_num_t;
+
+static inline int gpio_hold_en(gpio_num_t pin) {
+  (void) pin;
+  return 0;
+}
+static inline int gpio_hold_dis(gpio_num_t pin) {
+  (void) pin;
+  return 0;
+}
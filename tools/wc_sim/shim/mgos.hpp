@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host shim for tools/wc_sim, see README.md.
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "common/cs_dbg.h"
+#include "common/util/status.h"
+#include "common/util/statusor.h"
+#include "mgos.h"
+#include "mgos_timers.hpp"
+
+namespace mgos {
+
+std::string SPrintf(const char *fmt, ...);
+// Supports the subset of frozen's json_printf used by the sources.
+std::string JSONPrintStringf(const char *fmt, ...);
+void JSONAppendStringf(std::string *res, const char *fmt, ...);
+
+// Runs cb on the next iteration of the (virtual) event loop.
+bool InvokeCB(std::function<void()> cb, bool from_isr = false);
+
+class ScopedCPtr {
+ public:
+  explicit ScopedCPtr(void *ptr) : ptr_(ptr) {
+  }
+  ~ScopedCPtr() {
+    free(ptr_);
+  }
+
+ private:
+  void *ptr_;
+};
+
+}  // namespace mgos
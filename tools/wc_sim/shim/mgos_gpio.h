@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host shim for tools/wc_sim, see README.md.
+
+#pragma once
+
+#include <stdbool.h>
+
+// Outputs are simulated, pins are never used.
+enum mgos_gpio_mode {
+  MGOS_GPIO_MODE_INPUT = 0,
+  MGOS_GPIO_MODE_OUTPUT = 1,
+};
+
+static inline bool mgos_gpio_set_mode(int pin, enum mgos_gpio_mode mode) {
+  (void) pin;
+  (void) mode;
+  return true;
+}
+static inline bool mgos_gpio_read_out(int pin) {
+  (void) pin;
+  return false;
+}
+static inline void mgos_gpio_write(int pin, bool level) {
+  (void) pin;
+  (void) level;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host shim for tools/wc_sim, see README.md.
+
+#pragma once
+
+#include <functional>
+
+#include "mgos_hap_service.hpp"
+
+extern const HAPService mgos_hap_accessory_information_service;
+
+namespace mgos {
+namespace hap {
+
+class Accessory {
+ public:
+  typedef std::function<HAPError(HAPAccessoryServerRef *)> IdentifyCB;
+
+  template <class... Args>
+  explicit Accessory(Args &&...) {
+  }
+
+  void SetCategory(HAPAccessoryCategory category) {
+    (void) category;
+  }
+  void AddService(Service *svc) {
+    (void) svc;
+  }
+  void AddHAPService(const HAPService *svc) {
+    (void) svc;
+  }
+};
+
+}  // namespace hap
+}  // namespace mgos
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host shim for tools/wc_sim, see README.md.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Just enough of HAP for the services under simulation to build,
+// characteristics are never read or written through HAP.
+
+struct HAPAccessoryServer {};
+typedef struct HAPAccessoryServer HAPAccessoryServerRef;
+
+typedef struct {
+  uint8_t bytes[16];
+} HAPUUID;
+
+typedef enum {
+  kHAPError_None,
+  kHAPError_Unknown,
+  kHAPError_InvalidState,
+  kHAPError_InvalidData,
+  kHAPError_OutOfResources,
+  kHAPError_NotAuthorized,
+  kHAPError_Busy,
+} HAPError;
+
+typedef uint8_t HAPAccessoryCategory;
+enum {
+  kHAPAccessoryCategory_BridgedAccessory = 0,
+  kHAPAccessoryCategory_GarageDoorOpeners = 4,
+  kHAPAccessoryCategory_Windows = 13,
+  kHAPAccessoryCategory_WindowCoverings = 14,
+};
+
+struct HAPService {
+  uint16_t iid;
+  const HAPUUID *serviceType;
+  const char *debugDescription;
+};
+
+struct HAPBoolCharacteristicReadRequest;
+struct HAPBoolCharacteristicWriteRequest;
+struct HAPUInt8CharacteristicReadRequest;
+struct HAPUInt8CharacteristicWriteRequest;
+
+#define kHAPCharacteristicValue_PositionState_GoingToMinimum 0
+#define kHAPCharacteristicValue_PositionState_GoingToMaximum 1
+#define kHAPCharacteristicValue_PositionState_Stopped 2
+#define kHAPCharacteristicValue_TargetDoorState_Open 0
+#define kHAPCharacteristicValue_TargetDoorState_Closed 1
+
+extern const HAPUUID kHAPServiceType_GarageDoorOpener;
+extern const HAPUUID kHAPServiceType_Window;
+extern const HAPUUID kHAPServiceType_WindowCovering;
+extern const HAPUUID kHAPCharacteristicType_CurrentDoorState;
+extern const HAPUUID kHAPCharacteristicType_CurrentPosition;
+extern const HAPUUID kHAPCharacteristicType_HoldPosition;
+extern const HAPUUID kHAPCharacteristicType_ObstructionDetected;
+extern const HAPUUID kHAPCharacteristicType_PositionState;
+extern const HAPUUID kHAPCharacteristicType_TargetDoorState;
+extern const HAPUUID kHAPCharacteristicType_TargetPosition;
+
+#define kHAPServiceDebugDescription_GarageDoorOpener "garage-door-opener"
+#define kHAPServiceDebugDescription_Window "window"
+#define kHAPServiceDebugDescription_WindowCovering "window-covering"
+#define kHAPCharacteristicDebugDescription_CurrentDoorState "door-state.current"
+#define kHAPCharacteristicDebugDescription_CurrentPosition "position.current"
+#define kHAPCharacteristicDebugDescription_HoldPosition "position.hold"
+#define kHAPCharacteristicDebugDescription_ObstructionDetected \
+  "obstruction-detected"
+#define kHAPCharacteristicDebugDescription_PositionState "position.state"
+#define kHAPCharacteristicDebugDescription_TargetDoorState "door-state.target"
+#define kHAPCharacteristicDebugDescription_TargetPosition "position.target"
+
+namespace mgos {
+namespace hap {
+
+class Characteristic {
+ public:
+  virtual ~Characteristic() {
+  }
+  void RaiseEvent() {
+  }
+};
+
+// Handlers and constraints are accepted and ignored.
+class BoolCharacteristic : public Characteristic {
+ public:
+  template <class... Args>
+  explicit BoolCharacteristic(Args &&...) {
+  }
+};
+
+class UInt8Characteristic : public Characteristic {
+ public:
+  template <class... Args>
+  explicit UInt8Characteristic(Args &&...) {
+  }
+};
+
+}  // namespace hap
+}  // namespace mgos
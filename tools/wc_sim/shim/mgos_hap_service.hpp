@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host shim for tools/wc_sim, see README.md.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mgos_hap_chars.hpp"
+
+namespace mgos {
+namespace hap {
+
+class Service {
+ public:
+  Service(uint16_t iid, const HAPUUID *type, const char *debug_description) {
+    svc_.iid = iid;
+    svc_.serviceType = type;
+    svc_.debugDescription = debug_description;
+  }
+  virtual ~Service() {
+  }
+
+  void AddChar(Characteristic *ch) {
+    chars_.emplace_back(ch);
+  }
+  void AddNameChar(uint16_t iid, const std::string &name) {
+    (void) iid;
+    (void) name;
+  }
+  void set_primary(bool is_primary) {
+    (void) is_primary;
+  }
+
+ protected:
+  HAPService svc_;
+
+ private:
+  std::vector<std::unique_ptr<Characteristic>> chars_;
+};
+
+}  // namespace hap
+}  // namespace mgos
+
+// The real headers are not as fine-grained.
+#include "mgos_hap_accessory.hpp"
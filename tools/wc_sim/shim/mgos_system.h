@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host shim for tools/wc_sim, see README.md.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Platform ids, as in common/platform.h. CS_PLATFORM is up to the build, so
+// that code of either platform can run on the host.
+#define CS_P_UNIX 1
+#define CS_P_ESP8266 3
+#define CS_P_ESP32 15
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Virtual time, see sim::Now().
+int64_t mgos_uptime_micros(void);
+double mgos_uptime(void);
+double mg_time(void);
+int mgos_rand_range(int from, int to);
+// Timers only run in sim::RunUntil(), see sim::SetIntsHook().
+void mgos_ints_disable(void);
+void mgos_ints_enable(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host shim for tools/wc_sim, see README.md.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+#define MGOS_TIMER_REPEAT 1
+#define MGOS_TIMER_RUN_NOW 2
+
+namespace sim {
+
+// Virtual uptime, microseconds. Only advances in RunUntil().
+int64_t Now();
+
+// Runs timers in order of their due time until virtual time reaches `until`.
+void RunUntil(int64_t until);
+
+// Same, but stops as soon as done() is true after any timer has run.
+// Returns done().
+bool RunUntil(int64_t until, const std::function<bool()> &done);
+
+// Number of timer handler runs so far.
+int64_t NumRuns();
+
+// Called with true by the outermost mgos_ints_disable() and with false by
+// the matching mgos_ints_enable(). Nothing is interrupted on the host, the
+// PWM mock holds off period boundaries meanwhile.
+void SetIntsHook(std::function<void(bool disabled)> hook);
+
+}  // namespace sim
+
+namespace mgos {
+
+class Timer {
+ public:
+  typedef std::function<void()> Handler;
+
+  Timer();
+  explicit Timer(Handler handler);
+  ~Timer();
+
+  bool Reset(int msecs, int flags);
+  void Clear();
+  bool IsValid() const;
+  int GetMsecsLeft() const;
+
+  // Scheduler state.
+  int64_t due = 0;
+  int64_t seq = 0;
+  int period_ms = 0;
+  bool armed = false;
+  Handler handler;
+
+ private:
+  Timer(const Timer &other) = delete;
+};
+
+}  // namespace mgos
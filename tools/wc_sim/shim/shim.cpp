@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host implementation of the shimmed Mongoose OS APIs: virtual time event
+// loop, logging and string formatting.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mgos.hpp"
+#include "mgos_hap.hpp"
+#include "mgos_sys_config.h"
+
+namespace sim {
+
+static int64_t s_now = 0;
+static int64_t s_seq = 0;
+static int64_t s_num_runs = 0;
+static int s_ints_disabled = 0;
+static std::function<void(bool disabled)> s_ints_hook;
+static std::vector<mgos::Timer *> s_timers;
+
+int64_t Now() {
+  return s_now;
+}
+
+static void Arm(mgos::Timer *t, int msecs) {
+  t->due = s_now + (int64_t) msecs * 1000;
+  t->seq = s_seq++;
+  if (!t->armed) s_timers.push_back(t);
+  t->armed = true;
+}
+
+static void Disarm(mgos::Timer *t) {
+  if (!t->armed) return;
+  s_timers.erase(std::find(s_timers.begin(), s_timers.end(), t));
+  t->armed = false;
+}
+
+// Runs the earliest timer due by `until`, if any.
+static bool RunNext(int64_t until) {
+  mgos::Timer *next = nullptr;
+  for (mgos::Timer *t : s_timers) {
+    if (next == nullptr || t->due < next->due ||
+        (t->due == next->due && t->seq < next->seq)) {
+      next = t;
+    }
+  }
+  if (next == nullptr || next->due > until) return false;
+  s_now = std::max(s_now, next->due);
+  if (next->period_ms > 0) {
+    // Like mgos timers, the next run is relative to this one.
+    Arm(next, next->period_ms);
+  } else {
+    Disarm(next);
+  }
+  // Handler may destroy the timer, so it must not be touched after this.
+  mgos::Timer::Handler h = next->handler;
+  s_num_runs++;
+  h();
+  return true;
+}
+
+void RunUntil(int64_t until) {
+  while (RunNext(until)) {
+  }
+  s_now = std::max(s_now, until);
+}
+
+bool RunUntil(int64_t until, const std::function<bool()> &done) {
+  if (done()) return true;
+  while (RunNext(until)) {
+    if (done()) return true;
+  }
+  s_now = std::max(s_now, until);
+  return done();
+}
+
+int64_t NumRuns() {
+  return s_num_runs;
+}
+
+void SetIntsHook(std::function<void(bool disabled)> hook) {
+  s_ints_hook = hook;
+}
+
+}  // namespace sim
+
+namespace mgos {
+
+Timer::Timer() {
+}
+
+Timer::Timer(Handler h) : handler(h) {
+}
+
+Timer::~Timer() {
+  Clear();
+}
+
+bool Timer::Reset(int msecs, int flags) {
+  Clear();
+  if (msecs < 0) return false;
+  period_ms = ((flags & MGOS_TIMER_REPEAT) ? std::max(msecs, 1) : 0);
+  sim::Arm(this, msecs);
+  if (flags & MGOS_TIMER_RUN_NOW) handler();
+  return true;
+}
+
+void Timer::Clear() {
+  sim::Disarm(this);
+}
+
+bool Timer::IsValid() const {
+  return armed;
+}
+
+int Timer::GetMsecsLeft() const {
+  return (armed ? (due - sim::Now()) / 1000 : 0);
+}
+
+bool InvokeCB(std::function<void()> cb, bool from_isr) {
+  // Self-destructing one-shot timer.
+  Timer *t = new Timer();
+  t->handler = [t, cb] {
+    cb();
+    delete t;
+  };
+  t->Reset(0, 0);
+  (void) from_isr;
+  return true;
+}
+
+static std::string VSPrintf(const char *fmt, va_list ap) {
+  va_list ap2;
+  va_copy(ap2, ap);
+  int n = vsnprintf(nullptr, 0, fmt, ap2);
+  va_end(ap2);
+  std::string res(std::max(n, 0), '\0');
+  if (n > 0) vsnprintf(&res[0], n + 1, fmt, ap);
+  return res;
+}
+
+std::string SPrintf(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  std::string res = VSPrintf(fmt, ap);
+  va_end(ap);
+  return res;
+}
+
+// Quotes bare keys and handles %Q and %B, the rest is printf.
+static void VJSONAppend(std::string *res, const char *fmt, va_list ap) {
+  for (const char *p = fmt; *p != '\0'; p++) {
+    if ((isalpha(*p) || *p == '_') && (p == fmt || strchr("{, ", p[-1]))) {
+      const char *q = p;
+      while (isalnum(*q) || *q == '_') q++;
+      if (*q == ':') {
+        res->append("\"").append(p, q - p).append("\"");
+        p = q - 1;
+        continue;
+      }
+    }
+    if (*p != '%') {
+      res->push_back(*p);
+      continue;
+    }
+    const char *spec = p++;
+    while (strchr("0123456789.-+l", *p) != nullptr) p++;
+    std::string sf(spec, p - spec + 1);
+    switch (*p) {
+      case 'Q': {
+        const char *s = va_arg(ap, const char *);
+        res->append(s != nullptr ? "\"" + std::string(s) + "\"" : "null");
+        break;
+      }
+      case 'B':
+        res->append(va_arg(ap, int) ? "true" : "false");
+        break;
+      case 'f':
+        res->append(SPrintf(sf.c_str(), va_arg(ap, double)));
+        break;
+      case 's':
+        res->append(va_arg(ap, const char *));
+        break;
+      case 'd':
+      case 'u':
+        if (sf.find("ll") != std::string::npos) {
+          res->append(SPrintf(sf.c_str(), va_arg(ap, long long)));
+        } else {
+          res->append(SPrintf(sf.c_str(), va_arg(ap, int)));
+        }
+        break;
+      case '%':
+        res->push_back('%');
+        break;
+      default:
+        abort();
+    }
+  }
+}
+
+std::string JSONPrintStringf(const char *fmt, ...) {
+  std::string res;
+  va_list ap;
+  va_start(ap, fmt);
+  VJSONAppend(&res, fmt, ap);
+  va_end(ap);
+  return res;
+}
+
+void JSONAppendStringf(std::string *res, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  VJSONAppend(res, fmt, ap);
+  va_end(ap);
+}
+
+Status Errorf(int code, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  std::string msg = VSPrintf(fmt, ap);
+  va_end(ap);
+  return Status(code, msg);
+}
+
+}  // namespace mgos
+
+static enum cs_log_level s_log_level = LL_NONE;
+
+extern "C" {
+
+void cs_log_set_level(enum cs_log_level level) {
+  s_log_level = level;
+}
+
+int cs_log_print_prefix(enum cs_log_level level, const char *file, int line) {
+  if (level > s_log_level) return 0;
+  const char *fn = strrchr(file, '/');
+  printf("%10.3f %s:%d ", sim::Now() / 1e6, (fn != nullptr ? fn + 1 : file),
+         line);
+  return 1;
+}
+
+void cs_log_printf(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  putchar('\n');
+}
+
+int64_t mgos_uptime_micros(void) {
+  return sim::Now();
+}
+
+double mgos_uptime(void) {
+  return sim::Now() / 1e6;
+}
+
+double mg_time(void) {
+  return sim::Now() / 1e6;
+}
+
+int mgos_rand_range(int from, int to) {
+  return from + rand() % (to - from + 1);
+}
+
+void mgos_ints_disable(void) {
+  if (sim::s_ints_disabled++ == 0 && sim::s_ints_hook) sim::s_ints_hook(true);
+}
+
+void mgos_ints_enable(void) {
+  if (--sim::s_ints_disabled == 0 && sim::s_ints_hook) sim::s_ints_hook(false);
+}
+
+int json_scanf(const char *str, int len, const char *fmt, ...) {
+  (void) str;
+  (void) len;
+  (void) fmt;
+  return 0;
+}
+
+struct mgos_config mgos_sys_config;
+
+bool mgos_sys_config_save(const struct mgos_config *cfg, bool try_once,
+                          char **msg) {
+  (void) cfg;
+  (void) try_once;
+  (void) msg;
+  return true;
+}
+
+void mgos_conf_set_str(const char **vp, const char *v) {
+  *vp = v;
+}
+
+}  // extern "C"
+
+const HAPService mgos_hap_accessory_information_service = {};
+const HAPUUID kHAPServiceType_GarageDoorOpener = {};
+const HAPUUID kHAPServiceType_Window = {};
+const HAPUUID kHAPServiceType_WindowCovering = {};
+const HAPUUID kHAPCharacteristicType_CurrentDoorState = {};
+const HAPUUID kHAPCharacteristicType_CurrentPosition = {};
+const HAPUUID kHAPCharacteristicType_HoldPosition = {};
+const HAPUUID kHAPCharacteristicType_ObstructionDetected = {};
+const HAPUUID kHAPCharacteristicType_PositionState = {};
+const HAPUUID kHAPCharacteristicType_TargetDoorState = {};
+const HAPUUID kHAPCharacteristicType_TargetPosition = {};
@@ -0,0 +1,987 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Virtual time simulation of the window covering and garage door opener
+// state machines. Real firmware sources run against scripted motor and door
+// models, see README.md.
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "mgos.hpp"
+#include "mgos_timers.hpp"
+
+#include "shelly_hap_garage_door_opener.hpp"
+#include "shelly_hap_input.hpp"
+#include "shelly_hap_window_covering.hpp"
+#include "shelly_input.hpp"
+#include "shelly_main.hpp"
+#include "shelly_mock_pm.hpp"
+#include "shelly_output.hpp"
+
+namespace shelly {
+
+// Not used by the simulated components, referenced by their Create*
+// functions.
+mgos::hap::Accessory::IdentifyCB GetIdentifyCB() {
+  return nullptr;
+}
+
+namespace hap {
+
+void CreateHAPInput(int id, const struct mgos_config_in *cfg,
+                    std::vector<std::unique_ptr<Component>> *comps,
+                    std::vector<std::unique_ptr<mgos::hap::Accessory>> *accs,
+                    HAPAccessoryServerRef *svr) {
+  (void) id;
+  (void) cfg;
+  (void) comps;
+  (void) accs;
+  (void) svr;
+}
+
+// Access to component internals. Commands take the same path as the
+// Shelly.SetState RPC.
+class SimAccess {
+ public:
+  static void Calibrate(WindowCovering *wc) {
+    wc->tgt_state_ = WindowCovering::State::kPreCal0;
+    wc->RunOnce();
+  }
+  static void SetTgtPos(WindowCovering *wc, float pos) {
+    wc->SetTgtPos(pos, "sim");
+    wc->RunOnce();
+  }
+  static bool IsSettled(WindowCovering *wc) {
+    return (wc->state_ == WindowCovering::State::kIdle &&
+            wc->tgt_state_ == WindowCovering::State::kNone &&
+            wc->GetDesiredMoveDirection() == WindowCovering::Direction::kNone);
+  }
+  static bool IsMoving(const WindowCovering *wc) {
+    return (wc->state_ == WindowCovering::State::kMoving);
+  }
+  static float GetCurPos(const WindowCovering *wc) {
+    return wc->cur_pos_;
+  }
+  static bool GetObstruction(const WindowCovering *wc) {
+    return wc->obstruction_detected_;
+  }
+
+  static void Toggle(GarageDoorOpener *gdo) {
+    gdo->ToggleState("sim");
+  }
+  static int GetCurState(const GarageDoorOpener *gdo) {
+    return static_cast<int>(gdo->cur_state_);
+  }
+  static bool GetObstruction(const GarageDoorOpener *gdo) {
+    return gdo->obstruction_detected_;
+  }
+};
+
+}  // namespace hap
+}  // namespace shelly
+
+namespace {
+
+using shelly::Input;
+using shelly::Output;
+using shelly::Status;
+using shelly::hap::SimAccess;
+
+// HAP Current Door State values, same as GarageDoorOpener::State.
+constexpr int kDoorOpen = 0;
+constexpr int kDoorClosed = 1;
+constexpr int kDoorOpening = 2;
+constexpr int kDoorClosing = 3;
+
+std::mt19937 s_rng;
+
+// Uniformly distributed in [a, b).
+double Uniform(double a, double b) {
+  return a + (b - a) * (s_rng() / 4294967296.0);
+}
+
+// Normally distributed, Box-Muller: std::normal_distribution output is
+// implementation-defined and runs must be reproducible.
+double Normal(double sd) {
+  double u1 = std::max(Uniform(0, 1), 1e-12), u2 = Uniform(0, 1);
+  return sd * std::sqrt(-2 * std::log(u1)) * std::cos(2 * M_PI * u2);
+}
+
+bool Chance(double p) {
+  return Uniform(0, 1) < p;
+}
+
+int64_t Now() {
+  return sim::Now();
+}
+
+double ElapsedMs(int64_t since) {
+  return (Now() - since) / 1000.0;
+}
+
+class Distribution {
+ public:
+  void Add(double v) {
+    values_.push_back(v);
+  }
+
+  void Print(const char *name, const char *unit) {
+    if (values_.empty()) {
+      printf("  %-22s %6d\n", name, 0);
+      return;
+    }
+    std::sort(values_.begin(), values_.end());
+    double sum = 0;
+    for (double v : values_) sum += v;
+    printf("  %-22s %6d %9.2f %9.2f %9.2f %9.2f %9.2f  %s\n", name,
+           (int) values_.size(), sum / values_.size(), Percentile(50),
+           Percentile(90), Percentile(99), values_.back(), unit);
+  }
+
+ private:
+  double Percentile(int p) const {
+    size_t i = (values_.size() - 1) * p / 100;
+    return values_[i];
+  }
+
+  std::vector<double> values_;
+};
+
+void PrintHeader(const char *title) {
+  printf("%s\n  %-22s %6s %9s %9s %9s %9s %9s\n", title, "", "n", "mean",
+         "p50", "p90", "p99", "max");
+}
+
+class SimInput : public Input {
+ public:
+  SimInput(int id, std::function<bool()> state_fn)
+      : Input(id), state_fn_(state_fn) {
+  }
+
+  // Input interface impl.
+  void Init() override {
+    last_state_ = state_fn_();
+  }
+  bool GetState() override {
+    return state_fn_();
+  }
+  void SetInvert(bool invert) override {
+    (void) invert;
+  }
+
+  // Reports a change of the underlying signal, if any.
+  void Poll() {
+    bool state = state_fn_();
+    if (state == last_state_) return;
+    last_state_ = state;
+    CallHandlers(Event::kChange, state);
+  }
+
+ private:
+  std::function<bool()> state_fn_;
+  bool last_state_ = false;
+};
+
+class SimOutput : public Output {
+ public:
+  SimOutput(int id, std::function<void()> change_fn)
+      : Output(id),
+        change_fn_(change_fn),
+        pulse_timer_(std::bind(&SimOutput::PulseTimerCB, this)) {
+  }
+
+  // Output interface impl.
+  bool GetState() override {
+    return state_;
+  }
+  Status SetState(bool on, const char *source) override {
+    (void) source;
+    if (on == state_) return Status::OK();
+    state_ = on;
+    change_fn_();
+    return Status::OK();
+  }
+  Status SetStatePWM(float duty, const char *source) override {
+    return SetState(duty > 0, source);
+  }
+  Status Pulse(bool on, int duration_ms, const char *source) override {
+    SetState(on, source);
+    pulse_timer_.Reset(duration_ms, 0);
+    pulse_on_ = on;
+    return Status::OK();
+  }
+  void SetInvert(bool out_invert) override {
+    (void) out_invert;
+  }
+
+ private:
+  void PulseTimerCB() {
+    SetState(!pulse_on_, "pulse");
+  }
+
+  std::function<void()> change_fn_;
+  bool state_ = false;
+  bool pulse_on_ = false;
+  mgos::Timer pulse_timer_;
+};
+
+// Tubular shutter motor driven by two relays, one per direction, each with
+// its own power meter channel.
+class ShutterMotor {
+ public:
+  struct Params {
+    double open_ms, close_ms;  // Full travel time at full speed.
+    double power_w;            // Steady state power.
+    double inrush;             // Extra power at standstill, fraction.
+    double relay_ms;           // Relay switching latency.
+    double ramp_ms;            // Time to reach full speed.
+    double coast_ms;           // Time to stop after power is removed.
+    double noise;              // Power meter noise, fraction of power.
+  };
+
+  static constexpr int kStepMs = 2;
+
+  ShutterMotor(const Params &p, double pos)
+      : p_(p),
+        pos_(pos),
+        step_timer_(std::bind(&ShutterMotor::Step, this)),
+        relay_timer_(std::bind(&ShutterMotor::RelayTimerCB, this)) {
+    step_timer_.Reset(kStepMs, MGOS_TIMER_REPEAT);
+  }
+
+  const Params &params() const {
+    return p_;
+  }
+  double pos() const {
+    return pos_;
+  }
+  // Direction the relays are driving the motor in: 1 - open, -1 - close.
+  int drive() const {
+    return drive_;
+  }
+  bool stopped() const {
+    return speed_ == 0;
+  }
+  int64_t stop_ts() const {
+    return stop_ts_;
+  }
+  int64_t end_ts() const {
+    return end_ts_;
+  }
+  // Motor first met the obstacle, binding or not.
+  int64_t contact_ts() const {
+    return contact_ts_;
+  }
+
+  // Relay contacts follow the command after a delay.
+  void Command(int dir) {
+    cmd_ = dir;
+    relay_timer_.Reset(std::max((int) p_.relay_ms, 0), 0);
+  }
+
+  // Blocks movement in direction `dir` at position `pos`, where the motor
+  // stalls drawing `stall_w`. Load rises linearly over `bind_pct` before it.
+  void SetObstacle(double pos, int dir, double bind_pct, double stall_w) {
+    jam_pos_ = pos;
+    jam_dir_ = dir;
+    bind_pct_ = bind_pct;
+    stall_power_w_ = stall_w;
+    jam_ts_ = contact_ts_ = 0;
+  }
+  void ClearObstacle() {
+    jam_dir_ = 0;
+  }
+
+  // Extra load `factor` between `pos` and `pos` + `width_pct`, both ways.
+  void SetHeavySpot(double pos, double width_pct, double factor) {
+    spot_pos_ = pos;
+    spot_width_ = width_pct;
+    spot_factor_ = factor;
+  }
+  void ClearHeavySpot() {
+    spot_width_ = 0;
+  }
+
+  // Average power per relay since the previous call, W: 0 - open, 1 - close.
+  double TakePowerW(int idx) {
+    double ms = (Now() - sample_ts_[idx]) / 1000.0;
+    double p = (ms > 0 ? energy_[idx] / ms : 0);
+    energy_[idx] = 0;
+    sample_ts_[idx] = Now();
+    if (p > 0) p = std::max(p + Normal(p_.noise * p_.power_w), 0.0);
+    return p;
+  }
+
+ private:
+  void RelayTimerCB() {
+    drive_ = cmd_;
+  }
+
+  double GetLoad() {
+    double load = 1;
+    if (spot_width_ > 0 && pos_ >= spot_pos_ &&
+        pos_ <= spot_pos_ + spot_width_) {
+      load = spot_factor_;
+    }
+    if (jam_dir_ != 0 && jam_dir_ == dir_) {
+      double dist = (jam_pos_ - pos_) * jam_dir_;
+      if (dist >= 0 && dist <= bind_pct_) {
+        if (contact_ts_ == 0) contact_ts_ = Now();
+        double bind = 1 - dist / bind_pct_;
+        load = std::max(load, 1 + (stall_power_w_ / p_.power_w - 1) * bind);
+      }
+    }
+    return load;
+  }
+
+  void Step() {
+    const double dt = kStepMs;
+    double p = 0;
+    bool was_moving = (speed_ > 0);
+    if (drive_ != 0) {
+      bool at_end = (drive_ > 0 ? pos_ >= 100 : pos_ <= 0);
+      if (dir_ != drive_) speed_ = 0;
+      dir_ = drive_;
+      if (jam_dir_ == drive_ && jam_ts_ != 0) {
+        // Stalled against the obstacle.
+        speed_ = 0;
+        p = stall_power_w_;
+      } else if (at_end) {
+        // Limit switch cuts the power.
+        speed_ = 0;
+      } else {
+        speed_ = std::min(1.0, speed_ + dt / p_.ramp_ms);
+        p = p_.power_w * (1 + p_.inrush * (1 - speed_)) * GetLoad();
+      }
+      energy_[drive_ > 0 ? 0 : 1] += p * dt;
+    } else {
+      speed_ = std::max(0.0, speed_ - dt / p_.coast_ms);
+    }
+    double travel_ms = (dir_ > 0 ? p_.open_ms : p_.close_ms);
+    double new_pos = pos_ + dir_ * speed_ * dt * 100 / travel_ms;
+    if (jam_dir_ != 0 && jam_dir_ == dir_ && jam_ts_ == 0 &&
+        (new_pos - jam_pos_) * dir_ >= 0 && (pos_ - jam_pos_) * dir_ <= 0) {
+      new_pos = jam_pos_;
+      speed_ = 0;
+      jam_ts_ = Now();
+      if (contact_ts_ == 0) contact_ts_ = jam_ts_;
+    }
+    if (new_pos >= 100 || new_pos <= 0) {
+      new_pos = std::min(std::max(new_pos, 0.0), 100.0);
+      if (drive_ != 0 && end_ts_ == 0) end_ts_ = Now();
+      speed_ = 0;
+    } else if (speed_ > 0) {
+      end_ts_ = 0;
+    }
+    pos_ = new_pos;
+    if (was_moving && speed_ == 0) stop_ts_ = Now();
+  }
+
+  const Params p_;
+  double pos_;
+  int cmd_ = 0;
+  int drive_ = 0;
+  int dir_ = 0;
+  double speed_ = 0;
+  double jam_pos_ = 0;
+  int jam_dir_ = 0;
+  double bind_pct_ = 0;
+  double stall_power_w_ = 0;
+  int64_t jam_ts_ = 0;
+  int64_t contact_ts_ = 0;
+  double spot_pos_ = 0, spot_width_ = 0, spot_factor_ = 1;
+  int64_t stop_ts_ = 0;
+  int64_t end_ts_ = 0;
+  double energy_[2] = {0, 0};  // W * ms
+  int64_t sample_ts_[2] = {0, 0};
+  mgos::Timer step_timer_;
+  mgos::Timer relay_timer_;
+};
+
+// Sectional door with a single push button: open - stop - close - stop,
+// a press while closing reverses. Sensors are active at the end positions.
+class Door {
+ public:
+  static constexpr int kStepMs = 10;
+
+  Door(double open_ms, double close_ms, double pos)
+      : open_ms_(open_ms),
+        close_ms_(close_ms),
+        pos_(pos),
+        step_timer_(std::bind(&Door::Step, this)) {
+    step_timer_.Reset(kStepMs, MGOS_TIMER_REPEAT);
+  }
+
+  double pos() const {
+    return pos_;
+  }
+  int dir() const {
+    return dir_;
+  }
+  bool is_closed() const {
+    return pos_ <= 0;
+  }
+  bool is_open() const {
+    return pos_ >= 100;
+  }
+  int64_t jam_ts() const {
+    return jam_ts_;
+  }
+  int64_t edge_ts() const {
+    return edge_ts_;
+  }
+
+  void Press() {
+    if (dir_ > 0) {
+      dir_ = 0;
+      last_dir_ = 1;
+    } else if (dir_ < 0) {
+      dir_ = 1;
+    } else if (is_closed()) {
+      dir_ = 1;
+    } else if (is_open()) {
+      dir_ = -1;
+    } else {
+      dir_ = -last_dir_;
+    }
+    if (dir_ != 0) last_dir_ = dir_;
+  }
+
+  void SetJam(double pos) {
+    jam_pos_ = pos;
+    jam_ts_ = 0;
+  }
+  void ClearJam() {
+    jam_pos_ = -1;
+  }
+
+  // Called when any of the sensors changes state.
+  std::function<void()> on_sensor_change;
+
+ private:
+  void Step() {
+    if (dir_ == 0) return;
+    bool was_closed = is_closed(), was_open = is_open();
+    double travel_ms = (dir_ > 0 ? open_ms_ : close_ms_);
+    double new_pos = pos_ + dir_ * kStepMs * 100 / travel_ms;
+    if (jam_pos_ >= 0 && (new_pos - jam_pos_) * (pos_ - jam_pos_) <= 0) {
+      new_pos = jam_pos_;
+      dir_ = 0;
+      jam_ts_ = Now();
+    }
+    pos_ = std::min(std::max(new_pos, 0.0), 100.0);
+    if (is_closed() || is_open()) dir_ = 0;
+    if (was_closed != is_closed() || was_open != is_open()) {
+      edge_ts_ = Now();
+      if (on_sensor_change) on_sensor_change();
+    }
+  }
+
+  const double open_ms_, close_ms_;
+  double pos_;
+  int dir_ = 0;
+  int last_dir_ = -1;
+  double jam_pos_ = -1;
+  int64_t jam_ts_ = 0;
+  int64_t edge_ts_ = 0;
+  mgos::Timer step_timer_;
+};
+
+struct Options {
+  unsigned seed = 1;
+  int motors = 20;
+  int moves = 100;
+  int pm_ms = 100;
+  int gdo_runs = 200;
+};
+
+struct Stats {
+  // Window covering.
+  Distribution cal_close_err, cal_open_err, cal_power_err;
+  Distribution pos_err, track_err;
+  Distribution start_lat, reverse_lat, end_stop_lat, settle_lat;
+  Distribution obst_lat, bind_lat;
+  int wc_moves = 0;
+  int false_trips = 0, missed_obstructions = 0;
+  int interlock_violations = 0, timeouts = 0, cal_failures = 0;
+  // Garage door opener.
+  Distribution gdo_state_lat, gdo_ext_lat, gdo_obst_lat;
+  int gdo_moves = 0, gdo_mismatches = 0, gdo_false_obstructions = 0;
+  int gdo_missed_obstructions = 0;
+};
+
+class WCRig {
+ public:
+  WCRig(const ShutterMotor::Params &mp, const Options &opts, Stats *stats)
+      : opts_(opts),
+        stats_(stats),
+        motor_(mp, Uniform(0, 100)),
+        in_open_(1, [] { return false; }),
+        in_close_(2, [] { return false; }),
+        out_open_(1, std::bind(&WCRig::OutputChanged, this)),
+        out_close_(2, std::bind(&WCRig::OutputChanged, this)),
+        pm_open_(1),
+        pm_close_(2),
+        pm_timer_(std::bind(&WCRig::PMTimerCB, this)) {
+    mgos_config_wc_set_defaults(&cfg_);
+    cfg_.in_mode = 3;  // Detached
+    cfg_.max_ramp_up_time_ms = 3000;
+    pm_open_.Init();
+    pm_close_.Init();
+    wc_.reset(new shelly::hap::WindowCovering(1, &in_open_, &in_close_,
+                                              &out_open_, &out_close_,
+                                              &pm_open_, &pm_close_, &cfg_));
+    wc_->Init();
+    pm_timer_.Reset(opts_.pm_ms, MGOS_TIMER_REPEAT);
+  }
+
+  bool Calibrate() {
+    const auto &mp = motor_.params();
+    // On a device power meters have been running long before calibration.
+    sim::RunUntil(Now() + (opts_.pm_ms + 1000) * 1000);
+    SimAccess::Calibrate(wc_.get());
+    if (!RunUntilSettled(4 * (mp.open_ms + mp.close_ms) + 20000)) return false;
+    if (!cfg_.calibrated) {
+      stats_->cal_failures++;
+      return false;
+    }
+    stats_->cal_close_err.Add(RelErr(cfg_.move_time_ms, mp.close_ms));
+    stats_->cal_open_err.Add(RelErr(cfg_.open_time_ms, mp.open_ms));
+    stats_->cal_power_err.Add(RelErr(cfg_.move_power, mp.power_w));
+    return true;
+  }
+
+  // Moves to a random position, possibly reversing or hitting an obstacle
+  // along the way.
+  void RunScenario() {
+    double r = Uniform(0, 1);
+    if (r < 0.15) {
+      RunObstruction();
+    } else if (r < 0.3) {
+      RunReverse();
+    } else {
+      RunMove(RandomTarget());
+    }
+  }
+
+ private:
+  static double RelErr(double v, double ref) {
+    return std::abs(v - ref) * 100 / ref;
+  }
+
+  double RandomTarget() {
+    if (Chance(0.1)) return 0;
+    if (Chance(0.1)) return 100;
+    return std::round(Uniform(1, 99));
+  }
+
+  void OutputChanged() {
+    bool op = out_open_.GetState(), cl = out_close_.GetState();
+    if (op && cl) {
+      stats_->interlock_violations++;
+      motor_.Command(0);
+      return;
+    }
+    if (!op && !cl) out_off_ts_ = Now();
+    motor_.Command(op ? 1 : (cl ? -1 : 0));
+  }
+
+  void PMTimerCB() {
+    pm_open_.SetPowerW(motor_.TakePowerW(0));
+    pm_close_.SetPowerW(motor_.TakePowerW(1));
+  }
+
+  bool RunUntil(double max_ms, const std::function<bool()> &done) {
+    return sim::RunUntil(Now() + max_ms * 1000, done);
+  }
+
+  bool IsSettled() {
+    return SimAccess::IsSettled(wc_.get()) && motor_.stopped() &&
+           motor_.drive() == 0;
+  }
+
+  bool RunUntilSettled(double max_ms) {
+    bool ok = RunUntil(max_ms, [this] { return IsSettled(); });
+    if (!ok) stats_->timeouts++;
+    return ok;
+  }
+
+  double MaxMoveMs() const {
+    const auto &mp = motor_.params();
+    return 3 * std::max(mp.open_ms, mp.close_ms) + 10000;
+  }
+
+  // Waits for the motor to start moving in the direction of `tgt`,
+  // returns false if it didn't.
+  bool WaitForStart(double tgt, Distribution *lat) {
+    int dir = (tgt > motor_.pos() ? 1 : -1);
+    int64_t cmd_ts = Now();
+    if (!RunUntil(5000, [this, dir] { return motor_.drive() == dir; })) {
+      return false;
+    }
+    lat->Add(ElapsedMs(cmd_ts));
+    return true;
+  }
+
+  void Settle(double tgt, bool record_pos) {
+    stats_->wc_moves++;
+    if (!RunUntilSettled(MaxMoveMs())) return;
+    if (record_pos) {
+      stats_->pos_err.Add(std::abs(motor_.pos() - tgt));
+    }
+    stats_->track_err.Add(
+        std::abs(motor_.pos() - SimAccess::GetCurPos(wc_.get())));
+    if (SimAccess::GetObstruction(wc_.get())) stats_->false_trips++;
+  }
+
+  void RunMove(double tgt) {
+    bool to_end = (tgt == 0 || tgt == 100);
+    // Heavy spots are normal and must not be taken for obstructions.
+    if (Chance(0.25)) {
+      double from = motor_.pos();
+      motor_.SetHeavySpot(std::min(from, tgt) + std::abs(tgt - from) *
+                                                    Uniform(0.1, 0.8),
+                          Uniform(0.5, 4), Uniform(1.1, 1.4));
+    }
+    SimAccess::SetTgtPos(wc_.get(), tgt);
+    if (std::abs(tgt - SimAccess::GetCurPos(wc_.get())) >= 2) {
+      WaitForStart(tgt, &stats_->start_lat);
+    }
+    Settle(tgt, true);
+    int64_t stop_ts = std::max(motor_.stop_ts(), motor_.end_ts());
+    if (to_end && motor_.end_ts() != 0) {
+      stats_->end_stop_lat.Add((out_off_ts_ - motor_.end_ts()) / 1000.0);
+    }
+    if (stop_ts != 0 && Now() >= stop_ts) {
+      stats_->settle_lat.Add(ElapsedMs(stop_ts));
+    }
+    motor_.ClearHeavySpot();
+  }
+
+  void RunReverse() {
+    double from = SimAccess::GetCurPos(wc_.get());
+    double tgt = (from < 50 ? Uniform(from + 40, 100) : Uniform(0, from - 40));
+    tgt = std::round(tgt);
+    SimAccess::SetTgtPos(wc_.get(), tgt);
+    if (!WaitForStart(tgt, &stats_->start_lat)) {
+      Settle(tgt, true);
+      return;
+    }
+    RunUntil(Uniform(500, 4000), [] { return false; });
+    if (!SimAccess::IsMoving(wc_.get())) {
+      Settle(tgt, true);
+      return;
+    }
+    double pos = motor_.pos();
+    double new_tgt = std::round(tgt > from ? Uniform(0, std::max(pos - 5, 0.0))
+                                           : Uniform(std::min(pos + 5, 100.0),
+                                                     100));
+    SimAccess::SetTgtPos(wc_.get(), new_tgt);
+    WaitForStart(new_tgt, &stats_->reverse_lat);
+    Settle(new_tgt, true);
+  }
+
+  void RunObstruction() {
+    double from = motor_.pos();
+    double tgt = (from < 50 ? Uniform(from + 30, 100) : Uniform(0, from - 30));
+    tgt = std::round(tgt);
+    int dir = (tgt > from ? 1 : -1);
+    double jam_pos = from + (tgt - from) * Uniform(0.3, 0.7);
+    // Half of the obstacles stop the motor dead, the rest bind gradually.
+    double bind_pct = (Chance(0.5) ? 0 : Uniform(2, 10));
+    const auto &mp = motor_.params();
+    motor_.SetObstacle(jam_pos, dir, bind_pct, mp.power_w * Uniform(1.5, 4));
+    SimAccess::SetTgtPos(wc_.get(), tgt);
+    stats_->wc_moves++;
+    bool detected = RunUntil(MaxMoveMs(), [this] {
+      return SimAccess::GetObstruction(wc_.get()) || IsSettled();
+    });
+    detected = detected && SimAccess::GetObstruction(wc_.get());
+    if (detected && motor_.contact_ts() != 0) {
+      (bind_pct > 0 ? stats_->bind_lat : stats_->obst_lat)
+          .Add((Now() - motor_.contact_ts()) / 1000.0);
+    } else if (detected) {
+      stats_->false_trips++;
+    } else {
+      stats_->missed_obstructions++;
+    }
+    RunUntilSettled(MaxMoveMs());
+    motor_.ClearObstacle();
+    // Position is lost, re-home at the nearest end.
+    RunMove(motor_.pos() < 50 ? 0 : 100);
+  }
+
+  const Options &opts_;
+  Stats *stats_;
+  ShutterMotor motor_;
+  SimInput in_open_, in_close_;
+  SimOutput out_open_, out_close_;
+  shelly::MockPowerMeter pm_open_, pm_close_;
+  struct mgos_config_wc cfg_;
+  std::unique_ptr<shelly::hap::WindowCovering> wc_;
+  mgos::Timer pm_timer_;
+  int64_t out_off_ts_ = 0;
+};
+
+ShutterMotor::Params RandomMotorParams() {
+  ShutterMotor::Params p;
+  p.open_ms = Uniform(12000, 35000);
+  // Gravity helps closing.
+  p.close_ms = p.open_ms * Uniform(0.8, 1.0);
+  p.power_w = Uniform(60, 250);
+  p.inrush = Uniform(0.1, 0.8);
+  p.relay_ms = Uniform(5, 20);
+  p.ramp_ms = Uniform(30, 200);
+  p.coast_ms = Uniform(10, 120);
+  p.noise = Uniform(0.005, 0.03);
+  return p;
+}
+
+class GDORig {
+ public:
+  GDORig(Stats *stats)
+      : stats_(stats),
+        door_(Uniform(10000, 25000), Uniform(10000, 25000),
+              Chance(0.5) ? 0 : 100),
+        in_close_(1, [this] { return door_.is_closed(); }),
+        in_open_(2, [this] { return door_.is_open(); }),
+        out_close_(1, std::bind(&GDORig::OutputChanged, this, &out_close_)),
+        out_open_(2, std::bind(&GDORig::OutputChanged, this, &out_open_)) {
+    mgos_config_gdo_set_defaults(&cfg_);
+    in_close_.Init();
+    in_open_.Init();
+    door_.on_sensor_change = [this] {
+      in_close_.Poll();
+      in_open_.Poll();
+    };
+    gdo_.reset(new shelly::hap::GarageDoorOpener(
+        1, &in_close_, &in_open_, &out_close_, &out_open_, &cfg_));
+    gdo_->Init();
+  }
+
+  void RunScenario() {
+    double r = Uniform(0, 1);
+    if (r < 0.15) {
+      RunJam();
+    } else if (r < 0.3) {
+      RunExternal();
+    } else if (r < 0.45) {
+      RunInterrupted();
+    } else {
+      RunToggle();
+    }
+  }
+
+ private:
+  void OutputChanged(SimOutput *out) {
+    // Opener reacts to the button press.
+    if (out->GetState()) door_.Press();
+  }
+
+  int State() const {
+    return SimAccess::GetCurState(gdo_.get());
+  }
+
+  bool RunUntil(double max_ms, const std::function<bool()> &done) {
+    return sim::RunUntil(Now() + max_ms * 1000, done);
+  }
+
+  bool WaitForDoorStop() {
+    return RunUntil(60000, [this] { return door_.dir() == 0; });
+  }
+
+  // Waits for the state to catch up with the sensors after the door
+  // has stopped at one of the ends.
+  void CheckEndState(Distribution *lat) {
+    int want;
+    if (door_.is_closed()) {
+      want = kDoorClosed;
+    } else if (door_.is_open()) {
+      want = kDoorOpen;
+    } else {
+      return;
+    }
+    if (RunUntil(2000, [this, want] { return State() == want; })) {
+      if (lat != nullptr) lat->Add((Now() - door_.edge_ts()) / 1000.0);
+    } else {
+      stats_->gdo_mismatches++;
+    }
+  }
+
+  void RunToggle() {
+    stats_->gdo_moves++;
+    SimAccess::Toggle(gdo_.get());
+    WaitForDoorStop();
+    CheckEndState(&stats_->gdo_state_lat);
+    if (SimAccess::GetObstruction(gdo_.get())) {
+      stats_->gdo_false_obstructions++;
+    }
+  }
+
+  // Toggled again mid-way: stops when opening, reverses when closing.
+  void RunInterrupted() {
+    stats_->gdo_moves++;
+    SimAccess::Toggle(gdo_.get());
+    RunUntil(Uniform(1000, 8000), [] { return false; });
+    SimAccess::Toggle(gdo_.get());
+    RunUntil(1000, [] { return false; });
+    if (door_.dir() == 0 && !door_.is_closed() && !door_.is_open()) {
+      // Stopped half way, the next press closes.
+      SimAccess::Toggle(gdo_.get());
+    }
+    WaitForDoorStop();
+    CheckEndState(&stats_->gdo_state_lat);
+  }
+
+  // Wall button: state follows the sensors.
+  void RunExternal() {
+    stats_->gdo_moves++;
+    int want = (door_.is_closed() ? kDoorOpening : kDoorClosing);
+    door_.Press();
+    int64_t press_ts = Now();
+    if (RunUntil(15000, [this, want] { return State() == want; })) {
+      // Leaving the end position is only visible once the sensor releases.
+      stats_->gdo_ext_lat.Add(
+          (Now() - std::max(door_.edge_ts(), press_ts)) / 1000.0);
+    } else {
+      stats_->gdo_mismatches++;
+    }
+    WaitForDoorStop();
+    CheckEndState(&stats_->gdo_state_lat);
+  }
+
+  void RunJam() {
+    stats_->gdo_moves++;
+    int dir = (door_.is_closed() ? 1 : -1);
+    double from = door_.pos();
+    door_.SetJam(from + dir * Uniform(20, 80));
+    SimAccess::Toggle(gdo_.get());
+    WaitForDoorStop();
+    bool detected = RunUntil(cfg_.move_time_ms + 5000, [this] {
+      return SimAccess::GetObstruction(gdo_.get());
+    });
+    if (detected) {
+      stats_->gdo_obst_lat.Add((Now() - door_.jam_ts()) / 1000.0);
+    } else {
+      stats_->gdo_missed_obstructions++;
+    }
+    door_.ClearJam();
+    // Obstacle removed, the next press carries on.
+    while (!door_.is_closed() && !door_.is_open()) {
+      SimAccess::Toggle(gdo_.get());
+      RunUntil(1000, [] { return false; });
+      WaitForDoorStop();
+    }
+    CheckEndState(nullptr);
+  }
+
+  Stats *stats_;
+  Door door_;
+  SimInput in_close_, in_open_;
+  SimOutput out_close_, out_open_;
+  struct mgos_config_gdo cfg_;
+  std::unique_ptr<shelly::hap::GarageDoorOpener> gdo_;
+};
+
+void Usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-s seed] [-m motors] [-n moves] [-p pm_ms] "
+          "[-g gdo_runs] [-v]\n",
+          prog);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options opts;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:m:n:p:g:vh")) != -1) {
+    switch (opt) {
+      case 's':
+        opts.seed = strtoul(optarg, nullptr, 0);
+        break;
+      case 'm':
+        opts.motors = atoi(optarg);
+        break;
+      case 'n':
+        opts.moves = atoi(optarg);
+        break;
+      case 'p':
+        opts.pm_ms = std::max(atoi(optarg), 1);
+        break;
+      case 'g':
+        opts.gdo_runs = atoi(optarg);
+        break;
+      case 'v':
+        cs_log_set_level(LL_INFO);
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+  s_rng.seed(opts.seed);
+  Stats stats;
+  for (int i = 0; i < opts.motors; i++) {
+    WCRig rig(RandomMotorParams(), opts, &stats);
+    if (!rig.Calibrate()) continue;
+    for (int j = 0; j < opts.moves; j++) rig.RunScenario();
+  }
+  for (int i = 0; i < opts.gdo_runs; i++) {
+    GDORig rig(&stats);
+    for (int j = 0; j < 8; j++) rig.RunScenario();
+  }
+
+  printf("seed %u, pm %d ms, %.0f s of virtual time\n", opts.seed, opts.pm_ms,
+         Now() / 1e6);
+  PrintHeader("WC calibration");
+  stats.cal_close_err.Print("close_time_err", "%");
+  stats.cal_open_err.Print("open_time_err", "%");
+  stats.cal_power_err.Print("move_power_err", "%");
+  PrintHeader("WC position");
+  stats.pos_err.Print("pos_err", "%");
+  stats.track_err.Print("track_err", "%");
+  PrintHeader("WC latency");
+  stats.start_lat.Print("start", "ms");
+  stats.reverse_lat.Print("reverse", "ms");
+  stats.end_stop_lat.Print("end_stop", "ms");
+  stats.settle_lat.Print("settle", "ms");
+  stats.obst_lat.Print("obstruction", "ms");
+  stats.bind_lat.Print("obstruction_binding", "ms");
+  printf(
+      "  moves %d, calibration failures %d, false trips %d, missed "
+      "obstructions %d, interlock violations %d, timeouts %d\n",
+      stats.wc_moves, stats.cal_failures, stats.false_trips,
+      stats.missed_obstructions, stats.interlock_violations, stats.timeouts);
+  PrintHeader("GDO latency");
+  stats.gdo_state_lat.Print("sensor_to_state", "ms");
+  stats.gdo_ext_lat.Print("external_move", "ms");
+  stats.gdo_obst_lat.Print("obstruction", "ms");
+  printf("  moves %d, mismatches %d, false obstructions %d, missed %d\n",
+         stats.gdo_moves, stats.gdo_mismatches, stats.gdo_false_obstructions,
+         stats.gdo_missed_obstructions);
+  return (stats.interlock_violations > 0 || stats.timeouts > 0 ? 2 : 0);
+}
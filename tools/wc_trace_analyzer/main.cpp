@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) Shelly-HomeKit Contributors
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "shelly_wc_trace.hpp"
+
+using shelly::WCPowerParams;
+using shelly::WCPowerStats;
+using shelly::WCPowerTrace;
+using shelly::WCTracePass;
+
+// Shelly.GetWCTrace response is simple enough to not need a JSON library:
+// numeric fields and an array of [dt_ms, power_dw, state, dir] arrays.
+// Long traces come in pages, which are read in order, one JSON object each.
+
+static const char *FindKey(const std::string &json, const char *key) {
+  std::string qk = std::string("\"") + key + "\"";
+  size_t pos = json.find(qk);
+  if (pos == std::string::npos) return nullptr;
+  pos = json.find(':', pos + qk.size());
+  if (pos == std::string::npos) return nullptr;
+  return json.c_str() + pos + 1;
+}
+
+static double GetNumber(const std::string &json, const char *key,
+                        double def) {
+  const char *p = FindKey(json, key);
+  return (p != nullptr ? strtod(p, nullptr) : def);
+}
+
+// Splits the input into top level objects.
+static std::vector<std::string> SplitPages(const std::string &json) {
+  std::vector<std::string> res;
+  int depth = 0;
+  size_t begin = 0;
+  for (size_t i = 0; i < json.size(); i++) {
+    if (json[i] == '{') {
+      if (depth++ == 0) begin = i;
+    } else if (json[i] == '}' && depth > 0) {
+      if (--depth == 0) res.push_back(json.substr(begin, i - begin + 1));
+    }
+  }
+  return res;
+}
+
+// Appends entries of a page, the first one starts the trace. ts is that of
+// the last entry.
+static bool ParsePage(const std::string &json, WCPowerTrace *trace,
+                      int64_t *ts) {
+  const char *p = FindKey(json, "entries");
+  if (p == nullptr) return false;
+  p = strchr(p, '[');
+  if (p == nullptr) return false;
+  p++;
+  const int offset = GetNumber(json, "offset", 0);
+  if (offset == 0) {
+    WCPowerParams pp;
+    pp.idle_power_thr = GetNumber(json, "idle_power_thr", 0);
+    pp.move_power = GetNumber(json, "move_power", 0);
+    pp.max_ramp_up_time_ms = GetNumber(json, "max_ramp_up_time_ms", 0);
+    pp.obstruction_power_coeff =
+        GetNumber(json, "obstruction_power_coeff", 0);
+    pp.obstruction_duration_ms =
+        GetNumber(json, "obstruction_duration_ms", 0);
+    *ts = GetNumber(json, "start", 0) * 1000000;
+    const char *kind = FindKey(json, "kind");
+    bool is_move = (kind != nullptr && strstr(kind, "\"move\"") == kind + 1);
+    trace->Begin((is_move ? WCPowerTrace::Kind::kMove
+                          : WCPowerTrace::Kind::kCalibration),
+                 pp, *ts);
+  } else if (offset != (int) trace->entries().size()) {
+    fprintf(stderr, "Page at %d, expected %d\n", offset,
+            (int) trace->entries().size());
+    return false;
+  }
+  while (true) {
+    while (*p == ' ' || *p == ',' || *p == '\n') p++;
+    if (*p != '[') break;
+    long v[4];
+    char *end = nullptr;
+    p++;
+    for (int i = 0; i < 4; i++) {
+      v[i] = strtol(p, &end, 10);
+      if (end == p) return false;
+      p = end;
+      while (*p == ' ' || *p == ',') p++;
+    }
+    if (*p != ']') return false;
+    p++;
+    *ts += v[0] * 1000;
+    if (v[3] == 0) {
+      trace->AddState(*ts, v[2]);
+    } else {
+      trace->AddSample(*ts, v[2], v[3], v[1] / 10.0f);
+    }
+  }
+  return (*p == ']');
+}
+
+static bool ParseTrace(const std::string &json, WCPowerTrace *trace) {
+  const std::vector<std::string> pages = SplitPages(json);
+  if (pages.empty()) return false;
+  int64_t ts = 0;
+  for (const std::string &page : pages) {
+    if (!ParsePage(page, trace, &ts)) return false;
+  }
+  return true;
+}
+
+static const char *DirStr(int dir) {
+  switch (dir) {
+    case 1:
+      return "open";
+    case 2:
+      return "close";
+  }
+  return "-";
+}
+
+static void PrintSamples(const WCPowerTrace &trace) {
+  int t_ms = 0;
+  for (const auto &e : trace.entries()) {
+    t_ms += e.dt_ms;
+    if (e.dir == 0) {
+      printf("%8d state %d\n", t_ms, e.state);
+    } else {
+      printf("%8d %-5s %7.1f\n", t_ms, DirStr(e.dir), e.p_dw / 10.0f);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  bool samples = false;
+  std::vector<const char *> files;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-s") == 0) {
+      samples = true;
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+  std::string json;
+  for (const char *file : files) {
+    FILE *fp = fopen(file, "r");
+    if (fp == nullptr) {
+      perror(file);
+      return 1;
+    }
+    char buf[1024];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) json.append(buf, n);
+    fclose(fp);
+  }
+  if (files.empty()) {
+    json.assign(std::istreambuf_iterator<char>(std::cin),
+                std::istreambuf_iterator<char>());
+  }
+  WCPowerTrace trace(1 << 20);
+  if (!ParseTrace(json, &trace)) {
+    fprintf(stderr, "Invalid trace\n");
+    return 1;
+  }
+  const WCPowerParams &pp = trace.params();
+  printf("idle_power_thr %.2f move_power %.2f max_ramp_up_time_ms %d "
+         "obstruction_power_coeff %.2f, %d entries, %d dropped\n",
+         pp.idle_power_thr, pp.move_power, pp.max_ramp_up_time_ms,
+         pp.obstruction_power_coeff, (int) trace.entries().size(),
+         (int) GetNumber(json, "dropped", 0));
+  if (samples) PrintSamples(trace);
+  printf("%5s %-5s %8s %8s %5s %7s %7s %7s %7s %7s %7s %7s\n", "state",
+         "dir", "start", "duration", "n", "ramp_up", "travel", "mean",
+         "steady", "peak", "obst", "margin");
+  for (const WCTracePass &p : AnalyzeWCPowerTrace(trace)) {
+    printf("%5d %-5s %8d %8d %5d %7d %7d %7.1f %7.1f %7.1f %7.1f %7.1f\n",
+           p.state, DirStr(p.dir), p.start_ms, p.duration_ms, p.num_samples,
+           p.ramp_up_ms, p.travel_ms, p.mean_power_w, p.steady_power_w,
+           p.peak_power_w, p.obst_power_w, p.obst_margin_w);
+    if (p.travel_ms < 0 &&
+        trace.kind() == WCPowerTrace::Kind::kCalibration) {
+      printf("      end of travel not detected\n");
+    } else if (p.obst_margin_w <= 0) {
+      printf("      peak power is above obstruction threshold\n");
+    }
+    if (p.obst_trip != WCPowerStats::Trip::kNone) {
+      printf("      obstruction detection trips (%s) at %d\n",
+             WCPowerStats::TripStr(p.obst_trip), p.obst_trip_ms);
+    }
+  }
+  return 0;
+}